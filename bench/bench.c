@@ -0,0 +1,457 @@
+#define GNU_SOURCE
+// Microbenchmarks for the in-process request path. Network and worker
+// threads are never started; every case runs on the calling thread.
+//
+// Usage: perplexity-bench [--min-time-ms=N] [filter]
+//
+// Results go to stdout as one JSON document:
+//   {"benchmarks":[{"name":..., "input_bytes":..., "iterations":...,
+//                   "ns_per_op":..., "allocs_per_op":..., "bytes_per_op":...}]}
+// Allocation counts cover malloc/calloc/realloc from every library in the
+// process (glibc only; elsewhere they are reported as -1).
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <curl/curl.h>
+#include <cjson/cJSON.h>
+#include "../src/mcp_protocol.h"
+#include "../src/json_utils.h"
+#include "../src/http_client.h"
+#include "../src/arena.h"
+#include "../src/stdin_reader.h"
+#include "../src/models/model_router.h"
+#include "../src/models/chat_payload.h"
+#include "../src/models/query_classifier.h"
+#include "../include/constants.h"
+#include "../include/usage.h"
+#include "../include/types.h"
+
+#define DEFAULT_MIN_TIME_MS 200
+#define RECV_CHUNK_SIZE (16 * 1024)     // CURL_MAX_WRITE_SIZE
+#define UPLOAD_CHUNK_SIZE (64 * 1024)   // curl's default upload buffer
+
+// Allocation accounting
+
+static unsigned long alloc_count;
+static unsigned long alloc_bytes;
+
+#ifdef __GLIBC__
+// Replacing malloc in the executable interposes it for libcurl and libcjson
+// too; glibc's own entry points do the real work.
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+#define ALLOC_COUNTING 1
+
+void *malloc(size_t size) {
+    __atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&alloc_bytes, size, __ATOMIC_RELAXED);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    __atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&alloc_bytes, count * size, __ATOMIC_RELAXED);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    __atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&alloc_bytes, size, __ATOMIC_RELAXED);
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+    __libc_free(ptr);
+}
+#else
+#define ALLOC_COUNTING 0
+#endif
+
+// Inputs
+
+// Prose with the characters that need escaping in a JSON string
+static const char SAMPLE_TEXT[] =
+    "Compare the \"levelized cost\" of green hydrogen with natural gas for steel production.\n"
+    "Include capacity factors, electrolyzer capex (2024 $/kW) and the effect of carbon prices; "
+    "cite sources.\tTabulate: region | cost | notes.\n";
+
+static char *make_text(size_t len) {
+    char *text = malloc(len + 1);
+    if (!text) return NULL;
+    for (size_t i = 0; i < len; i++) {
+        text[i] = SAMPLE_TEXT[i % (sizeof(SAMPLE_TEXT) - 1)];
+    }
+    text[len] = '\0';
+    return text;
+}
+
+// Printed JSON as a plain heap string: cJSON's buffer must go back through
+// cJSON_free, and the cases free their inputs with free()
+static char *print_json(const cJSON *item) {
+    char *printed = cJSON_PrintUnformatted(item);
+    if (!printed) return NULL;
+    char *json = strdup(printed);
+    cJSON_free(printed);
+    return json;
+}
+
+// A JSON messages array alternating user and assistant turns
+static char *make_history_json(int count, size_t content_len) {
+    char *content = make_text(content_len);
+    if (!content) return NULL;
+
+    cJSON *messages = cJSON_CreateArray();
+    for (int i = 0; i < count; i++) {
+        cJSON *msg = cJSON_CreateObject();
+        cJSON_AddStringToObject(msg, "role", i % 2 == 0 ? "user" : "assistant");
+        cJSON_AddStringToObject(msg, "content", content);
+        cJSON_AddItemToArray(messages, msg);
+    }
+    char *json = print_json(messages);
+    cJSON_Delete(messages);
+    free(content);
+    return json;
+}
+
+// A chat.completion document with citations and usage after the content
+static char *make_completion_json(size_t content_len) {
+    char *content = make_text(content_len);
+    if (!content) return NULL;
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "id", "3c90c3cc-0d44-4b50-8888-8dd25736052a");
+    cJSON_AddStringToObject(root, "model", "sonar-pro");
+    cJSON *choices = cJSON_AddArrayToObject(root, "choices");
+    cJSON *choice = cJSON_CreateObject();
+    cJSON_AddNumberToObject(choice, "index", 0);
+    cJSON *message = cJSON_AddObjectToObject(choice, "message");
+    cJSON_AddStringToObject(message, "role", "assistant");
+    cJSON_AddStringToObject(message, "content", content);
+    cJSON_AddStringToObject(choice, "finish_reason", "stop");
+    cJSON_AddItemToArray(choices, choice);
+    cJSON *citations = cJSON_AddArrayToObject(root, "citations");
+    for (int i = 0; i < 8; i++) {
+        char url[64];
+        (void)snprintf(url, sizeof(url), "https://example.com/source/%d", i);
+        cJSON_AddItemToArray(citations, cJSON_CreateString(url));
+    }
+    cJSON *usage = cJSON_AddObjectToObject(root, "usage");
+    cJSON_AddNumberToObject(usage, "prompt_tokens", 1432);
+    cJSON_AddNumberToObject(usage, "completion_tokens", (double)(content_len / 4));
+    cJSON_AddNumberToObject(usage, "total_tokens", (double)(1432 + content_len / 4));
+    cJSON_AddStringToObject(usage, "search_context_size", "low");
+
+    char *json = print_json(root);
+    cJSON_Delete(root);
+    free(content);
+    return json;
+}
+
+// Benchmark cases
+
+typedef struct {
+    const char *text;           // Request line, query, body, document or result
+    size_t len;
+    cJSON *messages_json;       // parse_messages input
+    MessageArray *messages;     // Payload input
+    CURL *curl;
+    char *scratch;
+    int fd;                     // Framed request lines for the line reader
+} BenchInput;
+
+static void bench_process_request(BenchInput *in) {
+    process_request(in->text);
+}
+
+static void bench_parse_messages(BenchInput *in) {
+    MessageArray *msg_array = parse_messages(in->messages_json);
+    free_message_array(msg_array);
+}
+
+static void bench_classifier(BenchInput *in) {
+    volatile int complex = is_complex_research_query(in->text);
+    (void)complex;
+}
+
+// Serialize the body the way a transfer consumes it: small bodies are
+// written by attach, large ones are pulled in upload-buffer-sized reads
+static void bench_payload(BenchInput *in) {
+    ChatPayloadSpec spec = {"sonar-pro", in->messages, NULL, 1, 0};
+    ChatPayload payload;
+    if (chat_payload_init(&payload, &spec) != 0) return;
+    chat_payload_attach(in->curl, &payload);
+    while (chat_payload_read(&payload, in->scratch, UPLOAD_CHUNK_SIZE) > 0) {
+    }
+    chat_payload_free(&payload);
+}
+
+// Frame every line of the input the way main() reads stdin
+static void bench_line_reader(BenchInput *in) {
+    if (lseek(in->fd, 0, SEEK_SET) != 0) return;
+    LineReader reader;
+    if (line_reader_init(&reader, in->fd, MAX_REQUEST_SIZE) != 0) return;
+    size_t len;
+    volatile size_t total = 0;
+    while (line_reader_next(&reader, &len)) total += len;
+    line_reader_free(&reader);
+}
+
+static void bench_write_memory(BenchInput *in) {
+    HTTPResponse *response = init_http_response();
+    for (size_t offset = 0; offset < in->len; offset += RECV_CHUNK_SIZE) {
+        size_t n = in->len - offset < RECV_CHUNK_SIZE ? in->len - offset : RECV_CHUNK_SIZE;
+        WriteMemoryCallback(in->text + offset, 1, n, response);
+    }
+    free_http_response(response);
+}
+
+static void bench_parse_usage(BenchInput *in) {
+    UsageInfo usage;
+    volatile int ok = parse_usage_from_response(in->text, &usage);
+    (void)ok;
+}
+
+static void bench_send_response(BenchInput *in) {
+    Responder to = {"1", NULL};
+    send_response(&to, in->text, 0, NULL);
+}
+
+// Runner
+
+static long long min_time_ns = DEFAULT_MIN_TIME_MS * 1000000LL;
+static const char *filter = NULL;
+static FILE *results = NULL;
+static int result_count = 0;
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int wanted(const char *name) {
+    return !filter || strstr(name, filter) != NULL;
+}
+
+// Double the batch until it runs for min_time_ns; report the last batch
+static void run_case(const char *name, void (*fn)(BenchInput *), BenchInput *in, size_t input_bytes) {
+    if (!wanted(name)) return;
+
+    fn(in);  // Warm pools, caches and lazily built tables
+
+    long long iterations = 1;
+    long long elapsed = 0;
+    unsigned long allocs = 0, bytes = 0;
+    for (;;) {
+        unsigned long allocs_before = __atomic_load_n(&alloc_count, __ATOMIC_RELAXED);
+        unsigned long bytes_before = __atomic_load_n(&alloc_bytes, __ATOMIC_RELAXED);
+        long long start = now_ns();
+        for (long long i = 0; i < iterations; i++) fn(in);
+        elapsed = now_ns() - start;
+        allocs = __atomic_load_n(&alloc_count, __ATOMIC_RELAXED) - allocs_before;
+        bytes = __atomic_load_n(&alloc_bytes, __ATOMIC_RELAXED) - bytes_before;
+
+        if (elapsed >= min_time_ns) break;
+        iterations *= 2;
+    }
+
+    (void)fprintf(results, "%s\n    {\"name\":\"%s\",\"input_bytes\":%zu,\"iterations\":%lld,\"ns_per_op\":%.1f,",
+                  result_count++ ? "," : "", name, input_bytes, iterations, (double)elapsed / (double)iterations);
+    if (ALLOC_COUNTING) {
+        (void)fprintf(results, "\"allocs_per_op\":%.2f,\"bytes_per_op\":%.1f}",
+                      (double)allocs / (double)iterations, (double)bytes / (double)iterations);
+    } else {
+        (void)fprintf(results, "\"allocs_per_op\":-1,\"bytes_per_op\":-1}");
+    }
+    (void)fflush(results);
+}
+
+// Message histories from a one-line question to a multi-megabyte transcript
+static const struct {
+    const char *label;
+    int count;
+    size_t content_len;
+} HISTORIES[] = {
+    {"64B", 1, 64},
+    {"2KB", 4, 512},
+    {"128KB", 32, 4096},
+    {"4MB", 512, 8192},
+};
+
+static void run_history_cases(CURL *curl, char *scratch) {
+    for (size_t h = 0; h < sizeof(HISTORIES) / sizeof(HISTORIES[0]); h++) {
+        char request_name[64], parse_name[64], payload_name[64];
+        (void)snprintf(request_name, sizeof(request_name), "process_request/tools_call/%s", HISTORIES[h].label);
+        (void)snprintf(parse_name, sizeof(parse_name), "parse_messages/%s", HISTORIES[h].label);
+        (void)snprintf(payload_name, sizeof(payload_name), "chat_payload/%s", HISTORIES[h].label);
+        if (!wanted(request_name) && !wanted(parse_name) && !wanted(payload_name)) continue;
+
+        char *history = make_history_json(HISTORIES[h].count, HISTORIES[h].content_len);
+        if (!history) continue;
+        size_t history_len = strlen(history);
+
+        // An unknown tool runs dispatch, message parsing and the error reply
+        // without leaving the process
+        size_t line_size = history_len + 128;
+        char *line = malloc(line_size);
+        if (line) {
+            (void)snprintf(line, line_size,
+                           "{\"jsonrpc\":\"2.0\",\"id\":7,\"method\":\"tools/call\","
+                           "\"params\":{\"name\":\"bench_noop\",\"arguments\":{\"messages\":%s}}}", history);
+            BenchInput in = {.text = line, .len = strlen(line)};
+            run_case(request_name, bench_process_request, &in, in.len);
+            free(line);
+        }
+
+        cJSON *messages_json = cJSON_Parse(history);
+        MessageArray *messages = parse_messages(messages_json);
+        if (messages) {
+            BenchInput in = {.messages_json = messages_json, .messages = messages, .curl = curl, .scratch = scratch};
+            run_case(parse_name, bench_parse_messages, &in, history_len);
+            run_case(payload_name, bench_payload, &in, history_len);
+        }
+        free_message_array(messages);
+        cJSON_Delete(messages_json);
+        free(history);
+    }
+}
+
+static void run_sized_cases(const char *prefix, void (*fn)(BenchInput *), char *(*make)(size_t),
+                            const size_t *sizes, const char *const *labels, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        char name[64];
+        (void)snprintf(name, sizeof(name), "%s/%s", prefix, labels[i]);
+        if (!wanted(name)) continue;
+
+        char *text = make(sizes[i]);
+        if (!text) continue;
+        BenchInput in = {.text = text, .len = strlen(text)};
+        run_case(name, fn, &in, in.len);
+        free(text);
+    }
+}
+
+// Request streams of equal total size, from many mid-sized lines to a few
+// multi-megabyte ones, read back from a memfd so every run sees the same
+// read() sizes
+static const struct {
+    const char *label;
+    int count;
+    size_t line_len;
+} LINE_STREAMS[] = {
+    {"64KB", 512, 65536},
+    {"4MB", 8, 4194304},
+    {"32MB", 1, 33554432},
+};
+
+static void run_line_reader_cases(void) {
+    for (size_t i = 0; i < sizeof(LINE_STREAMS) / sizeof(LINE_STREAMS[0]); i++) {
+        char name[64];
+        (void)snprintf(name, sizeof(name), "line_reader/%s", LINE_STREAMS[i].label);
+        if (!wanted(name)) continue;
+
+        char *line = make_text(LINE_STREAMS[i].line_len);
+        int fd = memfd_create("bench-lines", 0);
+        if (!line || fd < 0) {
+            free(line);
+            if (fd >= 0) (void)close(fd);
+            continue;
+        }
+        // One frame per line: the sample text has newlines of its own
+        for (char *nl = strchr(line, '\n'); nl; nl = strchr(nl + 1, '\n')) *nl = ' ';
+        line[LINE_STREAMS[i].line_len - 1] = '\n';
+        size_t total = 0;
+        for (int n = 0; n < LINE_STREAMS[i].count; n++) {
+            if (write(fd, line, LINE_STREAMS[i].line_len) != (ssize_t)LINE_STREAMS[i].line_len) break;
+            total += LINE_STREAMS[i].line_len;
+        }
+        free(line);
+
+        BenchInput in = {.fd = fd};
+        run_case(name, bench_line_reader, &in, total);
+        (void)close(fd);
+    }
+}
+
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--min-time-ms=", 14) == 0) {
+            min_time_ns = atoll(argv[i] + 14) * 1000000LL;
+        } else {
+            filter = argv[i];
+        }
+    }
+
+    // Responses are written to stdout; keep it for the results and send the
+    // server's own output to /dev/null
+    int results_fd = dup(STDOUT_FILENO);
+    int devnull = open("/dev/null", O_WRONLY);
+    if (results_fd < 0 || devnull < 0 || dup2(devnull, STDOUT_FILENO) < 0) {
+        (void)fprintf(stderr, "Error: cannot redirect stdout\n");
+        return 1;
+    }
+    (void)close(devnull);
+    results = fdopen(results_fd, "w");
+    if (!results) return 1;
+
+    arena_install_cjson_hooks();
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    CURL *curl = curl_easy_init();
+    char *scratch = malloc(UPLOAD_CHUNK_SIZE);
+    if (!curl || !scratch) {
+        (void)fprintf(stderr, "Error: cannot set up benchmarks\n");
+        return 1;
+    }
+
+    (void)fprintf(results, "{\"benchmarks\":[");
+
+    BenchInput in = {.text = "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"initialize\",\"params\":{}}"};
+    in.len = strlen(in.text);
+    run_case("process_request/initialize", bench_process_request, &in, in.len);
+    in.text = "{\"jsonrpc\":\"2.0\",\"id\":2,\"method\":\"tools/list\",\"params\":{}}";
+    in.len = strlen(in.text);
+    run_case("process_request/tools_list", bench_process_request, &in, in.len);
+    in.text = "[{\"jsonrpc\":\"2.0\",\"id\":\"a\",\"method\":\"initialize\",\"params\":{}},"
+              "{\"jsonrpc\":\"2.0\",\"method\":\"notifications/initialized\"},"
+              "{\"jsonrpc\":\"2.0\",\"id\":\"b\",\"method\":\"tools/list\",\"params\":{}}]";
+    in.len = strlen(in.text);
+    run_case("process_request/batch", bench_process_request, &in, in.len);
+
+    run_history_cases(curl, scratch);
+    run_line_reader_cases();
+
+    static const size_t QUERY_SIZES[] = {64, 2048, 65536};
+    static const char *const QUERY_LABELS[] = {"64B", "2KB", "64KB"};
+    run_sized_cases("is_complex_research_query", bench_classifier, make_text, QUERY_SIZES, QUERY_LABELS, 3);
+
+    static const size_t BODY_SIZES[] = {4096, 262144, 4194304};
+    static const char *const BODY_LABELS[] = {"4KB", "256KB", "4MB"};
+    run_sized_cases("write_memory_callback", bench_write_memory, make_text, BODY_SIZES, BODY_LABELS, 3);
+
+    static const size_t COMPLETION_SIZES[] = {1024, 524288};
+    static const char *const COMPLETION_LABELS[] = {"1KB", "512KB"};
+    run_sized_cases("parse_usage_from_response", bench_parse_usage, make_completion_json, COMPLETION_SIZES,
+                    COMPLETION_LABELS, 2);
+
+    static const size_t RESULT_SIZES[] = {128, 16384, 1048576};
+    static const char *const RESULT_LABELS[] = {"128B", "16KB", "1MB"};
+    run_sized_cases("send_response", bench_send_response, make_text, RESULT_SIZES, RESULT_LABELS, 3);
+
+    (void)fprintf(results, "\n]}\n");
+    (void)fclose(results);
+
+    free(scratch);
+    curl_easy_cleanup(curl);
+    curl_global_cleanup();
+    arena_pool_cleanup();
+    query_classifier_free();
+    http_client_cleanup();
+    return 0;
+}
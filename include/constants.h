@@ -2,9 +2,15 @@
 #define CONSTANTS_H
 
 #define MAX_BUFFER_SIZE 65536
-#define MAX_LINE_SIZE 8192
-#define API_URL "https://api.perplexity.ai/chat/completions"
-#define ASYNC_API_URL "https://api.perplexity.ai/async/chat/completions"
+#define READ_CHUNK_SIZE 65536
+#define MAX_REQUEST_SIZE (256UL * 1024 * 1024)
+#define DEFAULT_WORKER_THREADS 8
+#define MAX_WORKER_THREADS 64
+#define DEFAULT_API_BASE_URL "https://api.perplexity.ai"
+#define CHAT_COMPLETIONS_PATH "/chat/completions"
+#define ASYNC_CHAT_COMPLETIONS_PATH "/async/chat/completions"
+#define MAX_API_URL_SIZE 512
+#define MAX_DEADLINE_MS (24L * 60 * 60 * 1000)
 
 #define SERVER_NAME "perplexity-mcp-server"
 #define SERVER_VERSION "0.4.0"
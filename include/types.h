@@ -2,17 +2,21 @@
 #define TYPES_H
 
 #include <stddef.h>
+#include "usage.h"
 
 // HTTP response structure for curl operations
 typedef struct {
     char *memory;
     size_t size;
+    size_t capacity;
+    unsigned int allocations;   // Buffers malloc'd for this response (pool misses)
+    unsigned int pool_hits;     // Buffers taken from the receive pool
 } HTTPResponse;
 
 // Individual chat message
 typedef struct {
-    char *role;
-    char *content;
+    const char *role;       // Borrowed from the parsed request
+    const char *content;
 } ChatMessage;
 
 // Array of chat messages
@@ -21,4 +25,29 @@ typedef struct {
     int count;
 } MessageArray;
 
+// Per-call options threaded from tools/call through the router
+typedef struct {
+    int force_async;    // Always use deep research (perplexity_deep_research)
+    int background;     // Deep research returns a job handle instead of waiting
+    int bypass_cache;   // Skip the response cache lookup (arguments.cache == false)
+    const char *progress_token;  // Serialized params._meta.progressToken; streams when set
+    const char *tool_name;       // Tool billed in the cost ledger
+    long deadline_ms;   // Routing hint: answer wanted within this time (0: none)
+    double max_cost_usd;  // Routing hint: spend at most this per call (0: none)
+    int hedge;          // Research: 1 always hedge, -1 never, 0 borderline queries with a deadline
+    struct CancelToken *cancel;  // Client cancellation and deadline (NULL: none)
+    const char *model;  // Use this model instead of routing (perplexity_batch items)
+
+    // Filled in by the model executors
+    double cost;        // Total USD billed for this call
+    UsageInfo usage;    // Tokens billed for this call, summed over its requests
+    const char *model_used;  // Model that produced the result
+    int complete;       // Result is a finished answer (not an error, timeout or job handle)
+    const char *error;  // Static message for the client when there is no result
+} RequestContext;
+
+// Completion of a call that holds no thread while it waits: result is
+// malloc'd, or NULL on failure (the RequestContext says why)
+typedef void (*call_done_fn)(char *result, void *userdata);
+
 #endif
@@ -1,6 +1,10 @@
 #ifndef USAGE_H
 #define USAGE_H
 
+// Models with a row in the pricing table. The cost ledger journal stores
+// these indices, so new models are only ever appended.
+#define USAGE_MODEL_COUNT 5
+
 // Usage tracking structure
 typedef struct {
     int prompt_tokens;
@@ -9,7 +13,7 @@ typedef struct {
     int citation_tokens;        // Deep Research only
     int num_search_queries;     // Deep Research only
     int reasoning_tokens;       // Deep Research only
-    char *search_context_size;  // "low", "medium", "high"
+    char search_context_size[16];  // "low", "medium", "high"
 } UsageInfo;
 
 // Cost calculation structure
@@ -22,11 +26,15 @@ typedef struct {
     double total_cost;
 } CostInfo;
 
-// Function declarations
-UsageInfo *parse_usage_from_response(const char *response_json);
-CostInfo *calculate_cost(UsageInfo *usage, const char *model);
+// Results are written to caller-provided structs; both return 0 on success
+int parse_usage_from_response(const char *response_json, UsageInfo *info);
+int parse_usage_object(const char *p, const char *end, UsageInfo *info);
+int calculate_cost(const UsageInfo *usage, const char *model, CostInfo *cost);
+void usage_add(UsageInfo *sum, const UsageInfo *add);
 void log_usage_and_cost(const char *model, const UsageInfo *usage, const CostInfo *cost);
-void free_usage_info(UsageInfo *usage);
-void free_cost_info(CostInfo *cost);
+
+// Pricing table row for model (-1 if unpriced), and the model of a row
+int usage_model_index(const char *model);
+const char *usage_model_name(int index);
 
 #endif
@@ -0,0 +1,575 @@
+#define GNU_SOURCE
+#include "admission.h"
+#include "event_loop.h"
+#include "http_client.h"
+#include "metrics.h"
+#include "../include/usage.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#define MODEL_SLOTS (USAGE_MODEL_COUNT + 1)     // Priced models, plus one for anything else
+#define DEFAULT_BURST_SECONDS 10.0              // Default burst: this much of the per-minute rate
+#define MAX_TOKEN_WAIT_MS 30000LL               // Longest wait for a token without a deadline
+#define DEFAULT_MAX_RETRIES 2
+#define BACKOFF_BASE_MS 500LL
+#define BACKOFF_CAP_MS 8000LL
+#define RETRY_AFTER_CAP_MS 60000LL
+#define RETRY_BUDGET_MAX 10.0                   // Retries available after a quiet spell
+#define RETRY_BUDGET_PER_CALL 0.2               // Each first attempt earns a fifth of a retry
+#define BREAKER_THRESHOLD 5                     // Consecutive failures that open the breaker
+#define BREAKER_COOLDOWN_MS 5000LL
+#define BREAKER_MAX_COOLDOWN_MS 60000LL
+
+typedef enum {
+    BREAKER_CLOSED = 0,
+    BREAKER_OPEN,
+    BREAKER_HALF_OPEN
+} BreakerState;
+
+typedef struct {
+    // Token bucket; rate 0 means unlimited
+    double rate;                // Tokens per millisecond
+    double burst;
+    double tokens;              // Negative while callers wait on reservations
+    long long refilled_ms;      // In the future while a 429 pauses the model
+    long long blocked_until_ms; // Same pause for unlimited buckets
+
+    // Circuit breaker
+    BreakerState state;
+    int failures;               // Consecutive
+    int probing;                // Half-open: one call is testing the API
+    long long open_until_ms;
+    long long cooldown_ms;
+
+    // Counters
+    unsigned long calls;
+    unsigned long throttled;    // Calls that waited for a token
+    long long waited_ms;
+    unsigned long rejected;     // No token before the deadline
+    unsigned long retries;
+    unsigned long rate_limited; // 429 responses
+    unsigned long fast_failures;
+    unsigned long breaker_opens;
+} ModelAdmission;
+
+static ModelAdmission models[MODEL_SLOTS];
+static double retry_budget = RETRY_BUDGET_MAX;
+static int max_retries = DEFAULT_MAX_RETRIES;
+static pthread_mutex_t admission_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread unsigned int jitter_seed;
+
+static int slot_for(const char *model) {
+    int index = model ? usage_model_index(model) : -1;
+    return index >= 0 ? index : USAGE_MODEL_COUNT;
+}
+
+static const char *slot_name(int slot) {
+    return slot < USAGE_MODEL_COUNT ? usage_model_name(slot) : "other";
+}
+
+// Uniform in [0, range]
+static long long jitter_ms(long long range) {
+    if (range <= 0) return 0;
+    if (jitter_seed == 0) jitter_seed = (unsigned int)(event_loop_now_ms() ^ (uintptr_t)&jitter_seed) | 1U;
+    return (long long)((double)rand_r(&jitter_seed) / RAND_MAX * (double)range);
+}
+
+static void set_rate(ModelAdmission *m, double rpm, double burst) {
+    m->rate = rpm > 0 ? rpm / 60000.0 : 0.0;
+    if (burst < 1.0) burst = rpm * DEFAULT_BURST_SECONDS / 60.0;
+    m->burst = burst < 1.0 ? 1.0 : burst;
+    m->tokens = m->burst;
+}
+
+// "model=rpm[:burst],..."
+static void parse_rate_limits(const char *spec) {
+    char *copy = strdup(spec);
+    if (!copy) return;
+
+    char *saveptr = NULL;
+    for (char *item = strtok_r(copy, ",", &saveptr); item; item = strtok_r(NULL, ",", &saveptr)) {
+        char *eq = strchr(item, '=');
+        int slot = -1;
+        if (eq) {
+            *eq = '\0';
+            slot = usage_model_index(item);
+        }
+        if (slot < 0) {
+            (void)fprintf(stderr, "Warning: ignoring rate limit '%s' (expected model=rpm[:burst])\n", item);
+            continue;
+        }
+        char *colon = strchr(eq + 1, ':');
+        set_rate(&models[slot], atof(eq + 1), colon ? atof(colon + 1) : 0.0);
+    }
+    free(copy);
+}
+
+int admission_init(void) {
+    // Models without a configured limit are unlimited; a 429 pauses them for its Retry-After
+    for (int slot = 0; slot < MODEL_SLOTS; slot++) {
+        models[slot].refilled_ms = event_loop_now_ms();
+        models[slot].cooldown_ms = BREAKER_COOLDOWN_MS;
+    }
+
+    const char *limits = getenv("PERPLEXITY_RATE_LIMITS");
+    if (limits && *limits) parse_rate_limits(limits);
+    const char *retries = getenv("PERPLEXITY_MAX_RETRIES");
+    if (retries && *retries) {
+        max_retries = atoi(retries);
+        if (max_retries < 0) max_retries = 0;
+    }
+
+    for (int slot = 0; slot < USAGE_MODEL_COUNT; slot++) {
+        if (models[slot].rate > 0) {
+            (void)fprintf(stderr, "Rate limit %s: %.0f/min, burst %.0f\n", slot_name(slot),
+                          models[slot].rate * 60000.0, models[slot].burst);
+        }
+    }
+    return 0;
+}
+
+/* ---- Token bucket ---- */
+
+// Caller holds admission_lock
+static void refill(ModelAdmission *m, long long now) {
+    if (m->rate <= 0 || now <= m->refilled_ms) return;
+    m->tokens += (double)(now - m->refilled_ms) * m->rate;
+    if (m->tokens > m->burst) m->tokens = m->burst;
+    m->refilled_ms = now;
+}
+
+// Reserve a token; returns how long to wait for it, or -1 when it would not
+// come before the deadline. Reservations queue callers at the refill rate,
+// so a burst drains in order rather than waking together.
+static long long reserve_token(ModelAdmission *m, const CancelToken *cancel) {
+    pthread_mutex_lock(&admission_lock);
+    long long now = event_loop_now_ms();
+    long long wait = 0;
+    if (m->rate > 0) {
+        refill(m, now);
+        if (m->refilled_ms > now) wait = m->refilled_ms - now;
+        if (m->tokens < 1.0) wait += (long long)((1.0 - m->tokens) / m->rate) + 1;
+    } else if (m->blocked_until_ms > now) {
+        // Nothing spaces unlimited callers out, so spread them over a quarter of the pause
+        wait = m->blocked_until_ms - now;
+        wait += jitter_ms(wait / 4);
+    }
+
+    long long limit = MAX_TOKEN_WAIT_MS;
+    if (cancel && cancel->deadline_ms > 0) limit = cancel->deadline_ms - now;
+    if (wait > limit) {
+        m->rejected++;
+        pthread_mutex_unlock(&admission_lock);
+        return -1;
+    }
+    if (m->rate > 0) m->tokens -= 1.0;
+    if (wait > 0) {
+        m->throttled++;
+        m->waited_ms += wait;
+    }
+    pthread_mutex_unlock(&admission_lock);
+    return wait;
+}
+
+// Hand back a reservation the caller gave up waiting for
+static void return_token(ModelAdmission *m) {
+    pthread_mutex_lock(&admission_lock);
+    if (m->rate > 0) m->tokens += 1.0;
+    pthread_mutex_unlock(&admission_lock);
+}
+
+// A 429 pauses the whole model: later reservations start after the pause.
+// Caller holds admission_lock.
+static void pause_model(ModelAdmission *m, long long now, long long pause_ms) {
+    if (m->rate > 0) {
+        refill(m, now);
+        if (m->tokens > 0) m->tokens = 0;
+        if (m->refilled_ms < now + pause_ms) m->refilled_ms = now + pause_ms;
+    } else if (m->blocked_until_ms < now + pause_ms) {
+        m->blocked_until_ms = now + pause_ms;
+    }
+}
+
+/* ---- Circuit breaker ---- */
+
+// Caller holds admission_lock; returns 0 if the call may go ahead
+static int breaker_admit(ModelAdmission *m, long long now) {
+    if (m->state == BREAKER_OPEN && now >= m->open_until_ms) {
+        m->state = BREAKER_HALF_OPEN;
+        m->probing = 0;
+    }
+    if (m->state == BREAKER_OPEN || (m->state == BREAKER_HALF_OPEN && m->probing)) {
+        m->fast_failures++;
+        return -1;
+    }
+    if (m->state == BREAKER_HALF_OPEN) m->probing = 1;
+    return 0;
+}
+
+typedef enum {
+    OUTCOME_OK,
+    OUTCOME_RATE_LIMITED,
+    OUTCOME_FAILED,             // Server error or transport failure
+    OUTCOME_NEUTRAL             // Cancelled or cut short by the deadline: says nothing about the API
+} Outcome;
+
+static Outcome classify(CURLcode res, long http_code, const CancelToken *cancel) {
+    if (res == CURLE_ABORTED_BY_CALLBACK) return OUTCOME_NEUTRAL;
+    if (res == CURLE_OPERATION_TIMEDOUT && cancel_token_expired(cancel)) return OUTCOME_NEUTRAL;
+    if (res != CURLE_OK || http_code >= 500) return OUTCOME_FAILED;
+    if (http_code == 429) return OUTCOME_RATE_LIMITED;
+    return OUTCOME_OK;
+}
+
+// Transient failures worth another attempt. Timeouts are not: each already
+// took the full per-attempt limit. Neither is a transfer that broke after
+// part of a body arrived (a stream may have forwarded it already).
+static int retryable(CURL *curl, Outcome outcome, CURLcode res, long http_code) {
+    if (outcome == OUTCOME_RATE_LIMITED) return 1;
+    if (outcome != OUTCOME_FAILED) return 0;
+    if (res == CURLE_OK) return http_code == 500 || http_code == 502 || http_code == 503 || http_code == 504;
+
+    curl_off_t received = 0;
+    curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &received);
+    if (received > 0) return 0;
+    return res == CURLE_COULDNT_CONNECT || res == CURLE_COULDNT_RESOLVE_HOST || res == CURLE_GOT_NOTHING ||
+           res == CURLE_SEND_ERROR || res == CURLE_RECV_ERROR;
+}
+
+// Caller holds admission_lock
+static void breaker_record(ModelAdmission *m, int slot, Outcome outcome, long long now) {
+    int probe = m->probing;
+    m->probing = 0;
+    if (outcome == OUTCOME_NEUTRAL) return;
+
+    if (outcome != OUTCOME_FAILED) {
+        if (m->state != BREAKER_CLOSED) {
+            (void)fprintf(stderr, "Circuit breaker for %s closed\n", slot_name(slot));
+        }
+        m->state = BREAKER_CLOSED;
+        m->failures = 0;
+        m->cooldown_ms = BREAKER_COOLDOWN_MS;
+        return;
+    }
+
+    m->failures++;
+    if (m->state == BREAKER_CLOSED && m->failures < BREAKER_THRESHOLD) return;
+    if (m->state == BREAKER_OPEN) return;
+
+    // A failed probe doubles the cooldown
+    if (m->cooldown_ms < BREAKER_COOLDOWN_MS) m->cooldown_ms = BREAKER_COOLDOWN_MS;
+    if (probe && m->state == BREAKER_HALF_OPEN) {
+        m->cooldown_ms *= 2;
+        if (m->cooldown_ms > BREAKER_MAX_COOLDOWN_MS) m->cooldown_ms = BREAKER_MAX_COOLDOWN_MS;
+    }
+    m->state = BREAKER_OPEN;
+    m->open_until_ms = now + m->cooldown_ms;
+    m->breaker_opens++;
+    (void)fprintf(stderr, "Circuit breaker for %s open for %lld ms after %d failures\n", slot_name(slot),
+                  m->cooldown_ms, m->failures);
+}
+
+/* ---- Public API ---- */
+
+int admission_try(const char *model) {
+    pthread_mutex_lock(&admission_lock);
+    ModelAdmission *m = &models[slot_for(model)];
+    int rc = breaker_admit(m, event_loop_now_ms());
+    if (rc == 0) m->calls++;
+    pthread_mutex_unlock(&admission_lock);
+    return rc;
+}
+
+void admission_record(const char *model, CURLcode res, long http_code) {
+    int slot = slot_for(model);
+    pthread_mutex_lock(&admission_lock);
+    ModelAdmission *m = &models[slot];
+    Outcome outcome = classify(res, http_code, NULL);
+    if (outcome == OUTCOME_RATE_LIMITED) m->rate_limited++;
+    breaker_record(m, slot, outcome, event_loop_now_ms());
+    pthread_mutex_unlock(&admission_lock);
+}
+
+void admission_withdraw(const char *model) {
+    pthread_mutex_lock(&admission_lock);
+    models[slot_for(model)].probing = 0;
+    pthread_mutex_unlock(&admission_lock);
+}
+
+/* ---- Attempts ---- */
+
+// The breaker goes first; there is no point waiting for a token to fail.
+// Returns 0 if the attempt may go ahead.
+static int begin_attempt(ModelAdmission *m, int attempt) {
+    pthread_mutex_lock(&admission_lock);
+    int admitted = breaker_admit(m, event_loop_now_ms()) == 0;
+    if (admitted) m->calls++;
+    if (admitted && attempt == 0 && retry_budget < RETRY_BUDGET_MAX) {
+        retry_budget += RETRY_BUDGET_PER_CALL;
+    }
+    pthread_mutex_unlock(&admission_lock);
+    return admitted ? 0 : -1;
+}
+
+// Point a leased handle at the next attempt
+static void prepare_attempt(CURL *curl, const AdmissionSpec *spec, int attempt) {
+    if (attempt > 0 && spec->response) http_response_reset(spec->response);
+    http_client_set_deadline(curl, spec->cancel, spec->timeout_ms);
+}
+
+// Record a finished attempt; returns the delay before the next one, or -1
+// when the call is over
+static long long settle_attempt(CURL *curl, const AdmissionSpec *spec, int attempt, CURLcode res) {
+    int slot = slot_for(spec->model);
+    ModelAdmission *m = &models[slot];
+    metrics_record_transfer(spec->model, curl, res);
+
+    long http_code = 0;
+    if (res == CURLE_OK) curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+    Outcome outcome = classify(res, http_code, spec->cancel);
+
+    long long now = event_loop_now_ms();
+    long long delay = -1;
+    pthread_mutex_lock(&admission_lock);
+    breaker_record(m, slot, outcome, now);
+    if (outcome == OUTCOME_RATE_LIMITED) {
+        m->rate_limited++;
+        curl_off_t retry_after = 0;
+        curl_easy_getinfo(curl, CURLINFO_RETRY_AFTER, &retry_after);
+        long long pause = retry_after > 0 ? (long long)retry_after * 1000LL : BACKOFF_BASE_MS << attempt;
+        if (pause > RETRY_AFTER_CAP_MS) pause = RETRY_AFTER_CAP_MS;
+        // Requests wait out the pause in the bucket along with everyone else
+        pause_model(m, now, pause);
+        delay = spec->kind == ADMISSION_POLL ? pause : 0;
+    } else if (retryable(curl, outcome, res, http_code)) {
+        // Exponential backoff with equal jitter
+        long long cap = BACKOFF_BASE_MS << attempt;
+        if (cap > BACKOFF_CAP_MS) cap = BACKOFF_CAP_MS;
+        delay = cap / 2 + jitter_ms(cap / 2);
+    }
+    int retry = delay >= 0 && attempt < max_retries && retry_budget >= 1.0 && !cancel_token_expired(spec->cancel);
+    if (retry) {
+        retry_budget -= 1.0;
+        m->retries++;
+    }
+    pthread_mutex_unlock(&admission_lock);
+
+    if (!retry) return -1;
+    if (res != CURLE_OK) {
+        (void)fprintf(stderr, "Retrying %s after %s (attempt %d/%d)\n", spec->model, curl_easy_strerror(res),
+                      attempt + 2, max_retries + 1);
+    } else {
+        (void)fprintf(stderr, "Retrying %s after HTTP %ld (attempt %d/%d)\n", spec->model, http_code,
+                      attempt + 2, max_retries + 1);
+    }
+    return delay;
+}
+
+AdmissionResult admission_perform(CURL *curl, const AdmissionSpec *spec, CURLcode *res) {
+    ModelAdmission *m = &models[slot_for(spec->model)];
+    *res = CURLE_OK;
+
+    for (int attempt = 0;; attempt++) {
+        if (begin_attempt(m, attempt) != 0) return ADMISSION_CIRCUIT_OPEN;
+
+        if (spec->kind == ADMISSION_REQUEST) {
+            long long wait = reserve_token(m, spec->cancel);
+            if (wait < 0 || (wait > 0 && cancel_token_sleep(spec->cancel, wait))) {
+                if (wait > 0) return_token(m);
+                admission_withdraw(spec->model);
+                return wait < 0 ? ADMISSION_THROTTLED : ADMISSION_EXPIRED;
+            }
+        }
+
+        prepare_attempt(curl, spec, attempt);
+        *res = http_client_perform(curl);
+
+        long long delay = settle_attempt(curl, spec, attempt, *res);
+        if (delay < 0) return ADMISSION_PERFORMED;
+        if (delay > 0 && cancel_token_sleep(spec->cancel, delay)) return ADMISSION_PERFORMED;
+    }
+}
+
+/* ---- Event loop driven calls ---- */
+
+// One admission_submit() call; token waits and backoff run as loop timers
+typedef struct {
+    CURL *curl;
+    AdmissionSpec spec;
+    ModelAdmission *m;
+    int attempt;
+    CURLcode res;               // Result of the last attempt
+    long long resume_ms;        // End of the current wait
+    timer_fn resume;            // What to do once it is over
+    admission_done_fn on_done;
+    void *userdata;
+} AdmissionCall;
+
+static void start_attempt(AdmissionCall *call);
+
+static void finish_call(AdmissionCall *call, AdmissionResult result, CURLcode res) {
+    call->on_done(call->curl, result, res, call->userdata);
+    free(call);
+}
+
+// Sleep until resume_ms in CANCEL_CHECK_MS slices, like cancel_token_sleep()
+static void wait_slice(void *userdata) {
+    AdmissionCall *call = (AdmissionCall *)userdata;
+    long long left = call->resume_ms - event_loop_now_ms();
+    if (left > 0 && !cancel_token_expired(call->spec.cancel)) {
+        if (event_loop_add_timer((long)(left < CANCEL_CHECK_MS ? left : CANCEL_CHECK_MS), wait_slice, call) == 0) {
+            return;
+        }
+    }
+    call->resume(call);
+}
+
+static void wait_then(AdmissionCall *call, long long delay_ms, timer_fn resume) {
+    call->resume_ms = event_loop_now_ms() + delay_ms;
+    call->resume = resume;
+    wait_slice(call);
+}
+
+// Backoff over; a call that expired meanwhile ends with its last result
+static void retry_ready(void *userdata) {
+    AdmissionCall *call = (AdmissionCall *)userdata;
+    if (cancel_token_expired(call->spec.cancel)) {
+        finish_call(call, ADMISSION_PERFORMED, call->res);
+        return;
+    }
+    start_attempt(call);
+}
+
+static void attempt_done(CURL *curl, CURLcode res, void *userdata) {
+    AdmissionCall *call = (AdmissionCall *)userdata;
+    call->res = res;
+    long long delay = settle_attempt(curl, &call->spec, call->attempt, res);
+    if (delay < 0) {
+        finish_call(call, ADMISSION_PERFORMED, res);
+        return;
+    }
+    call->attempt++;
+    wait_then(call, delay, retry_ready);
+}
+
+static void send_attempt(AdmissionCall *call) {
+    prepare_attempt(call->curl, &call->spec, call->attempt);
+    if (event_loop_add_transfer(call->curl, attempt_done, call) != 0) {
+        attempt_done(call->curl, CURLE_FAILED_INIT, call);
+    }
+}
+
+static void token_ready(void *userdata) {
+    AdmissionCall *call = (AdmissionCall *)userdata;
+    if (cancel_token_expired(call->spec.cancel)) {
+        return_token(call->m);
+        admission_withdraw(call->spec.model);
+        finish_call(call, ADMISSION_EXPIRED, CURLE_OK);
+        return;
+    }
+    send_attempt(call);
+}
+
+static void start_attempt(AdmissionCall *call) {
+    if (begin_attempt(call->m, call->attempt) != 0) {
+        finish_call(call, ADMISSION_CIRCUIT_OPEN, CURLE_OK);
+        return;
+    }
+    if (call->spec.kind == ADMISSION_REQUEST) {
+        long long wait = reserve_token(call->m, call->spec.cancel);
+        if (wait < 0) {
+            admission_withdraw(call->spec.model);
+            finish_call(call, ADMISSION_THROTTLED, CURLE_OK);
+            return;
+        }
+        if (wait > 0) {
+            wait_then(call, wait, token_ready);
+            return;
+        }
+    }
+    send_attempt(call);
+}
+
+void admission_submit(CURL *curl, const AdmissionSpec *spec, admission_done_fn on_done, void *userdata) {
+    AdmissionCall *call = event_loop_is_running() ? calloc(1, sizeof(AdmissionCall)) : NULL;
+    if (!call) {
+        // No loop to drive the call: run it on this thread
+        CURLcode res = CURLE_OK;
+        AdmissionResult result = admission_perform(curl, spec, &res);
+        on_done(curl, result, res, userdata);
+        return;
+    }
+
+    call->curl = curl;
+    call->spec = *spec;
+    call->m = &models[slot_for(spec->model)];
+    call->on_done = on_done;
+    call->userdata = userdata;
+    start_attempt(call);
+}
+
+const char *admission_error(AdmissionResult result, CURLcode res, long http_code) {
+    switch (result) {
+        case ADMISSION_CIRCUIT_OPEN:
+            return "Perplexity API is failing; not sending requests for a few seconds";
+        case ADMISSION_THROTTLED:
+            return "Rate limit for this model reached; no request slot before the deadline";
+        case ADMISSION_EXPIRED:
+            return NULL;
+        case ADMISSION_PERFORMED:
+            break;
+    }
+    if (res == CURLE_OPERATION_TIMEDOUT) return "Perplexity API timed out";
+    if (res != CURLE_OK) return "Could not reach the Perplexity API";
+    if (http_code == 429) return "Perplexity API rate limit exceeded; try again later";
+    if (http_code == 401 || http_code == 403) return "Perplexity API rejected the API key";
+    if (http_code >= 500) return "Perplexity API server error";
+    return NULL;
+}
+
+static const char *breaker_name(BreakerState state) {
+    switch (state) {
+        case BREAKER_CLOSED: return "closed";
+        case BREAKER_OPEN: return "open";
+        case BREAKER_HALF_OPEN: return "half_open";
+    }
+    return "unknown";
+}
+
+int admission_format_json(Buffer *out) {
+    pthread_mutex_lock(&admission_lock);
+    long long now = event_loop_now_ms();
+    buffer_append_printf(out, "{\"retry_budget\":%.1f,\"max_retries\":%d,\"models\":{", retry_budget, max_retries);
+    for (int slot = 0; slot < MODEL_SLOTS; slot++) {
+        ModelAdmission *m = &models[slot];
+        refill(m, now);
+        buffer_append_printf(out, "%s\"%s\":{\"rpm\":%.0f,\"burst\":%.0f,\"tokens\":%.1f,\"calls\":%lu,"
+                             "\"throttled\":%lu,\"waited_ms\":%lld,\"rejected\":%lu,\"retries\":%lu,"
+                             "\"rate_limited\":%lu,\"breaker\":\"%s\",\"breaker_opens\":%lu,\"fast_failures\":%lu}",
+                             slot ? "," : "", slot_name(slot), m->rate * 60000.0, m->rate > 0 ? m->burst : 0.0,
+                             m->rate > 0 ? m->tokens : 0.0, m->calls, m->throttled, m->waited_ms, m->rejected,
+                             m->retries, m->rate_limited, breaker_name(m->state), m->breaker_opens,
+                             m->fast_failures);
+    }
+    pthread_mutex_unlock(&admission_lock);
+    return buffer_append_str(out, "}}");
+}
+
+void admission_log_summary(void) {
+    pthread_mutex_lock(&admission_lock);
+    for (int slot = 0; slot < MODEL_SLOTS; slot++) {
+        const ModelAdmission *m = &models[slot];
+        if (m->throttled == 0 && m->rejected == 0 && m->retries == 0 && m->rate_limited == 0 &&
+            m->breaker_opens == 0) {
+            continue;
+        }
+        (void)fprintf(stderr, "Admission %s: %lu throttled (%lld ms waiting), %lu rejected, %lu retries, "
+                      "%lu rate limited, breaker opened %lu times, %lu fast failures\n",
+                      slot_name(slot), m->throttled, m->waited_ms, m->rejected, m->retries, m->rate_limited,
+                      m->breaker_opens, m->fast_failures);
+    }
+    pthread_mutex_unlock(&admission_lock);
+}
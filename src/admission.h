@@ -0,0 +1,70 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <curl/curl.h>
+#include "buffer.h"
+#include "cancel.h"
+#include "../include/types.h"
+
+// Admission control for Perplexity API calls, per model:
+//  - an optional token bucket sized to the account's rate limit
+//    (PERPLEXITY_RATE_LIMITS, e.g. "sonar-pro=50:10,sonar-deep-research=5" in
+//    requests per minute, optionally with a burst size); callers wait their
+//    turn instead of collecting 429s. Unconfigured models are unlimited and
+//    only pause for the Retry-After of a 429
+//  - retries of 429, 5xx and connection failures, after Retry-After when
+//    the API sends one and with jittered exponential backoff otherwise,
+//    drawn from a shared retry budget so retries never outgrow traffic
+//  - a circuit breaker that fails calls fast while the API keeps failing,
+//    and lets one probe through after a cooldown
+
+typedef enum {
+    ADMISSION_REQUEST,      // Chat completion or async submit: takes a bucket token
+    ADMISSION_POLL          // Async status poll: breaker and retries only
+} AdmissionKind;
+
+typedef enum {
+    ADMISSION_PERFORMED = 0,    // The transfer ran; check res and the response code
+    ADMISSION_CIRCUIT_OPEN,     // Failed fast while the API is unhealthy
+    ADMISSION_THROTTLED,        // No rate limit token before the deadline
+    ADMISSION_EXPIRED           // The call was cancelled while waiting
+} AdmissionResult;
+
+typedef struct {
+    const char *model;
+    AdmissionKind kind;
+    const CancelToken *cancel;  // Deadline and cancellation; NULL for none
+    long timeout_ms;            // Per attempt, shortened by the deadline
+    HTTPResponse *response;     // Body buffer, cleared before a retry
+} AdmissionSpec;
+
+// Read the configured limits (PERPLEXITY_RATE_LIMITS, PERPLEXITY_MAX_RETRIES)
+int admission_init(void);
+
+// Perform curl under admission control; *res is the last attempt's result
+AdmissionResult admission_perform(CURL *curl, const AdmissionSpec *spec, CURLcode *res);
+
+// The same without blocking: token waits, attempts and backoff are driven by
+// the event loop, and on_done runs once with the outcome: on the loop thread,
+// or on this thread when the call is settled before a transfer starts or the
+// loop is down. spec is copied; its cancel token and response must outlive
+// the call.
+typedef void (*admission_done_fn)(CURL *curl, AdmissionResult result, CURLcode res, void *userdata);
+void admission_submit(CURL *curl, const AdmissionSpec *spec, admission_done_fn on_done, void *userdata);
+
+// Non-blocking variant for transfers driven by the event loop: returns 0 if
+// the breaker lets the call through. The outcome must then be recorded, or
+// the call withdrawn if it never went out.
+int admission_try(const char *model);
+void admission_record(const char *model, CURLcode res, long http_code);
+void admission_withdraw(const char *model);
+
+// Message for the client when a call failed, or NULL if there is nothing
+// more specific to say than a generic failure
+const char *admission_error(AdmissionResult result, CURLcode res, long http_code);
+
+// Bucket, retry and breaker state as JSON (perplexity_stats), and the shutdown log
+int admission_format_json(Buffer *out);
+void admission_log_summary(void);
+
+#endif
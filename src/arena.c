@@ -0,0 +1,183 @@
+#define GNU_SOURCE
+#include "arena.h"
+#include <cjson/cJSON.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Chunks start at 64 KB and double up to 1 MB, so even multi-megabyte
+// requests span only a handful of chunks. Larger blocks get their own.
+#define ARENA_FIRST_CHUNK (64 * 1024)
+#define ARENA_MAX_CHUNK (1024 * 1024)
+#define ARENA_ALIGN 16
+#define MAX_IDLE_ARENAS 16
+
+// Blocks handed to cJSON carry a tag saying where they came from, so the
+// free hook never has to look the pointer up in the arena's chunks. The
+// header keeps the block ARENA_ALIGN-aligned.
+#define HOOK_HEADER ARENA_ALIGN
+#define HOOK_TAG_ARENA ((uintptr_t)0x414e455241ULL)  // "ARENA"
+#define HOOK_TAG_HEAP ((uintptr_t)0x50414548ULL)     // "HEAP"
+
+struct ArenaChunk {
+    ArenaChunk *next;
+    size_t size;
+    size_t used;
+    char *data;
+};
+
+static __thread Arena *active_arena = NULL;
+
+static pthread_mutex_t arena_lock = PTHREAD_MUTEX_INITIALIZER;
+static Arena *idle_arenas[MAX_IDLE_ARENAS];
+static int idle_count = 0;
+static ArenaStats arena_stats;
+
+static ArenaChunk *chunk_new(size_t size) {
+    ArenaChunk *chunk = malloc(sizeof(ArenaChunk) + size + ARENA_ALIGN);
+    if (!chunk) return NULL;
+
+    uintptr_t base = (uintptr_t)(chunk + 1);
+    chunk->data = (char *)((base + ARENA_ALIGN - 1) & ~(uintptr_t)(ARENA_ALIGN - 1));
+    chunk->size = size;
+    chunk->used = 0;
+    chunk->next = NULL;
+
+    pthread_mutex_lock(&arena_lock);
+    arena_stats.chunk_mallocs++;
+    pthread_mutex_unlock(&arena_lock);
+    return chunk;
+}
+
+void *arena_alloc(Arena *arena, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (size == 0) size = ARENA_ALIGN;
+
+    ArenaChunk *chunk = arena->head;
+    if (!chunk || chunk->size - chunk->used < size) {
+        size_t chunk_size = chunk ? chunk->size * 2 : ARENA_FIRST_CHUNK;
+        if (chunk_size > ARENA_MAX_CHUNK) chunk_size = ARENA_MAX_CHUNK;
+
+        if (size > chunk_size / 4) {
+            // Large block (a long message): dedicated chunk behind the current one
+            ArenaChunk *big = chunk_new(size);
+            if (!big) return NULL;
+            big->used = size;
+            if (chunk) {
+                big->next = chunk->next;
+                chunk->next = big;
+            } else {
+                arena->head = big;
+            }
+            arena->allocated += size;
+            return big->data;
+        }
+
+        ArenaChunk *fresh = chunk_new(chunk_size);
+        if (!fresh) return NULL;
+        fresh->next = chunk;
+        arena->head = fresh;
+        chunk = fresh;
+    }
+
+    void *ptr = chunk->data + chunk->used;
+    chunk->used += size;
+    arena->allocated += size;
+    return ptr;
+}
+
+Arena *arena_acquire(void) {
+    Arena *arena = NULL;
+
+    pthread_mutex_lock(&arena_lock);
+    if (idle_count > 0) arena = idle_arenas[--idle_count];
+    pthread_mutex_unlock(&arena_lock);
+
+    if (!arena) arena = calloc(1, sizeof(Arena));
+    return arena;
+}
+
+// Free everything at once; the first-size chunk is kept for the next request
+void arena_release(Arena *arena) {
+    if (!arena) return;
+
+    ArenaChunk *keep = NULL;
+    ArenaChunk *chunk = arena->head;
+    while (chunk) {
+        ArenaChunk *next = chunk->next;
+        if (!keep && chunk->size == ARENA_FIRST_CHUNK) {
+            keep = chunk;
+            keep->used = 0;
+            keep->next = NULL;
+        } else {
+            free(chunk);
+        }
+        chunk = next;
+    }
+
+    pthread_mutex_lock(&arena_lock);
+    arena_stats.requests++;
+    if (arena->allocated > arena_stats.peak_bytes) arena_stats.peak_bytes = arena->allocated;
+    pthread_mutex_unlock(&arena_lock);
+
+    arena->head = keep;
+    arena->allocated = 0;
+
+    pthread_mutex_lock(&arena_lock);
+    if (idle_count < MAX_IDLE_ARENAS) {
+        idle_arenas[idle_count++] = arena;
+        arena = NULL;
+    }
+    pthread_mutex_unlock(&arena_lock);
+
+    if (arena) {
+        free(arena->head);
+        free(arena);
+    }
+}
+
+void arena_pool_cleanup(void) {
+    pthread_mutex_lock(&arena_lock);
+    for (int i = 0; i < idle_count; i++) {
+        free(idle_arenas[i]->head);
+        free(idle_arenas[i]);
+    }
+    idle_count = 0;
+    pthread_mutex_unlock(&arena_lock);
+}
+
+void arena_activate(Arena *arena) {
+    active_arena = arena;
+}
+
+Arena *arena_active(void) {
+    return active_arena;
+}
+
+static void *arena_hook_malloc(size_t size) {
+    Arena *arena = active_arena;
+    char *block = arena ? arena_alloc(arena, size + HOOK_HEADER) : malloc(size + HOOK_HEADER);
+    if (!block) return NULL;
+    *(uintptr_t *)block = arena ? HOOK_TAG_ARENA : HOOK_TAG_HEAP;
+    return block + HOOK_HEADER;
+}
+
+// Arena memory is released by arena_release(); only heap blocks are freed,
+// whichever arena is active on the freeing thread
+static void arena_hook_free(void *ptr) {
+    if (!ptr) return;
+    char *block = (char *)ptr - HOOK_HEADER;
+    if (*(uintptr_t *)block == HOOK_TAG_HEAP) free(block);
+}
+
+void arena_install_cjson_hooks(void) {
+    cJSON_Hooks hooks = {arena_hook_malloc, arena_hook_free};
+    cJSON_InitHooks(&hooks);
+}
+
+void arena_get_stats(ArenaStats *stats) {
+    pthread_mutex_lock(&arena_lock);
+    *stats = arena_stats;
+    pthread_mutex_unlock(&arena_lock);
+}
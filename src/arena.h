@@ -0,0 +1,38 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// Request-scoped bump allocator. Everything allocated while handling one
+// JSON-RPC request is released together by arena_release().
+typedef struct ArenaChunk ArenaChunk;
+
+typedef struct {
+    ArenaChunk *head;       // Current chunk; older chunks follow
+    size_t allocated;       // Bytes handed out since the last reset
+} Arena;
+
+typedef struct {
+    unsigned long requests;     // Arenas released
+    unsigned long chunk_mallocs;
+    size_t peak_bytes;          // Largest single-request footprint
+} ArenaStats;
+
+// Route cJSON allocations through the calling thread's active arena. Blocks
+// from cJSON_malloc must go back through cJSON_free, never free().
+void arena_install_cjson_hooks(void);
+
+// Arenas are recycled through a small pool
+Arena *arena_acquire(void);
+void arena_release(Arena *arena);
+void arena_pool_cleanup(void);
+
+void *arena_alloc(Arena *arena, size_t size);
+
+// The arena cJSON allocates from on this thread (NULL: plain heap)
+void arena_activate(Arena *arena);
+Arena *arena_active(void);
+
+void arena_get_stats(ArenaStats *stats);
+
+#endif
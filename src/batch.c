@@ -0,0 +1,299 @@
+#define GNU_SOURCE
+#include "batch.h"
+#include "arena.h"
+#include "buffer.h"
+#include "json_utils.h"
+#include "metrics.h"
+#include "mcp_protocol.h"
+#include "registry.h"
+#include "worker_pool.h"
+#include "models/model_router.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BATCH_MAX_ITEMS 64
+#define BATCH_DEFAULT_CONCURRENCY 4
+#define BATCH_MAX_CONCURRENCY 16
+
+typedef struct Batch Batch;
+
+// One query of the batch. Parsed and validated on the calling thread; the
+// result fields are written by whichever thread finishes the item.
+typedef struct {
+    Batch *batch;
+    const cJSON *messages;      // Borrowed from the request
+    const ToolDescriptor *tool;
+    RequestContext ctx;
+    const char *invalid;        // Rejected before running; reported as the error
+    Arena *arena;               // Holds the parsed messages while the item runs
+    MessageArray *msg_array;
+    char *result;
+    const char *error;
+    long long started_us;
+    long long elapsed_us;
+} BatchItem;
+
+// Items start as earlier ones finish, at most in_flight at a time; no
+// thread waits for them. The last item to finish answers and frees the batch.
+struct Batch {
+    BatchItem *items;
+    int count;
+    int in_flight;
+    int next;                   // Next item to start, under lock
+    int done;                   // Finished items, under lock
+    long long started_us;
+    const char *progress_token;
+    pthread_mutex_t lock;
+    batch_done_fn on_done;
+    void *userdata;
+};
+
+// Validate one entry of arguments.items and fill in its call options
+static void prepare_item(BatchItem *item, const cJSON *entry, long batch_deadline_ms, CancelToken *cancel) {
+    item->tool = registry_tool(TOOL_ASK);
+    if (!cJSON_IsObject(entry)) {
+        item->invalid = "Item is not an object";
+        return;
+    }
+
+    cJSON *tool = cJSON_GetObjectItem(entry, "tool");
+    if (tool) {
+        const ToolDescriptor *descriptor =
+            cJSON_IsString(tool) ? registry_find_tool(tool->valuestring, strlen(tool->valuestring)) : NULL;
+        if (!descriptor || !(descriptor->flags & TOOL_BATCHABLE)) {
+            item->invalid = "Unsupported 'tool' for a batch item";
+            return;
+        }
+        item->tool = descriptor;
+    }
+
+    item->messages = cJSON_GetObjectItem(entry, "messages");
+    if (!cJSON_IsArray(item->messages)) {
+        item->invalid = "Missing or invalid 'messages' parameter";
+        return;
+    }
+
+    // Items don't stream; progress is reported per finished item instead.
+    // They run on the batch's token, so only its deadline can stop them.
+    init_request_context(&item->ctx, item->tool, entry, NULL, cancel);
+    item->ctx.deadline_ms = batch_deadline_ms;
+
+    cJSON *model = cJSON_GetObjectItem(entry, "model");
+    if (model) {
+        const ModelDescriptor *descriptor =
+            cJSON_IsString(model) ? registry_find_model(model->valuestring, strlen(model->valuestring)) : NULL;
+        if (!descriptor || !descriptor->routable) {
+            item->invalid = "Unsupported 'model' for a batch item";
+            return;
+        }
+        item->ctx.model = descriptor->name;
+    }
+}
+
+static void append_usage(Buffer *out, const BatchItem *item) {
+    const UsageInfo *usage = &item->ctx.usage;
+    buffer_append_printf(out, "\"usage\":{\"prompt_tokens\":%d,\"completion_tokens\":%d,\"total_tokens\":%d,"
+                         "\"citation_tokens\":%d,\"reasoning_tokens\":%d,\"search_queries\":%d,\"cost_usd\":%.6f}",
+                         usage->prompt_tokens, usage->completion_tokens, usage->total_tokens,
+                         usage->citation_tokens, usage->reasoning_tokens, usage->num_search_queries,
+                         item->ctx.cost);
+}
+
+static char *format_results(const BatchItem *items, int count, long long elapsed_us) {
+    Buffer out;
+    buffer_init(&out);
+    int succeeded = 0;
+    double cost = 0.0;
+
+    buffer_append_str(&out, "{\"results\":[");
+    for (int i = 0; i < count; i++) {
+        const BatchItem *item = &items[i];
+        int ok = item->result != NULL;
+        succeeded += ok;
+        cost += item->ctx.cost;
+
+        buffer_append_printf(&out, "%s{\"index\":%d,\"tool\":", i ? "," : "", i);
+        buffer_append_json_string(&out, item->tool->name);
+        if (item->ctx.model_used) {
+            buffer_append_str(&out, ",\"model\":");
+            buffer_append_json_string(&out, item->ctx.model_used);
+        }
+        buffer_append_printf(&out, ",\"ok\":%s,", ok ? "true" : "false");
+        if (ok) {
+            buffer_append_str(&out, "\"text\":");
+            buffer_append_json_string(&out, item->result);
+            buffer_append_printf(&out, ",\"complete\":%s,", item->ctx.complete ? "true" : "false");
+        } else {
+            buffer_append_str(&out, "\"error\":");
+            buffer_append_json_string(&out, item->invalid ? item->invalid : item->error);
+            buffer_append_str(&out, ",");
+        }
+        buffer_append_printf(&out, "\"elapsed_ms\":%lld,", item->elapsed_us / 1000);
+        append_usage(&out, item);
+        buffer_append_str(&out, "}");
+    }
+    int status = buffer_append_printf(&out, "],\"succeeded\":%d,\"failed\":%d,\"cost_usd\":%.6f,\"elapsed_ms\":%lld}",
+                                      succeeded, count - succeeded, cost, elapsed_us / 1000);
+
+    if (status != 0) {
+        buffer_free(&out);
+        return NULL;
+    }
+    return out.data;
+}
+
+// Requested in-flight cap, clamped as a double so huge or NaN values never
+// reach the int conversion
+static int batch_concurrency(const cJSON *arguments, int count) {
+    int concurrency = BATCH_DEFAULT_CONCURRENCY;
+    cJSON *requested = cJSON_GetObjectItem(arguments, "max_concurrency");
+    if (cJSON_IsNumber(requested)) {
+        double value = requested->valuedouble;
+        if (!(value >= 1)) {
+            concurrency = 1;
+        } else if (value >= BATCH_MAX_CONCURRENCY) {
+            concurrency = BATCH_MAX_CONCURRENCY;
+        } else {
+            concurrency = (int)value;
+        }
+    }
+    return concurrency < count ? concurrency : count;
+}
+
+static void run_item(void *arg);
+
+// Format the results and answer; the batch is gone afterwards
+static void finish_batch(Batch *batch) {
+    long long elapsed_us = metrics_now_us() - batch->started_us;
+    char *result = format_results(batch->items, batch->count, elapsed_us);
+    (void)fprintf(stderr, "Batch of %d items (%d in flight) finished in %lld ms\n", batch->count, batch->in_flight,
+                  elapsed_us / 1000);
+
+    for (int i = 0; i < batch->count; i++) {
+        free(batch->items[i].result);
+    }
+    batch_done_fn on_done = batch->on_done;
+    void *userdata = batch->userdata;
+    free(batch->items);
+    pthread_mutex_destroy(&batch->lock);
+    free(batch);
+
+    on_done(result, result ? NULL : "Not enough memory for batch results", userdata);
+}
+
+static void item_done(BatchItem *item) {
+    Batch *batch = item->batch;
+
+    // Progress goes out under the lock: the token belongs to the caller,
+    // which answers and frees it as soon as the last item is done
+    pthread_mutex_lock(&batch->lock);
+    int done = ++batch->done;
+    if (batch->progress_token) {
+        char message[64];
+        (void)snprintf(message, sizeof(message), "%d/%d items done", done, batch->count);
+        send_progress_notification(batch->progress_token, (double)done, message);
+    }
+    BatchItem *next = batch->next < batch->count ? &batch->items[batch->next++] : NULL;
+    pthread_mutex_unlock(&batch->lock);
+
+    if (next) {
+        worker_pool_dispatch(run_item, next);
+    } else if (done == batch->count) {
+        finish_batch(batch);
+    }
+}
+
+static void item_routed(char *result, void *userdata) {
+    BatchItem *item = (BatchItem *)userdata;
+    item->result = result;
+    free_message_array(item->msg_array);
+    arena_release(item->arena);
+
+    if (!item->result) {
+        if (cancel_token_cancelled(item->ctx.cancel)) {
+            item->error = "Cancelled";
+        } else if (cancel_token_expired(item->ctx.cancel)) {
+            item->error = "Deadline exceeded before Perplexity API answered";
+        } else {
+            item->error = item->ctx.error ? item->ctx.error : "Failed to get response from Perplexity API";
+        }
+    }
+    item->elapsed_us = metrics_now_us() - item->started_us;
+    item_done(item);
+}
+
+// Start one item. Its messages are parsed into an arena of its own: arenas
+// are single-threaded, and the call finishes on whichever worker is free.
+static void run_item(void *arg) {
+    BatchItem *item = (BatchItem *)arg;
+    if (item->invalid) {
+        item_done(item);
+        return;
+    }
+
+    item->started_us = metrics_now_us();
+    Arena *previous = arena_active();
+    item->arena = arena_acquire();
+    arena_activate(item->arena);
+    item->msg_array = parse_messages(item->messages);
+    arena_activate(previous);
+
+    if (!item->msg_array) {
+        arena_release(item->arena);
+        item->error = "Failed to parse messages";
+        item->elapsed_us = metrics_now_us() - item->started_us;
+        item_done(item);
+        return;
+    }
+    route_and_execute(item->msg_array, item->tool, &item->ctx, item_routed, item);
+}
+
+void batch_execute(const cJSON *arguments, const char *progress_token, CancelToken *cancel, batch_done_fn on_done,
+                   void *userdata) {
+    cJSON *items_json = cJSON_GetObjectItem(arguments, "items");
+    int count = cJSON_IsArray(items_json) ? cJSON_GetArraySize(items_json) : 0;
+    if (count == 0) {
+        on_done(NULL, "Missing or empty 'items' parameter", userdata);
+        return;
+    }
+    if (count > BATCH_MAX_ITEMS) {
+        on_done(NULL, "Too many items in batch (at most 64)", userdata);
+        return;
+    }
+
+    Batch *batch = calloc(1, sizeof(Batch));
+    BatchItem *items = calloc((size_t)count, sizeof(BatchItem));
+    if (!batch || !items) {
+        free(batch);
+        free(items);
+        on_done(NULL, "Not enough memory for batch", userdata);
+        return;
+    }
+
+    long batch_deadline_ms = parse_deadline_ms(arguments);
+
+    int index = 0;
+    cJSON *entry = NULL;
+    cJSON_ArrayForEach(entry, items_json) {
+        items[index].batch = batch;
+        prepare_item(&items[index++], entry, batch_deadline_ms, cancel);
+    }
+
+    int in_flight = batch_concurrency(arguments, count);
+    batch->items = items;
+    batch->count = count;
+    batch->in_flight = in_flight;
+    batch->next = in_flight;
+    batch->started_us = metrics_now_us();
+    batch->progress_token = progress_token;
+    batch->on_done = on_done;
+    batch->userdata = userdata;
+    pthread_mutex_init(&batch->lock, NULL);
+
+    // The batch may be gone once the last of these is started
+    for (int i = 0; i < in_flight; i++) {
+        worker_pool_dispatch(run_item, &items[i]);
+    }
+}
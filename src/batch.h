@@ -0,0 +1,17 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <cjson/cJSON.h>
+#include "cancel.h"
+
+// perplexity_batch: run arguments.items (each a tools/call-like object with
+// messages and an optional tool and model) concurrently, at most
+// max_concurrency at a time, and deliver a JSON document with one result per
+// item in input order. on_done runs once: with NULL and an error when the
+// batch itself is invalid (on this thread), else once the last item is done.
+// Failures of single items are reported inside the document.
+typedef void (*batch_done_fn)(char *result, const char *error, void *userdata);
+void batch_execute(const cJSON *arguments, const char *progress_token, CancelToken *cancel, batch_done_fn on_done,
+                   void *userdata);
+
+#endif
@@ -0,0 +1,91 @@
+#define GNU_SOURCE
+#include "buffer.h"
+#include "json_escape.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BUFFER_MIN_CAPACITY 256
+
+void buffer_init(Buffer *buf) {
+    buf->data = NULL;
+    buf->len = 0;
+    buf->cap = 0;
+}
+
+void buffer_free(Buffer *buf) {
+    free(buf->data);
+    buffer_init(buf);
+}
+
+void buffer_reset(Buffer *buf) {
+    buf->len = 0;
+    if (buf->data) buf->data[0] = '\0';
+}
+
+// Ensure room for extra bytes plus the terminating NUL; grows geometrically
+int buffer_reserve(Buffer *buf, size_t extra) {
+    size_t needed = buf->len + extra + 1;
+    if (needed <= buf->cap) return 0;
+
+    size_t new_cap = buf->cap ? buf->cap : BUFFER_MIN_CAPACITY;
+    while (new_cap < needed) new_cap *= 2;
+
+    char *grown = realloc(buf->data, new_cap);
+    if (!grown) return -1;
+    buf->data = grown;
+    buf->cap = new_cap;
+    return 0;
+}
+
+int buffer_append(Buffer *buf, const char *data, size_t len) {
+    if (buffer_reserve(buf, len) != 0) return -1;
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+    buf->data[buf->len] = '\0';
+    return 0;
+}
+
+int buffer_append_str(Buffer *buf, const char *str) {
+    return buffer_append(buf, str, strlen(str));
+}
+
+int buffer_append_printf(Buffer *buf, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int needed = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+    if (needed < 0 || buffer_reserve(buf, (size_t)needed) != 0) return -1;
+
+    va_start(args, fmt);
+    (void)vsnprintf(buf->data + buf->len, (size_t)needed + 1, fmt, args);
+    va_end(args);
+    buf->len += (size_t)needed;
+    return 0;
+}
+
+// Runs of bytes that need no escaping are found with a vectorized scan and
+// copied in one memcpy; UTF-8 passes through unchanged, as JSON allows
+int buffer_append_json_string(Buffer *buf, const char *str) {
+    size_t len = strlen(str);
+
+    // Worst case is a few escapes; reserve the common case up front
+    if (buffer_reserve(buf, len + len / 8 + 2) != 0) return -1;
+    buf->data[buf->len++] = '"';
+
+    size_t i = 0;
+    while (i < len) {
+        size_t run = json_escape_safe_run(str + i, len - i);
+        if (buffer_append(buf, str + i, run) != 0) return -1;
+        i += run;
+        if (i < len) {
+            char esc[6];
+            size_t esc_len = json_escape_byte((unsigned char)str[i], esc);
+            if (buffer_append(buf, esc, esc_len) != 0) return -1;
+            i++;
+        }
+    }
+
+    return buffer_append(buf, "\"", 1);
+}
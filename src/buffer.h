@@ -0,0 +1,24 @@
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include <stddef.h>
+
+// Growable byte buffer; data stays NUL-terminated after every append
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} Buffer;
+
+void buffer_init(Buffer *buf);
+void buffer_free(Buffer *buf);
+void buffer_reset(Buffer *buf);
+int buffer_reserve(Buffer *buf, size_t extra);
+int buffer_append(Buffer *buf, const char *data, size_t len);
+int buffer_append_str(Buffer *buf, const char *str);
+int buffer_append_printf(Buffer *buf, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+// Append str as a quoted, escaped JSON string
+int buffer_append_json_string(Buffer *buf, const char *str);
+
+#endif
@@ -0,0 +1,159 @@
+#define GNU_SOURCE
+#include "cancel.h"
+#include "event_loop.h"
+#include "../include/constants.h"
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static CancelToken *registry = NULL;
+
+// Armed watches, and whether the sweep timer is scheduled
+static pthread_mutex_t watch_lock = PTHREAD_MUTEX_INITIALIZER;
+static CancelWatch *watches = NULL;
+static int sweep_scheduled = 0;
+
+void cancel_token_init(CancelToken *token, const char *request_id, long long deadline_ms) {
+    token->cancelled = 0;
+    if (deadline_ms > MAX_DEADLINE_MS) deadline_ms = MAX_DEADLINE_MS;
+    token->deadline_ms = deadline_ms > 0 ? event_loop_now_ms() + deadline_ms : 0;
+    token->request_id = request_id;
+    token->next = NULL;
+}
+
+int cancel_token_cancelled(const CancelToken *token) {
+    return token && __atomic_load_n(&token->cancelled, __ATOMIC_ACQUIRE);
+}
+
+int cancel_token_expired(const CancelToken *token) {
+    if (!token) return 0;
+    if (__atomic_load_n(&token->cancelled, __ATOMIC_ACQUIRE)) return 1;
+    return token->deadline_ms > 0 && event_loop_now_ms() >= token->deadline_ms;
+}
+
+long cancel_token_timeout_ms(const CancelToken *token, long cap_ms) {
+    if (!token || token->deadline_ms == 0) return cap_ms;
+    long long left = token->deadline_ms - event_loop_now_ms();
+    if (left < 1) return 1;
+    return left < cap_ms ? (long)left : cap_ms;
+}
+
+int cancel_token_sleep(const CancelToken *token, long long ms) {
+    long long until = event_loop_now_ms() + ms;
+    while (!cancel_token_expired(token)) {
+        long long left = until - event_loop_now_ms();
+        if (left <= 0) return 0;
+        (void)usleep((useconds_t)(left < CANCEL_CHECK_MS ? left : CANCEL_CHECK_MS) * 1000U);
+    }
+    return 1;
+}
+
+void cancel_register(CancelToken *token) {
+    pthread_mutex_lock(&registry_lock);
+    token->next = registry;
+    registry = token;
+    pthread_mutex_unlock(&registry_lock);
+}
+
+void cancel_unregister(CancelToken *token) {
+    pthread_mutex_lock(&registry_lock);
+    for (CancelToken **slot = &registry; *slot; slot = &(*slot)->next) {
+        if (*slot == token) {
+            *slot = token->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&registry_lock);
+}
+
+int cancel_request(const char *request_id, size_t len) {
+    int found = 0;
+    pthread_mutex_lock(&registry_lock);
+    for (CancelToken *token = registry; token; token = token->next) {
+        if (strlen(token->request_id) == len && memcmp(token->request_id, request_id, len) == 0) {
+            __atomic_store_n(&token->cancelled, 1, __ATOMIC_RELEASE);
+            found++;
+        }
+    }
+    pthread_mutex_unlock(&registry_lock);
+
+    // Transfers notice through their progress callback, which runs when the loop does
+    if (found) event_loop_wakeup();
+    return found;
+}
+
+static int watch_expired(const CancelWatch *watch, long long now) {
+    return cancel_token_expired(watch->token) || (watch->until_ms > 0 && now >= watch->until_ms);
+}
+
+// Sweep timer (event loop thread): fire expired watches outside the lock
+static void sweep_watches(void *unused) {
+    (void)unused;
+    long long now = event_loop_now_ms();
+    CancelWatch *fired = NULL;
+
+    pthread_mutex_lock(&watch_lock);
+    CancelWatch **slot = &watches;
+    while (*slot) {
+        CancelWatch *watch = *slot;
+        if (watch_expired(watch, now)) {
+            *slot = watch->next;
+            watch->state = 2;
+            watch->next = fired;
+            fired = watch;
+        } else {
+            slot = &watch->next;
+        }
+    }
+    sweep_scheduled = watches && event_loop_add_timer(CANCEL_CHECK_MS, sweep_watches, NULL) == 0;
+    pthread_mutex_unlock(&watch_lock);
+
+    while (fired) {
+        CancelWatch *watch = fired;
+        fired = watch->next;
+        watch->on_expired(watch->userdata);
+    }
+}
+
+int cancel_watch(CancelWatch *watch, const CancelToken *token, long long until_ms, cancel_watch_fn on_expired,
+                 void *userdata) {
+    watch->token = token;
+    watch->until_ms = until_ms;
+    watch->on_expired = on_expired;
+    watch->userdata = userdata;
+    watch->state = 0;
+    watch->next = NULL;
+    if (!token && until_ms <= 0) return -1;
+
+    pthread_mutex_lock(&watch_lock);
+    if (!sweep_scheduled) {
+        sweep_scheduled = event_loop_add_timer(CANCEL_CHECK_MS, sweep_watches, NULL) == 0;
+    }
+    if (!sweep_scheduled) {
+        pthread_mutex_unlock(&watch_lock);
+        return -1;
+    }
+    watch->state = 1;
+    watch->next = watches;
+    watches = watch;
+    pthread_mutex_unlock(&watch_lock);
+    return 0;
+}
+
+int cancel_unwatch(CancelWatch *watch) {
+    pthread_mutex_lock(&watch_lock);
+    int state = watch->state;
+    if (state == 1) {
+        for (CancelWatch **slot = &watches; *slot; slot = &(*slot)->next) {
+            if (*slot == watch) {
+                *slot = watch->next;
+                break;
+            }
+        }
+        watch->state = 0;
+    }
+    pthread_mutex_unlock(&watch_lock);
+    return state != 2;
+}
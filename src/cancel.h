@@ -0,0 +1,64 @@
+#ifndef CANCEL_H
+#define CANCEL_H
+
+#include <stddef.h>
+
+// Cancellation and deadline for one tools/call, shared by everything that
+// works on it: routing, curl transfers (through their progress callback)
+// and deep research waits. Tokens of calls in flight are registered by
+// JSON-RPC id so notifications/cancelled can find them.
+// How often blocking waits look at their token
+#define CANCEL_CHECK_MS 100
+
+typedef struct CancelToken {
+    int cancelled;              // Set once; read with __atomic loads
+    long long deadline_ms;      // event_loop_now_ms() at which the client gives up; 0 for none
+    const char *request_id;     // Raw JSON id, owned by the call
+    struct CancelToken *next;
+} CancelToken;
+
+// deadline_ms is relative to now; 0 for none
+void cancel_token_init(CancelToken *token, const char *request_id, long long deadline_ms);
+
+// Cancelled, or the deadline has passed. A NULL token never expires.
+int cancel_token_expired(const CancelToken *token);
+int cancel_token_cancelled(const CancelToken *token);
+
+// Milliseconds left before the deadline, capped at cap_ms (and at least 1)
+long cancel_token_timeout_ms(const CancelToken *token, long cap_ms);
+
+// Sleep for ms, waking early if the token expires; returns nonzero then
+int cancel_token_sleep(const CancelToken *token, long long ms);
+
+// In-flight registry
+void cancel_register(CancelToken *token);
+void cancel_unregister(CancelToken *token);
+
+// Cancel every registered call whose raw id is request_id (len bytes, as
+// it appeared on the wire); returns how many were found
+int cancel_request(const char *request_id, size_t len);
+
+// Watch for a waiter that has no thread to block: on_expired runs once on the
+// event loop thread when token expires or until_ms (event_loop_now_ms() time,
+// 0 for none) passes. Every armed watch is checked by one timer each
+// CANCEL_CHECK_MS.
+typedef void (*cancel_watch_fn)(void *userdata);
+
+typedef struct CancelWatch {
+    const CancelToken *token;
+    long long until_ms;
+    cancel_watch_fn on_expired;
+    void *userdata;
+    int state;                  // 0 idle, 1 armed, 2 fired
+    struct CancelWatch *next;
+} CancelWatch;
+
+// Returns 0 once armed; -1 when there is nothing to watch or no event loop
+int cancel_watch(CancelWatch *watch, const CancelToken *token, long long until_ms, cancel_watch_fn on_expired,
+                 void *userdata);
+
+// Disarm; returns 1 if on_expired will not run, 0 if it already fired (and
+// the waiter now belongs to it)
+int cancel_unwatch(CancelWatch *watch);
+
+#endif
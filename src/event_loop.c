@@ -0,0 +1,300 @@
+#define GNU_SOURCE
+#include "event_loop.h"
+#include "http_client.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Upper bound on how long curl_multi_poll() sleeps when nothing is due
+#define MAX_POLL_WAIT_MS 1000
+
+// Transfer waiting to be added to, or owned by, the multi handle
+typedef struct Transfer {
+    CURL *curl;
+    transfer_done_fn on_done;
+    void *userdata;
+    struct Transfer *prev;
+    struct Transfer *next;
+} Transfer;
+
+// One-shot timer, kept in a list sorted by due time
+typedef struct Timer {
+    long long due_ms;
+    timer_fn on_fire;
+    void *userdata;
+    struct Timer *next;
+} Timer;
+
+// Waiter for event_loop_perform()
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int done;
+    CURLcode result;
+} PerformWaiter;
+
+static CURLM *multi_handle = NULL;
+static pthread_t loop_thread;
+static int loop_running = 0;
+
+// Submissions from other threads; only the loop thread touches multi_handle
+static pthread_mutex_t loop_lock = PTHREAD_MUTEX_INITIALIZER;
+static Transfer *pending_transfers = NULL;
+static Timer *timers = NULL;
+
+// Transfers currently owned by the multi handle (loop thread only)
+static Transfer *active_transfers = NULL;
+
+long long event_loop_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Move queued transfers into the multi handle
+static void attach_pending_transfers(void) {
+    pthread_mutex_lock(&loop_lock);
+    Transfer *list = pending_transfers;
+    pending_transfers = NULL;
+    pthread_mutex_unlock(&loop_lock);
+
+    while (list) {
+        Transfer *transfer = list;
+        list = list->next;
+
+        curl_easy_setopt(transfer->curl, CURLOPT_PRIVATE, (void *)transfer);
+        CURLMcode mres = curl_multi_add_handle(multi_handle, transfer->curl);
+        if (mres != CURLM_OK) {
+            (void)fprintf(stderr, "curl_multi_add_handle() failed: %s\n", curl_multi_strerror(mres));
+            transfer->on_done(transfer->curl, CURLE_FAILED_INIT, transfer->userdata);
+            free(transfer);
+            continue;
+        }
+
+        transfer->prev = NULL;
+        transfer->next = active_transfers;
+        if (active_transfers) active_transfers->prev = transfer;
+        active_transfers = transfer;
+    }
+}
+
+// Detach a finished transfer from the multi handle and the active list
+static void detach_transfer(Transfer *transfer) {
+    curl_multi_remove_handle(multi_handle, transfer->curl);
+
+    if (transfer->prev) {
+        transfer->prev->next = transfer->next;
+    } else {
+        active_transfers = transfer->next;
+    }
+    if (transfer->next) transfer->next->prev = transfer->prev;
+}
+
+// Fire every timer that is due; returns ms until the next one (or the cap)
+static long run_due_timers(void) {
+    long long now = event_loop_now_ms();
+
+    for (;;) {
+        pthread_mutex_lock(&loop_lock);
+        Timer *timer = timers;
+        if (!timer || timer->due_ms > now) {
+            long wait = MAX_POLL_WAIT_MS;
+            if (timer && timer->due_ms - now < wait) wait = (long)(timer->due_ms - now);
+            pthread_mutex_unlock(&loop_lock);
+            return wait;
+        }
+        timers = timer->next;
+        pthread_mutex_unlock(&loop_lock);
+
+        timer->on_fire(timer->userdata);
+        free(timer);
+    }
+}
+
+// Dispatch completion callbacks for finished transfers
+static void collect_finished_transfers(void) {
+    CURLMsg *msg;
+    int msgs_left = 0;
+
+    while ((msg = curl_multi_info_read(multi_handle, &msgs_left))) {
+        if (msg->msg != CURLMSG_DONE) continue;
+
+        CURL *curl = msg->easy_handle;
+        CURLcode result = msg->data.result;
+        Transfer *transfer = NULL;
+        curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char **)&transfer);
+
+        if (!transfer) {
+            curl_multi_remove_handle(multi_handle, curl);
+            continue;
+        }
+
+        detach_transfer(transfer);
+        http_client_record_transfer(curl);
+        transfer->on_done(curl, result, transfer->userdata);
+        free(transfer);
+    }
+}
+
+static void *event_loop_main(void *unused) {
+    (void)unused;
+
+    for (;;) {
+        pthread_mutex_lock(&loop_lock);
+        int running = loop_running;
+        pthread_mutex_unlock(&loop_lock);
+        if (!running) break;
+
+        attach_pending_transfers();
+        long wait_ms = run_due_timers();
+
+        int still_running = 0;
+        curl_multi_perform(multi_handle, &still_running);
+        collect_finished_transfers();
+
+        // New work may have been queued by a callback; don't sleep on it
+        pthread_mutex_lock(&loop_lock);
+        if (pending_transfers) wait_ms = 0;
+        pthread_mutex_unlock(&loop_lock);
+
+        curl_multi_poll(multi_handle, NULL, 0, (int)wait_ms, NULL);
+    }
+
+    return NULL;
+}
+
+int event_loop_start(void) {
+    multi_handle = curl_multi_init();
+    if (!multi_handle) return -1;
+
+    loop_running = 1;
+    if (pthread_create(&loop_thread, NULL, event_loop_main, NULL) != 0) {
+        loop_running = 0;
+        curl_multi_cleanup(multi_handle);
+        multi_handle = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+// Stop the loop; transfers still in flight complete with CURLE_ABORTED_BY_CALLBACK
+void event_loop_stop(void) {
+    if (!multi_handle) return;
+
+    pthread_mutex_lock(&loop_lock);
+    loop_running = 0;
+    pthread_mutex_unlock(&loop_lock);
+    curl_multi_wakeup(multi_handle);
+    pthread_join(loop_thread, NULL);
+
+    attach_pending_transfers();
+
+    while (active_transfers) {
+        Transfer *transfer = active_transfers;
+        detach_transfer(transfer);
+        transfer->on_done(transfer->curl, CURLE_ABORTED_BY_CALLBACK, transfer->userdata);
+        free(transfer);
+    }
+
+    while (timers) {
+        Timer *timer = timers;
+        timers = timer->next;
+        free(timer);
+    }
+
+    curl_multi_cleanup(multi_handle);
+    multi_handle = NULL;
+}
+
+int event_loop_is_running(void) {
+    pthread_mutex_lock(&loop_lock);
+    int running = loop_running;
+    pthread_mutex_unlock(&loop_lock);
+    return running;
+}
+
+int event_loop_add_transfer(CURL *curl, transfer_done_fn on_done, void *userdata) {
+    Transfer *transfer = malloc(sizeof(Transfer));
+    if (!transfer) return -1;
+    transfer->curl = curl;
+    transfer->on_done = on_done;
+    transfer->userdata = userdata;
+
+    pthread_mutex_lock(&loop_lock);
+    if (!loop_running) {
+        pthread_mutex_unlock(&loop_lock);
+        free(transfer);
+        return -1;
+    }
+    transfer->next = pending_transfers;
+    pending_transfers = transfer;
+    pthread_mutex_unlock(&loop_lock);
+
+    curl_multi_wakeup(multi_handle);
+    return 0;
+}
+
+int event_loop_add_timer(long delay_ms, timer_fn on_fire, void *userdata) {
+    Timer *timer = malloc(sizeof(Timer));
+    if (!timer) return -1;
+    timer->due_ms = event_loop_now_ms() + (delay_ms > 0 ? delay_ms : 0);
+    timer->on_fire = on_fire;
+    timer->userdata = userdata;
+
+    pthread_mutex_lock(&loop_lock);
+    if (!loop_running) {
+        pthread_mutex_unlock(&loop_lock);
+        free(timer);
+        return -1;
+    }
+    Timer **slot = &timers;
+    while (*slot && (*slot)->due_ms <= timer->due_ms) {
+        slot = &(*slot)->next;
+    }
+    timer->next = *slot;
+    *slot = timer;
+    pthread_mutex_unlock(&loop_lock);
+
+    curl_multi_wakeup(multi_handle);
+    return 0;
+}
+
+void event_loop_wakeup(void) {
+    if (event_loop_is_running()) curl_multi_wakeup(multi_handle);
+}
+
+static void perform_done(CURL *curl, CURLcode result, void *userdata) {
+    (void)curl;
+    PerformWaiter *waiter = (PerformWaiter *)userdata;
+
+    pthread_mutex_lock(&waiter->lock);
+    waiter->result = result;
+    waiter->done = 1;
+    pthread_cond_signal(&waiter->cond);
+    pthread_mutex_unlock(&waiter->lock);
+}
+
+CURLcode event_loop_perform(CURL *curl) {
+    PerformWaiter waiter;
+    pthread_mutex_init(&waiter.lock, NULL);
+    pthread_cond_init(&waiter.cond, NULL);
+    waiter.done = 0;
+    waiter.result = CURLE_OK;
+
+    if (event_loop_add_transfer(curl, perform_done, &waiter) != 0) {
+        pthread_cond_destroy(&waiter.cond);
+        pthread_mutex_destroy(&waiter.lock);
+        return CURLE_FAILED_INIT;
+    }
+
+    pthread_mutex_lock(&waiter.lock);
+    while (!waiter.done) {
+        pthread_cond_wait(&waiter.cond, &waiter.lock);
+    }
+    pthread_mutex_unlock(&waiter.lock);
+
+    pthread_cond_destroy(&waiter.cond);
+    pthread_mutex_destroy(&waiter.lock);
+    return waiter.result;
+}
@@ -0,0 +1,30 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <curl/curl.h>
+
+// Completion callbacks run on the event loop thread and must not block
+typedef void (*transfer_done_fn)(CURL *curl, CURLcode result, void *userdata);
+typedef void (*timer_fn)(void *userdata);
+
+// Event loop lifecycle
+int event_loop_start(void);
+void event_loop_stop(void);
+int event_loop_is_running(void);
+
+// Hand a configured easy handle to the loop; on_done fires once it finishes
+int event_loop_add_transfer(CURL *curl, transfer_done_fn on_done, void *userdata);
+
+// Schedule a one-shot timer on the loop thread
+int event_loop_add_timer(long delay_ms, timer_fn on_fire, void *userdata);
+
+// Run the loop now, e.g. so progress callbacks notice a cancellation
+void event_loop_wakeup(void);
+
+// Run a transfer through the loop and wait for it (blocking convenience)
+CURLcode event_loop_perform(CURL *curl);
+
+// Monotonic clock in milliseconds
+long long event_loop_now_ms(void);
+
+#endif
@@ -2,22 +2,128 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <pthread.h>
+#include <curl/curl.h>
 #include "../include/types.h"  // For HTTPResponse
+#include "../include/constants.h"
+#include "event_loop.h"
+
+// Idle easy handles kept around for reuse
+#define MAX_IDLE_HANDLES 16
+
+// Content-Length values above this are not trusted for preallocation
+#define MAX_PRESIZED_RESPONSE (64ULL * 1024 * 1024)
 
 // Global API key
 static char *perplexity_api_key = NULL;
 
+// Endpoints, built once from PERPLEXITY_API_BASE_URL (e.g. a local mock)
+static char api_url[MAX_API_URL_SIZE];
+static char async_api_url[MAX_API_URL_SIZE];
+static pthread_once_t api_url_once = PTHREAD_ONCE_INIT;
+
+// Shared cache (DNS, TLS sessions, connections) used by every leased handle
+static CURLSH *share_handle = NULL;
+static pthread_mutex_t share_locks[CURL_LOCK_DATA_LAST];
+
+// Pool of idle easy handles
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static CURL *idle_handles[MAX_IDLE_HANDLES];
+static int idle_count = 0;
+static HTTPClientStats client_stats;
+
+// Receive buffers come in power-of-two size classes from 4 KB to 4 MB. Freed
+// buffers go back to a per-class free list; larger ones are plain mallocs.
+#define RECV_MIN_SHIFT 12
+#define RECV_CLASS_COUNT 11
+#define RECV_POOL_DEPTH 8
+
+static char *recv_pool[RECV_CLASS_COUNT][RECV_POOL_DEPTH];
+static int recv_pool_count[RECV_CLASS_COUNT];
+
+// Smallest size class holding capacity bytes, or -1 if it is beyond the largest
+static int recv_size_class(size_t capacity) {
+    for (int cls = 0; cls < RECV_CLASS_COUNT; cls++) {
+        if (capacity <= ((size_t)1 << (cls + RECV_MIN_SHIFT))) return cls;
+    }
+    return -1;
+}
+
+static char *recv_block_get(HTTPResponse *response, size_t capacity, size_t *capacity_out) {
+    int cls = recv_size_class(capacity);
+    if (cls >= 0) {
+        capacity = (size_t)1 << (cls + RECV_MIN_SHIFT);
+
+        char *block = NULL;
+        pthread_mutex_lock(&pool_lock);
+        if (recv_pool_count[cls] > 0) {
+            block = recv_pool[cls][--recv_pool_count[cls]];
+            client_stats.recv_pool_hits++;
+        } else {
+            client_stats.recv_allocations++;
+        }
+        pthread_mutex_unlock(&pool_lock);
+
+        if (block) {
+            response->pool_hits++;
+            *capacity_out = capacity;
+            return block;
+        }
+    } else {
+        pthread_mutex_lock(&pool_lock);
+        client_stats.recv_allocations++;
+        pthread_mutex_unlock(&pool_lock);
+    }
+
+    char *block = malloc(capacity);
+    if (block) {
+        response->allocations++;
+        *capacity_out = capacity;
+    }
+    return block;
+}
+
+static void recv_block_put(char *block, size_t capacity) {
+    if (!block) return;
+
+    int cls = recv_size_class(capacity);
+    if (cls >= 0 && capacity == ((size_t)1 << (cls + RECV_MIN_SHIFT))) {
+        pthread_mutex_lock(&pool_lock);
+        if (recv_pool_count[cls] < RECV_POOL_DEPTH) {
+            recv_pool[cls][recv_pool_count[cls]++] = block;
+            block = NULL;
+        }
+        pthread_mutex_unlock(&pool_lock);
+    }
+    free(block);
+}
+
+// Make room for capacity bytes (including the NUL), at least doubling the buffer
+int http_response_reserve(HTTPResponse *response, size_t capacity) {
+    if (capacity <= response->capacity) return 0;
+    if (capacity < response->capacity * 2) capacity = response->capacity * 2;
+
+    size_t new_capacity = 0;
+    char *block = recv_block_get(response, capacity, &new_capacity);
+    if (!block) return -1;
+
+    memcpy(block, response->memory, response->size + 1);
+    recv_block_put(response->memory, response->capacity);
+    response->memory = block;
+    response->capacity = new_capacity;
+    return 0;
+}
+
 // HTTP response callback
 size_t WriteMemoryCallback(const void *contents, size_t size, size_t nmemb, void *userp) {
     size_t realsize = size * nmemb;
     HTTPResponse *response = (HTTPResponse *)userp;
 
-    char *ptr = realloc(response->memory, response->size + realsize + 1);
-    if (!ptr) {
-        (void)fprintf(stderr, "Not enough memory (realloc returned NULL)\n");
+    if (http_response_reserve(response, response->size + realsize + 1) != 0) {
+        (void)fprintf(stderr, "Not enough memory for response buffer\n");
         return 0;
     }
-    response->memory = ptr;
     memcpy(&(response->memory[response->size]), contents, realsize);
     response->size += realsize;
     response->memory[response->size] = 0;
@@ -25,22 +131,61 @@ size_t WriteMemoryCallback(const void *contents, size_t size, size_t nmemb, void
     return realsize;
 }
 
-// Initialize HTTP response structure
+// Size the buffer up front when the server announces Content-Length
+static size_t HeaderCallback(const char *buffer, size_t size, size_t nitems, void *userp) {
+    size_t len = size * nitems;
+    static const char header[] = "content-length:";
+
+    if (len > sizeof(header) - 1 && strncasecmp(buffer, header, sizeof(header) - 1) == 0) {
+        char *end = NULL;
+        unsigned long long length = strtoull(buffer + sizeof(header) - 1, &end, 10);
+        if (end != buffer + sizeof(header) - 1 && length > 0 && length < MAX_PRESIZED_RESPONSE) {
+            (void)http_response_reserve((HTTPResponse *)userp, (size_t)length + 1);
+        }
+    }
+    return len;
+}
+
+// Collect the response body into response, presized from Content-Length
+void http_response_attach(CURL *curl, HTTPResponse *response) {
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)response);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, HeaderCallback);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, (void *)response);
+}
+
+// Initialize HTTP response structure with an empty pooled buffer
 HTTPResponse *init_http_response(void) {
-    HTTPResponse *response = (HTTPResponse *)malloc(sizeof(HTTPResponse));
-    response->memory = (char *)malloc(1);
-    response->size = 0;
+    HTTPResponse *response = (HTTPResponse *)calloc(1, sizeof(HTTPResponse));
+    if (!response) return NULL;
+
+    response->memory = recv_block_get(response, 1, &response->capacity);
+    if (!response->memory) {
+        free(response);
+        return NULL;
+    }
+    response->memory[0] = '\0';
+
+    pthread_mutex_lock(&pool_lock);
+    client_stats.responses++;
+    pthread_mutex_unlock(&pool_lock);
     return response;
 }
 
-// Free HTTP response
+// Free HTTP response, returning its buffer to the pool
 void free_http_response(HTTPResponse *response) {
     if (response) {
-        if (response->memory) free(response->memory);
+        recv_block_put(response->memory, response->capacity);
         free(response);
     }
 }
 
+// Empty the response, keeping its buffer (before retrying a transfer)
+void http_response_reset(HTTPResponse *response) {
+    response->size = 0;
+    response->memory[0] = '\0';
+}
+
 // Get API key (to be called from main)
 char *get_api_key(void) {
     if (!perplexity_api_key) {
@@ -48,3 +193,200 @@ char *get_api_key(void) {
     }
     return perplexity_api_key;
 }
+
+static void build_api_urls(void) {
+    const char *base = getenv("PERPLEXITY_API_BASE_URL");
+    size_t len = base ? strlen(base) : 0;
+    while (len > 0 && base[len - 1] == '/') len--;
+
+    if (len == 0 || len + sizeof(ASYNC_CHAT_COMPLETIONS_PATH) > MAX_API_URL_SIZE) {
+        if (len > 0) {
+            (void)fprintf(stderr, "Warning: PERPLEXITY_API_BASE_URL is too long, using %s\n", DEFAULT_API_BASE_URL);
+        }
+        base = DEFAULT_API_BASE_URL;
+        len = strlen(base);
+    } else {
+        (void)fprintf(stderr, "Using Perplexity API at %.*s\n", (int)len, base);
+    }
+
+    (void)snprintf(api_url, sizeof(api_url), "%.*s%s", (int)len, base, CHAT_COMPLETIONS_PATH);
+    (void)snprintf(async_api_url, sizeof(async_api_url), "%.*s%s", (int)len, base, ASYNC_CHAT_COMPLETIONS_PATH);
+}
+
+// Chat completions endpoint
+const char *get_api_url(void) {
+    (void)pthread_once(&api_url_once, build_api_urls);
+    return api_url;
+}
+
+// Async chat completions endpoint; jobs live at <url>/<request_id>
+const char *get_async_api_url(void) {
+    (void)pthread_once(&api_url_once, build_api_urls);
+    return async_api_url;
+}
+
+static void share_lock_cb(CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr) {
+    (void)handle;
+    (void)access;
+    (void)userptr;
+    pthread_mutex_lock(&share_locks[data]);
+}
+
+static void share_unlock_cb(CURL *handle, curl_lock_data data, void *userptr) {
+    (void)handle;
+    (void)userptr;
+    pthread_mutex_unlock(&share_locks[data]);
+}
+
+// Set up the shared cache; call once after curl_global_init()
+int http_client_init(void) {
+    (void)get_api_url();  // Resolve the endpoints up front so an override is logged at startup
+
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+        pthread_mutex_init(&share_locks[i], NULL);
+    }
+
+    share_handle = curl_share_init();
+    if (!share_handle) return -1;
+
+    curl_share_setopt(share_handle, CURLSHOPT_LOCKFUNC, share_lock_cb);
+    curl_share_setopt(share_handle, CURLSHOPT_UNLOCKFUNC, share_unlock_cb);
+    curl_share_setopt(share_handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share_handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    curl_share_setopt(share_handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+
+    return 0;
+}
+
+// Release pooled handles and the shared cache; call before curl_global_cleanup()
+void http_client_cleanup(void) {
+    pthread_mutex_lock(&pool_lock);
+    for (int i = 0; i < idle_count; i++) {
+        curl_easy_cleanup(idle_handles[i]);
+    }
+    idle_count = 0;
+
+    for (int cls = 0; cls < RECV_CLASS_COUNT; cls++) {
+        while (recv_pool_count[cls] > 0) {
+            free(recv_pool[cls][--recv_pool_count[cls]]);
+        }
+    }
+    pthread_mutex_unlock(&pool_lock);
+
+    if (share_handle) {
+        curl_share_cleanup(share_handle);
+        share_handle = NULL;
+    }
+
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+        pthread_mutex_destroy(&share_locks[i]);
+    }
+}
+
+// Lease an easy handle attached to the shared cache.
+// Options from the previous lease are cleared; connections are kept.
+CURL *http_client_acquire(void) {
+    CURL *curl = NULL;
+
+    pthread_mutex_lock(&pool_lock);
+    if (idle_count > 0) {
+        curl = idle_handles[--idle_count];
+    }
+    client_stats.handles_leased++;
+    if (!curl) client_stats.handles_created++;
+    pthread_mutex_unlock(&pool_lock);
+
+    if (!curl) {
+        curl = curl_easy_init();
+        if (!curl) return NULL;
+    }
+
+    if (share_handle) {
+        curl_easy_setopt(curl, CURLOPT_SHARE, share_handle);
+    }
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+
+    return curl;
+}
+
+// Return a leased handle to the pool
+void http_client_release(CURL *curl) {
+    if (!curl) return;
+
+    curl_easy_reset(curl);
+
+    pthread_mutex_lock(&pool_lock);
+    if (idle_count < MAX_IDLE_HANDLES) {
+        idle_handles[idle_count++] = curl;
+        curl = NULL;
+    }
+    pthread_mutex_unlock(&pool_lock);
+
+    if (curl) curl_easy_cleanup(curl);
+}
+
+// Perform a transfer on a leased handle. Runs on the shared event loop when it
+// is up (the caller just waits), otherwise falls back to curl_easy_perform().
+CURLcode http_client_perform(CURL *curl) {
+    if (event_loop_is_running()) {
+        return event_loop_perform(curl);
+    }
+
+    CURLcode res = curl_easy_perform(curl);
+    http_client_record_transfer(curl);
+    return res;
+}
+
+// Abort the transfer once its call is cancelled or past its deadline
+static int cancel_xferinfo(void *clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow) {
+    (void)dltotal;
+    (void)dlnow;
+    (void)ultotal;
+    (void)ulnow;
+    return cancel_token_expired((const CancelToken *)clientp);
+}
+
+// Limit a transfer to timeout_ms, or less when the call's deadline is closer,
+// and make it abort (CURLE_ABORTED_BY_CALLBACK) when the call is cancelled
+void http_client_set_deadline(CURL *curl, const CancelToken *token, long timeout_ms) {
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, cancel_token_timeout_ms(token, timeout_ms));
+    if (token) {
+        curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, cancel_xferinfo);
+        curl_easy_setopt(curl, CURLOPT_XFERINFODATA, (void *)token);
+        curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+    }
+}
+
+// Record whether a finished transfer reused a connection
+void http_client_record_transfer(CURL *curl) {
+    long new_connections = 0;
+    curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &new_connections);
+
+    pthread_mutex_lock(&pool_lock);
+    client_stats.transfers++;
+    if (new_connections > 0) client_stats.new_connections++;
+    pthread_mutex_unlock(&pool_lock);
+}
+
+void http_client_get_stats(HTTPClientStats *stats) {
+    pthread_mutex_lock(&pool_lock);
+    *stats = client_stats;
+    pthread_mutex_unlock(&pool_lock);
+}
+
+void http_client_log_stats(void) {
+    HTTPClientStats stats;
+    http_client_get_stats(&stats);
+
+    unsigned long reused = stats.transfers - stats.new_connections;
+    double reuse_ratio = stats.transfers > 0 ? (double)reused / (double)stats.transfers : 0.0;
+
+    (void)fprintf(stderr, "HTTP transfers: %lu, new connections: %lu, reused: %lu (%.1f%%), handles created: %lu/%lu leases\n",
+                  stats.transfers, stats.new_connections, reused, reuse_ratio * 100.0,
+                  stats.handles_created, stats.handles_leased);
+
+    double per_response = stats.responses > 0 ? (double)stats.recv_allocations / (double)stats.responses : 0.0;
+    (void)fprintf(stderr, "Receive buffers: %lu responses, %lu allocations (%.2f per response), %lu pool reuses\n",
+                  stats.responses, stats.recv_allocations, per_response, stats.recv_pool_hits);
+}
@@ -1,14 +1,45 @@
 #ifndef HTTP_CLIENT_H
 #define HTTP_CLIENT_H
 
+#include <curl/curl.h>
 #include "../include/types.h"
+#include "cancel.h"
+
+// Connection-reuse counters for the shared handle pool
+typedef struct {
+    unsigned long transfers;        // Completed http_client_perform() calls
+    unsigned long new_connections;  // Transfers that had to open a new connection
+    unsigned long handles_created;  // Easy handles allocated (pool misses)
+    unsigned long handles_leased;   // Total http_client_acquire() calls
+    unsigned long responses;        // Receive buffers handed out by init_http_response()
+    unsigned long recv_allocations; // Receive buffer mallocs (pool misses)
+    unsigned long recv_pool_hits;   // Receive buffers reused from the pool
+} HTTPClientStats;
 
 // HTTP client functions
 HTTPResponse *init_http_response(void);
 void free_http_response(HTTPResponse *response);
+void http_response_reset(HTTPResponse *response);
+int http_response_reserve(HTTPResponse *response, size_t capacity);
 size_t WriteMemoryCallback(const void *contents, size_t size, size_t nmemb, void *userp);
+void http_response_attach(CURL *curl, HTTPResponse *response);
+
+// Persistent connection layer: shared DNS, TLS session and connection cache
+int http_client_init(void);
+void http_client_cleanup(void);
+CURL *http_client_acquire(void);
+void http_client_release(CURL *curl);
+CURLcode http_client_perform(CURL *curl);
+void http_client_set_deadline(CURL *curl, const CancelToken *token, long timeout_ms);
+void http_client_record_transfer(CURL *curl);
+void http_client_get_stats(HTTPClientStats *stats);
+void http_client_log_stats(void);
 
 // Get global API key
 extern char *get_api_key(void);
 
+// API endpoints (PERPLEXITY_API_BASE_URL overrides https://api.perplexity.ai)
+const char *get_api_url(void);
+const char *get_async_api_url(void);
+
 #endif
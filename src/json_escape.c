@@ -0,0 +1,73 @@
+#define GNU_SOURCE
+#include "json_escape.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Bytes below 0x20, '"' and '\\' must be escaped; everything else (including
+// UTF-8 sequences) is copied as is. With SSE2 the scan checks 16 bytes per step.
+size_t json_escape_safe_run(const char *s, size_t len) {
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control_max = _mm_set1_epi8(0x1F);
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(const void *)(s + i));
+        __m128i special = _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash));
+        // Unsigned v <= 0x1F exactly when max(v, 0x1F) == 0x1F
+        special = _mm_or_si128(special, _mm_cmpeq_epi8(_mm_max_epu8(v, control_max), control_max));
+
+        int mask = _mm_movemask_epi8(special);
+        if (mask != 0) return i + (size_t)__builtin_ctz((unsigned int)mask);
+    }
+#endif
+
+    for (; i < len; i++) {
+        unsigned char c = (unsigned char)s[i];
+        if (c < 0x20 || c == '"' || c == '\\') break;
+    }
+    return i;
+}
+
+size_t json_escape_byte(unsigned char c, char out[6]) {
+    static const char hex[] = "0123456789abcdef";
+
+    out[0] = '\\';
+    switch (c) {
+        case '"': out[1] = '"'; return 2;
+        case '\\': out[1] = '\\'; return 2;
+        case '\n': out[1] = 'n'; return 2;
+        case '\r': out[1] = 'r'; return 2;
+        case '\t': out[1] = 't'; return 2;
+        case '\b': out[1] = 'b'; return 2;
+        case '\f': out[1] = 'f'; return 2;
+        default:
+            out[1] = 'u';
+            out[2] = '0';
+            out[3] = '0';
+            out[4] = hex[c >> 4];
+            out[5] = hex[c & 0xf];
+            return 6;
+    }
+}
+
+size_t json_escaped_length(const char *s, size_t len) {
+    size_t total = 0;
+    size_t i = 0;
+    char esc[6];
+
+    while (i < len) {
+        size_t run = json_escape_safe_run(s + i, len - i);
+        total += run;
+        i += run;
+        if (i < len) {
+            total += json_escape_byte((unsigned char)s[i], esc);
+            i++;
+        }
+    }
+    return total;
+}
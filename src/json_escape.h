@@ -0,0 +1,15 @@
+#ifndef JSON_ESCAPE_H
+#define JSON_ESCAPE_H
+
+#include <stddef.h>
+
+// Length of the leading run of s that needs no escaping inside a JSON string
+size_t json_escape_safe_run(const char *s, size_t len);
+
+// Escape sequence for one byte that needs it; returns its length (2 or 6)
+size_t json_escape_byte(unsigned char c, char out[6]);
+
+// Escaped length of s, without the surrounding quotes
+size_t json_escaped_length(const char *s, size_t len);
+
+#endif
@@ -0,0 +1,282 @@
+#define GNU_SOURCE
+#include "json_scan.h"
+#include <stdlib.h>
+#include <string.h>
+
+const char *json_scan_ws(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) p++;
+    return p;
+}
+
+// p at the opening quote; returns the position after the closing quote.
+// The quote search uses memchr, which libc vectorizes.
+static const char *skip_string(const char *p, const char *end) {
+    p++;
+    for (;;) {
+        const char *quote = memchr(p, '"', (size_t)(end - p));
+        if (!quote) return NULL;
+
+        // An odd run of backslashes means the quote is escaped
+        const char *b = quote;
+        while (b > p && b[-1] == '\\') b--;
+        if (((quote - b) & 1) == 0) return quote + 1;
+        p = quote + 1;
+    }
+}
+
+// Skip one complete value starting at p; NULL if it is malformed
+const char *json_scan_skip(const char *p, const char *end) {
+    p = json_scan_ws(p, end);
+    if (p >= end) return NULL;
+
+    if (*p == '"') return skip_string(p, end);
+
+    if (*p == '{' || *p == '[') {
+        int depth = 0;
+        while (p < end) {
+            char c = *p;
+            if (c == '"') {
+                p = skip_string(p, end);
+                if (!p) return NULL;
+                continue;
+            }
+            if (c == '{' || c == '[') {
+                depth++;
+            } else if (c == '}' || c == ']') {
+                if (--depth == 0) return p + 1;
+            }
+            p++;
+        }
+        return NULL;
+    }
+
+    // Number, true, false or null
+    const char *start = p;
+    while (p < end && *p != ',' && *p != '}' && *p != ']' &&
+           *p != ' ' && *p != '\n' && *p != '\r' && *p != '\t') {
+        p++;
+    }
+    return p > start ? p : NULL;
+}
+
+static int iter_begin(JsonIter *it, const char *p, const char *end, char open, char close) {
+    memset(it, 0, sizeof(*it));
+    p = p ? json_scan_ws(p, end) : NULL;
+    if (!p || p >= end || *p != open) return 0;
+
+    it->p = json_scan_ws(p + 1, end);
+    it->end = end;
+    it->close = close;
+    return 1;
+}
+
+int json_scan_object_begin(JsonIter *it, const char *p, const char *end) {
+    return iter_begin(it, p, end, '{', '}');
+}
+
+int json_scan_array_begin(JsonIter *it, const char *p, const char *end) {
+    return iter_begin(it, p, end, '[', ']');
+}
+
+// Step past the previous value and its separator; 0 at the closing bracket
+static int iter_advance(JsonIter *it) {
+    if (!it->p || it->error) return 0;
+
+    if (it->value) {
+        const char *p = it->value_end ? it->value_end : json_scan_skip(it->value, it->end);
+        it->value_end = NULL;
+        if (!p) {
+            it->error = 1;
+            return 0;
+        }
+        p = json_scan_ws(p, it->end);
+        if (p < it->end && *p == ',') {
+            it->p = json_scan_ws(p + 1, it->end);
+        } else if (p < it->end && *p == it->close) {
+            it->p = NULL;
+            it->after = p + 1;
+            return 0;
+        } else {
+            it->error = 1;
+            return 0;
+        }
+    } else if (it->p < it->end && *it->p == it->close) {
+        it->after = it->p + 1;
+        it->p = NULL;
+        return 0;
+    }
+    return it->p < it->end;
+}
+
+int json_scan_object_next(JsonIter *it, const char **key, size_t *key_len, const char **value) {
+    if (!iter_advance(it)) return 0;
+
+    const char *p = it->p;
+    if (*p != '"') {
+        it->error = 1;
+        return 0;
+    }
+    const char *key_end = skip_string(p, it->end);
+    if (!key_end) {
+        it->error = 1;
+        return 0;
+    }
+    *key = p + 1;
+    *key_len = (size_t)(key_end - p - 2);
+
+    p = json_scan_ws(key_end, it->end);
+    if (p >= it->end || *p != ':') {
+        it->error = 1;
+        return 0;
+    }
+    it->value = json_scan_ws(p + 1, it->end);
+    *value = it->value;
+    return 1;
+}
+
+int json_scan_array_next(JsonIter *it, const char **value) {
+    if (!iter_advance(it)) return 0;
+
+    it->value = it->p;
+    *value = it->value;
+    return 1;
+}
+
+void json_scan_iter_skip_to(JsonIter *it, const char *value_end) {
+    it->value_end = value_end;
+}
+
+int json_scan_key_equals(const char *key, size_t key_len, const char *expected) {
+    return strlen(expected) == key_len && memcmp(key, expected, key_len) == 0;
+}
+
+const char *json_scan_member(const char *p, const char *end, const char *key) {
+    JsonIter it;
+    if (!json_scan_object_begin(&it, p, end)) return NULL;
+
+    const char *name, *value;
+    size_t name_len;
+    while (json_scan_object_next(&it, &name, &name_len, &value)) {
+        if (json_scan_key_equals(name, name_len, key)) return value;
+    }
+    return NULL;
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static int read_hex4(const char *p, const char *end, unsigned int *out) {
+    if (end - p < 4) return -1;
+    unsigned int v = 0;
+    for (int i = 0; i < 4; i++) {
+        int h = hex_value(p[i]);
+        if (h < 0) return -1;
+        v = (v << 4) | (unsigned int)h;
+    }
+    *out = v;
+    return 0;
+}
+
+static char *put_utf8(char *out, unsigned int cp) {
+    if (cp < 0x80) {
+        *out++ = (char)cp;
+    } else if (cp < 0x800) {
+        *out++ = (char)(0xC0 | (cp >> 6));
+        *out++ = (char)(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        *out++ = (char)(0xE0 | (cp >> 12));
+        *out++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+        *out++ = (char)(0x80 | (cp & 0x3F));
+    } else {
+        *out++ = (char)(0xF0 | (cp >> 18));
+        *out++ = (char)(0x80 | ((cp >> 12) & 0x3F));
+        *out++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+        *out++ = (char)(0x80 | (cp & 0x3F));
+    }
+    return out;
+}
+
+// Decode the string value at p into a new NUL-terminated buffer; *after is
+// set past the closing quote
+char *json_scan_string_dup(const char *p, const char *end, const char **after) {
+    p = p ? json_scan_ws(p, end) : NULL;
+    if (!p || p >= end || *p != '"') return NULL;
+
+    const char *close = skip_string(p, end);
+    if (!close) return NULL;
+    if (after) *after = close;
+    const char *s = p + 1;
+    const char *s_end = close - 1;
+    size_t len = (size_t)(s_end - s);
+
+    // Decoded text is never longer than its escaped form
+    char *out = malloc(len + 1);
+    if (!out) return NULL;
+
+    // Fast path: no escapes, one copy
+    if (!memchr(s, '\\', len)) {
+        memcpy(out, s, len);
+        out[len] = '\0';
+        return out;
+    }
+
+    char *w = out;
+    while (s < s_end) {
+        const char *bs = memchr(s, '\\', (size_t)(s_end - s));
+        if (!bs) bs = s_end;
+        memcpy(w, s, (size_t)(bs - s));
+        w += bs - s;
+        s = bs;
+        if (s >= s_end) break;
+
+        s++;  // Backslash
+        if (s >= s_end) break;
+        char c = *s++;
+        switch (c) {
+            case 'n': *w++ = '\n'; break;
+            case 'r': *w++ = '\r'; break;
+            case 't': *w++ = '\t'; break;
+            case 'b': *w++ = '\b'; break;
+            case 'f': *w++ = '\f'; break;
+            case 'u': {
+                unsigned int cp;
+                if (read_hex4(s, s_end, &cp) != 0) goto invalid;
+                s += 4;
+                if (cp >= 0xD800 && cp <= 0xDBFF) {
+                    unsigned int low;
+                    if (s_end - s >= 6 && s[0] == '\\' && s[1] == 'u' &&
+                        read_hex4(s + 2, s_end, &low) == 0 && low >= 0xDC00 && low <= 0xDFFF) {
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                        s += 6;
+                    } else {
+                        cp = 0xFFFD;
+                    }
+                } else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+                    cp = 0xFFFD;
+                }
+                w = put_utf8(w, cp);
+                break;
+            }
+            default: *w++ = c; break;  // \" \\ \/
+        }
+    }
+    *w = '\0';
+    return out;
+
+invalid:
+    free(out);
+    return NULL;
+}
+
+int json_scan_number(const char *p, const char *end, double *out) {
+    p = p ? json_scan_ws(p, end) : NULL;
+    if (!p || p >= end || !(*p == '-' || (*p >= '0' && *p <= '9'))) return -1;
+
+    char *num_end = NULL;
+    *out = strtod(p, &num_end);
+    return num_end > p && num_end <= end ? 0 : -1;
+}
@@ -0,0 +1,43 @@
+#ifndef JSON_SCAN_H
+#define JSON_SCAN_H
+
+#include <stddef.h>
+
+// On-demand JSON scanner. Works in place on a buffer, decodes only the
+// values that are asked for and skips everything else structurally.
+// Pointers returned point into the scanned buffer.
+
+// Iterator over the members of an object or the elements of an array
+typedef struct {
+    const char *p;
+    const char *end;
+    const char *value;      // Current value; skipped on the next call
+    const char *value_end;  // End of the current value, when the caller already walked it
+    const char *after;      // Past the closing bracket once iteration is done
+    char close;             // '}' or ']'
+    int error;
+} JsonIter;
+
+const char *json_scan_ws(const char *p, const char *end);
+const char *json_scan_skip(const char *p, const char *end);
+
+// Begin iterating the object/array at p; returns 0 if p is not one
+int json_scan_object_begin(JsonIter *it, const char *p, const char *end);
+int json_scan_array_begin(JsonIter *it, const char *p, const char *end);
+
+// Advance to the next member; key is raw (escapes are not decoded)
+int json_scan_object_next(JsonIter *it, const char **key, size_t *key_len, const char **value);
+int json_scan_array_next(JsonIter *it, const char **value);
+
+// Record where the current value ends so the iterator does not rescan it
+void json_scan_iter_skip_to(JsonIter *it, const char *value_end);
+
+// Find a member by key in the object at p
+const char *json_scan_member(const char *p, const char *end, const char *key);
+
+// Value accessors; p must point at the value's first character
+int json_scan_key_equals(const char *key, size_t key_len, const char *expected);
+char *json_scan_string_dup(const char *p, const char *end, const char **after);
+int json_scan_number(const char *p, const char *end, double *out);
+
+#endif
@@ -3,28 +3,46 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
 #include <cjson/cJSON.h>
 #include "../include/types.h"  // For MessageArray, ChatMessage
+#include "../include/constants.h"
+#include "buffer.h"
 
-// Constants for magic numbers
-#define JSONRPC_INTERNAL_ERROR (-32603)
+// Serializes stdout so concurrent responses never interleave
+static pthread_mutex_t stdout_lock = PTHREAD_MUTEX_INITIALIZER;
 
-// Parse messages array from JSON
+struct ResponseBatch {
+    pthread_mutex_t lock;
+    int refs;
+    int count;          // Responses collected in out
+    Buffer out;
+};
+
+// Parse messages array from JSON. Roles and contents borrow the strings of
+// messages_json, which must outlive the returned array.
 MessageArray *parse_messages(const cJSON *messages_json) {
     if (!cJSON_IsArray(messages_json)) {
         return NULL;
     }
 
     int count = cJSON_GetArraySize(messages_json);
-    MessageArray *msg_array = (MessageArray *)malloc(sizeof(MessageArray));
+    MessageArray *msg_array = (MessageArray *)cJSON_malloc(sizeof(MessageArray));
+    if (!msg_array) return NULL;
 
-    // FIX: Use calloc instead of malloc to initialize memory to zero
-    // This prevents "garbage value" warnings when accessing uninitialized fields
-    msg_array->messages = (ChatMessage *)calloc((size_t)count, sizeof(ChatMessage));
+    msg_array->messages = (ChatMessage *)cJSON_malloc(sizeof(ChatMessage) * (size_t)(count > 0 ? count : 1));
+    if (!msg_array->messages) {
+        cJSON_free(msg_array);
+        return NULL;
+    }
     msg_array->count = count;
 
-    for (int i = 0; i < count; i++) {
-        cJSON *msg = cJSON_GetArrayItem(messages_json, i);
+    int i = 0;
+    const cJSON *msg = NULL;
+    cJSON_ArrayForEach(msg, messages_json) {
         cJSON *role = cJSON_GetObjectItem(msg, "role");
         cJSON *content = cJSON_GetObjectItem(msg, "content");
 
@@ -32,59 +50,213 @@ MessageArray *parse_messages(const cJSON *messages_json) {
             msg_array->messages[i].role = NULL;
             msg_array->messages[i].content = NULL;
         } else {
-            msg_array->messages[i].role = strdup(role->valuestring);
-            msg_array->messages[i].content = strdup(content->valuestring);
+            msg_array->messages[i].role = role->valuestring;
+            msg_array->messages[i].content = content->valuestring;
         }
+        i++;
     }
 
     return msg_array;
 }
 
-// Free messages
+// Free messages (the strings are borrowed)
 void free_message_array(MessageArray *msg_array) {
     if (!msg_array) {
         return;
     }
 
-    for (int i = 0; i < msg_array->count; i++) {
-        if (msg_array->messages[i].role) {
-            free(msg_array->messages[i].role);
+    cJSON_free(msg_array->messages);
+    cJSON_free(msg_array);
+}
+
+// Clamped as a double to [1, MAX_DEADLINE_MS], so huge or fractional values
+// never reach the integer conversion or overflow a deadline added to now
+long parse_deadline_ms(const cJSON *arguments) {
+    cJSON *deadline = cJSON_GetObjectItem(arguments, "deadline_ms");
+    if (!cJSON_IsNumber(deadline) || !(deadline->valuedouble > 0)) return 0;
+
+    double value = deadline->valuedouble;
+    if (value < 1) return 1;
+    if (value >= MAX_DEADLINE_MS) return MAX_DEADLINE_MS;
+    return (long)value;
+}
+
+// Per-thread output buffer, reused across responses. Buffers that grew past
+// OUTPUT_BUFFER_RETAIN (a large report) are released after the write.
+#define OUTPUT_BUFFER_RETAIN (256 * 1024)
+static __thread Buffer output_buffer;
+static pthread_key_t output_buffer_key;
+static pthread_once_t output_buffer_once = PTHREAD_ONCE_INIT;
+
+// Thread-exit destructor for worker and event loop threads
+static void free_output_buffer(void *buffer) {
+    buffer_free((Buffer *)buffer);
+}
+
+static void create_output_buffer_key(void) {
+    (void)pthread_key_create(&output_buffer_key, free_output_buffer);
+}
+
+static Buffer *begin_output(void) {
+    if (!output_buffer.data) {
+        (void)pthread_once(&output_buffer_once, create_output_buffer_key);
+        (void)pthread_setspecific(output_buffer_key, &output_buffer);
+    }
+    buffer_reset(&output_buffer);
+    return &output_buffer;
+}
+
+// Write all iovecs, retrying on short writes
+static void write_all(struct iovec *iov, int iovcnt) {
+    while (iovcnt > 0) {
+        ssize_t n = writev(STDOUT_FILENO, iov, iovcnt);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            (void)fprintf(stderr, "Failed to write response: %s\n", strerror(errno));
+            return;
+        }
+
+        size_t written = (size_t)n;
+        while (iovcnt > 0 && written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            iovcnt--;
         }
-        if (msg_array->messages[i].content) {
-            free(msg_array->messages[i].content);
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + written;
+            iov->iov_len -= written;
         }
     }
-    free(msg_array->messages);
-    free(msg_array);
-}
-
-// Send JSON-RPC formatted response
-void send_response(int request_id, const char *result, int error, const char *error_msg) {
-    cJSON *root = cJSON_CreateObject();
-    cJSON_AddStringToObject(root, "jsonrpc", "2.0");
-    cJSON_AddNumberToObject(root, "id", request_id);
-
-    if (!error) {
-        cJSON *result_obj = cJSON_CreateObject();
-        cJSON *content_array = cJSON_CreateArray();
-        cJSON *content_obj = cJSON_CreateObject();
-        cJSON_AddStringToObject(content_obj, "type", "text");
-        cJSON_AddStringToObject(content_obj, "text", result);
-        cJSON_AddItemToArray(content_array, content_obj);
-        cJSON_AddItemToObject(result_obj, "content", content_array);
-        cJSON_AddBoolToObject(result_obj, "isError", 0);
-        cJSON_AddItemToObject(root, "result", result_obj);
+}
+
+// Write the output buffer as one newline-terminated frame
+static void finish_output(Buffer *out) {
+    if (buffer_append(out, "\n", 1) != 0) {
+        (void)fprintf(stderr, "Not enough memory for response\n");
+    } else {
+        struct iovec iov = {out->data, out->len};
+        pthread_mutex_lock(&stdout_lock);
+        write_all(&iov, 1);
+        pthread_mutex_unlock(&stdout_lock);
+    }
+
+    if (out->cap > OUTPUT_BUFFER_RETAIN) {
+        buffer_free(out);
+    }
+}
+
+// Write the response frame in out to its destination
+static void finish_response(const Responder *to, Buffer *out) {
+    ResponseBatch *batch = to->batch;
+    if (!batch) {
+        finish_output(out);
+        return;
+    }
+
+    pthread_mutex_lock(&batch->lock);
+    if (buffer_append(&batch->out, batch->count ? "," : "[", 1) != 0 ||
+        buffer_append(&batch->out, out->data, out->len) != 0) {
+        (void)fprintf(stderr, "Not enough memory for batch response\n");
     } else {
-        cJSON *error_obj = cJSON_CreateObject();
-        cJSON_AddNumberToObject(error_obj, "code", JSONRPC_INTERNAL_ERROR);
-        cJSON_AddStringToObject(error_obj, "message", error_msg);
-        cJSON_AddItemToObject(root, "error", error_obj);
+        batch->count++;
+    }
+    pthread_mutex_unlock(&batch->lock);
+    if (out->cap > OUTPUT_BUFFER_RETAIN) {
+        buffer_free(out);
+    }
+    response_batch_release(batch);
+}
+
+ResponseBatch *response_batch_create(void) {
+    ResponseBatch *batch = calloc(1, sizeof(ResponseBatch));
+    if (!batch) return NULL;
+    pthread_mutex_init(&batch->lock, NULL);
+    batch->refs = 1;
+    buffer_init(&batch->out);
+    return batch;
+}
+
+void response_batch_retain(ResponseBatch *batch) {
+    pthread_mutex_lock(&batch->lock);
+    batch->refs++;
+    pthread_mutex_unlock(&batch->lock);
+}
+
+// A batch of notifications only gets no response at all
+void response_batch_release(ResponseBatch *batch) {
+    pthread_mutex_lock(&batch->lock);
+    int last = --batch->refs == 0;
+    pthread_mutex_unlock(&batch->lock);
+    if (!last) return;
+
+    if (batch->count > 0) {
+        if (buffer_append(&batch->out, "]", 1) == 0) {
+            finish_output(&batch->out);
+        } else {
+            (void)fprintf(stderr, "Not enough memory for batch response\n");
+        }
+    }
+    buffer_free(&batch->out);
+    pthread_mutex_destroy(&batch->lock);
+    free(batch);
+}
+
+// Send JSON-RPC formatted response; frames are written compact, without a cJSON tree
+void send_response(const Responder *to, const char *result, int error, const char *error_msg) {
+    if (error) {
+        send_error(to, JSONRPC_INTERNAL_ERROR, error_msg);
+        return;
     }
 
-    char *output = cJSON_Print(root);
-    printf("%s\n", output);
-    (void)fflush(stdout);  // Fixed: removed redundant void cast
+    Buffer *out = begin_output();
+    buffer_append_str(out, "{\"jsonrpc\":\"2.0\",\"id\":");
+    buffer_append_str(out, to->id);
+    buffer_append_str(out, ",\"result\":{\"content\":[{\"type\":\"text\",\"text\":");
+    buffer_append_json_string(out, result ? result : "");
+    buffer_append_str(out, "}],\"isError\":false}}");
+
+    finish_response(to, out);
+}
+
+void send_error(const Responder *to, int code, const char *message) {
+    Buffer *out = begin_output();
+    buffer_append_str(out, "{\"jsonrpc\":\"2.0\",\"id\":");
+    buffer_append_str(out, to->id);
+    buffer_append_printf(out, ",\"error\":{\"code\":%d,\"message\":", code);
+    buffer_append_json_string(out, message ? message : "");
+    buffer_append_str(out, "}}");
+
+    finish_response(to, out);
+}
+
+// Send a result that is already serialized JSON (precomputed payloads)
+void send_result_json(const Responder *to, const char *result, size_t len) {
+    Buffer *out = begin_output();
+    buffer_append_str(out, "{\"jsonrpc\":\"2.0\",\"id\":");
+    buffer_append_str(out, to->id);
+    buffer_append_str(out, ",\"result\":");
+    buffer_append(out, result, len);
+    buffer_append_str(out, "}");
+
+    finish_response(to, out);
+}
+
+// For requests that get no answer (cancelled by the client)
+void send_no_response(const Responder *to) {
+    if (to->batch) response_batch_release(to->batch);
+}
+
+// Send an MCP notifications/progress message; progress_token is raw JSON
+void send_progress_notification(const char *progress_token, double progress, const char *message) {
+    Buffer *out = begin_output();
+    buffer_append_str(out, "{\"jsonrpc\":\"2.0\",\"method\":\"notifications/progress\",\"params\":{\"progressToken\":");
+    buffer_append_str(out, progress_token);
+    buffer_append_printf(out, ",\"progress\":%.15g", progress);
+    if (message) {
+        buffer_append_str(out, ",\"message\":");
+        buffer_append_json_string(out, message);
+    }
+    buffer_append_str(out, "}}");
 
-    free(output);
-    cJSON_Delete(root);
+    finish_output(out);
 }
@@ -8,7 +8,39 @@
 MessageArray *parse_messages(const cJSON *messages_json);
 void free_message_array(MessageArray *msg_array);
 
+// deadline_ms of tools/call (or batch item) arguments; 0 when absent
+long parse_deadline_ms(const cJSON *arguments);
+
+// JSON-RPC error codes
+#define JSONRPC_PARSE_ERROR (-32700)
+#define JSONRPC_INVALID_REQUEST (-32600)
+#define JSONRPC_METHOD_NOT_FOUND (-32601)
+#define JSONRPC_INVALID_PARAMS (-32602)
+#define JSONRPC_INTERNAL_ERROR (-32603)
+
+// Responses to the elements of one batch array, written as a single array
+// once every element has been answered
+typedef struct ResponseBatch ResponseBatch;
+
+// Where a response goes. id is the request id as raw JSON, copied from the
+// wire so string ids and integers beyond double precision survive.
+typedef struct {
+    const char *id;
+    ResponseBatch *batch;       // NULL: write the response on its own
+} Responder;
+
+// Batch lifecycle: every responder pointing at the batch holds a reference
+// and gives it up with exactly one send (or send_no_response); the creator
+// holds one more. The array is written when the last reference goes.
+ResponseBatch *response_batch_create(void);
+void response_batch_retain(ResponseBatch *batch);
+void response_batch_release(ResponseBatch *batch);
+
 // JSON-RPC response functions
-void send_response(int id, const char *result, int error, const char *error_msg);
+void send_response(const Responder *to, const char *result, int error, const char *error_msg);
+void send_error(const Responder *to, int code, const char *message);
+void send_result_json(const Responder *to, const char *result, size_t len);
+void send_no_response(const Responder *to);
+void send_progress_notification(const char *progress_token, double progress, const char *message);
 
 #endif
@@ -0,0 +1,389 @@
+#define GNU_SOURCE
+#include "ledger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Journal layout: a 16-byte header ("PPLXLDGR", u32 version, u32 record
+// size) followed by one 32-byte little-endian record per billed call:
+//   u8 model, u8 tool, u16 reserved,
+//   u32 prompt, completion, citation and reasoning tokens, u32 searches,
+//   i64 unix time
+// Records hold usage only; replay prices them with the current table.
+#define JOURNAL_MAGIC "PPLXLDGR"
+#define JOURNAL_VERSION 1
+#define HEADER_SIZE 16
+#define RECORD_SIZE 32
+#define INDEX_OTHER 0xff            // Model or tool without a table entry
+#define REPLAY_CHUNK_RECORDS 2048
+
+// Journal tool indices; new tools are only ever appended
+static const char *const TOOL_NAMES[] = {
+    "perplexity_ask", "perplexity_research", "perplexity_reason", "perplexity_deep_research",
+    "perplexity_research_hedged",   // Both legs of hedged research calls
+};
+#define TOOL_COUNT (int)(sizeof(TOOL_NAMES) / sizeof(TOOL_NAMES[0]))
+
+// The last model and tool slot collects everything without a table entry
+#define MODEL_SLOTS (USAGE_MODEL_COUNT + 1)
+#define TOOL_SLOTS (TOOL_COUNT + 1)
+
+typedef struct {
+    uint64_t calls;
+    uint64_t prompt_tokens;
+    uint64_t completion_tokens;
+    uint64_t citation_tokens;
+    uint64_t reasoning_tokens;
+    uint64_t search_queries;
+    uint64_t cost_nanos;        // USD * 1e9, so sums stay exact
+} LedgerTotals;
+
+static LedgerTotals cells[MODEL_SLOTS][TOOL_SLOTS];
+static int64_t since = 0;       // Time of the oldest call in the totals
+static int journal_fd = -1;
+static int journal_failed = 0;
+
+static const char *model_label(int slot) {
+    return slot < USAGE_MODEL_COUNT ? usage_model_name(slot) : "other";
+}
+
+static const char *tool_label(int slot) {
+    return slot < TOOL_COUNT ? TOOL_NAMES[slot] : "other";
+}
+
+int ledger_tool_index(const char *tool_name) {
+    if (tool_name) {
+        for (int i = 0; i < TOOL_COUNT; i++) {
+            if (strcmp(tool_name, TOOL_NAMES[i]) == 0) return i;
+        }
+    }
+    return TOOL_COUNT;
+}
+
+static uint32_t clamp_count(int value) {
+    return value > 0 ? (uint32_t)value : 0;
+}
+
+static uint64_t to_nanos(const CostInfo *cost) {
+    return cost && cost->total_cost > 0 ? (uint64_t)(cost->total_cost * 1e9 + 0.5) : 0;
+}
+
+static void add_call(int model, int tool, const UsageInfo *usage, uint64_t cost_nanos, int64_t when) {
+    LedgerTotals *cell = &cells[model][tool];
+    __atomic_fetch_add(&cell->calls, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&cell->prompt_tokens, clamp_count(usage->prompt_tokens), __ATOMIC_RELAXED);
+    __atomic_fetch_add(&cell->completion_tokens, clamp_count(usage->completion_tokens), __ATOMIC_RELAXED);
+    __atomic_fetch_add(&cell->citation_tokens, clamp_count(usage->citation_tokens), __ATOMIC_RELAXED);
+    __atomic_fetch_add(&cell->reasoning_tokens, clamp_count(usage->reasoning_tokens), __ATOMIC_RELAXED);
+    __atomic_fetch_add(&cell->search_queries, clamp_count(usage->num_search_queries), __ATOMIC_RELAXED);
+    __atomic_fetch_add(&cell->cost_nanos, cost_nanos, __ATOMIC_RELAXED);
+
+    int64_t oldest = __atomic_load_n(&since, __ATOMIC_RELAXED);
+    while ((oldest == 0 || when < oldest) &&
+           !__atomic_compare_exchange_n(&since, &oldest, when, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+/* ---- Journal encoding ---- */
+
+static void put_u32(unsigned char *p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static uint32_t get_u32(const unsigned char *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void put_u64(unsigned char *p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static uint64_t get_u64(const unsigned char *p) {
+    return (uint64_t)get_u32(p) | (uint64_t)get_u32(p + 4) << 32;
+}
+
+static void encode_record(unsigned char *rec, int model, int tool, const UsageInfo *usage, int64_t when) {
+    rec[0] = model < USAGE_MODEL_COUNT ? (unsigned char)model : INDEX_OTHER;
+    rec[1] = tool < TOOL_COUNT ? (unsigned char)tool : INDEX_OTHER;
+    rec[2] = 0;
+    rec[3] = 0;
+    put_u32(rec + 4, clamp_count(usage->prompt_tokens));
+    put_u32(rec + 8, clamp_count(usage->completion_tokens));
+    put_u32(rec + 12, clamp_count(usage->citation_tokens));
+    put_u32(rec + 16, clamp_count(usage->reasoning_tokens));
+    put_u32(rec + 20, clamp_count(usage->num_search_queries));
+    put_u64(rec + 24, (uint64_t)when);
+}
+
+static void replay_record(const unsigned char *rec) {
+    int model = rec[0] < USAGE_MODEL_COUNT ? rec[0] : USAGE_MODEL_COUNT;
+    int tool = rec[1] < TOOL_COUNT ? rec[1] : TOOL_COUNT;
+
+    UsageInfo usage;
+    memset(&usage, 0, sizeof(usage));
+    usage.prompt_tokens = (int)(get_u32(rec + 4) & 0x7fffffff);
+    usage.completion_tokens = (int)(get_u32(rec + 8) & 0x7fffffff);
+    usage.citation_tokens = (int)(get_u32(rec + 12) & 0x7fffffff);
+    usage.reasoning_tokens = (int)(get_u32(rec + 16) & 0x7fffffff);
+    usage.num_search_queries = (int)(get_u32(rec + 20) & 0x7fffffff);
+
+    CostInfo cost;
+    int priced = model < USAGE_MODEL_COUNT && calculate_cost(&usage, usage_model_name(model), &cost) == 0;
+    add_call(model, tool, &usage, priced ? to_nanos(&cost) : 0, (int64_t)get_u64(rec + 24));
+}
+
+// Read every whole record after the header. Returns the number replayed,
+// or -1 on a read error.
+static long long replay_journal(int fd, off_t size) {
+    unsigned char *chunk = malloc((size_t)REPLAY_CHUNK_RECORDS * RECORD_SIZE);
+    if (!chunk) return -1;
+
+    long long records = (long long)((size - HEADER_SIZE) / RECORD_SIZE);
+    off_t offset = HEADER_SIZE;
+    long long done = 0;
+    while (done < records) {
+        long long batch = records - done < REPLAY_CHUNK_RECORDS ? records - done : REPLAY_CHUNK_RECORDS;
+        size_t want = (size_t)batch * RECORD_SIZE;
+        size_t got = 0;
+        while (got < want) {
+            ssize_t n = pread(fd, chunk + got, want - got, offset + (off_t)got);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                free(chunk);
+                return -1;
+            }
+            got += (size_t)n;
+        }
+        for (long long i = 0; i < batch; i++) {
+            replay_record(chunk + i * RECORD_SIZE);
+        }
+        offset += (off_t)want;
+        done += batch;
+    }
+
+    free(chunk);
+    return done;
+}
+
+static int write_header(int fd) {
+    unsigned char header[HEADER_SIZE];
+    memcpy(header, JOURNAL_MAGIC, 8);
+    put_u32(header + 8, JOURNAL_VERSION);
+    put_u32(header + 12, RECORD_SIZE);
+    return write(fd, header, HEADER_SIZE) == HEADER_SIZE ? 0 : -1;
+}
+
+static int check_header(int fd) {
+    unsigned char header[HEADER_SIZE];
+    if (pread(fd, header, HEADER_SIZE, 0) != HEADER_SIZE) return -1;
+    if (memcmp(header, JOURNAL_MAGIC, 8) != 0) return -1;
+    if (get_u32(header + 8) != JOURNAL_VERSION || get_u32(header + 12) != RECORD_SIZE) return -1;
+    return 0;
+}
+
+static double totals_cost(const LedgerTotals *totals) {
+    return (double)totals->cost_nanos / 1e9;
+}
+
+static void snapshot_cell(int model, int tool, LedgerTotals *out) {
+    const LedgerTotals *cell = &cells[model][tool];
+    out->calls = __atomic_load_n(&cell->calls, __ATOMIC_RELAXED);
+    out->prompt_tokens = __atomic_load_n(&cell->prompt_tokens, __ATOMIC_RELAXED);
+    out->completion_tokens = __atomic_load_n(&cell->completion_tokens, __ATOMIC_RELAXED);
+    out->citation_tokens = __atomic_load_n(&cell->citation_tokens, __ATOMIC_RELAXED);
+    out->reasoning_tokens = __atomic_load_n(&cell->reasoning_tokens, __ATOMIC_RELAXED);
+    out->search_queries = __atomic_load_n(&cell->search_queries, __ATOMIC_RELAXED);
+    out->cost_nanos = __atomic_load_n(&cell->cost_nanos, __ATOMIC_RELAXED);
+}
+
+static void totals_add(LedgerTotals *sum, const LedgerTotals *add) {
+    sum->calls += add->calls;
+    sum->prompt_tokens += add->prompt_tokens;
+    sum->completion_tokens += add->completion_tokens;
+    sum->citation_tokens += add->citation_tokens;
+    sum->reasoning_tokens += add->reasoning_tokens;
+    sum->search_queries += add->search_queries;
+    sum->cost_nanos += add->cost_nanos;
+}
+
+/* ---- Public API ---- */
+
+int ledger_init(void) {
+    const char *path = getenv("PERPLEXITY_LEDGER_FILE");
+    if (!path || !*path) return 0;
+
+    int fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        (void)fprintf(stderr, "Warning: cannot open cost ledger %s: %s\n", path, strerror(errno));
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+
+    if (st.st_size == 0) {
+        if (write_header(fd) != 0) {
+            (void)fprintf(stderr, "Warning: cannot write cost ledger %s: %s\n", path, strerror(errno));
+            close(fd);
+            return -1;
+        }
+    } else if (st.st_size < HEADER_SIZE || check_header(fd) != 0) {
+        // Never append to a file we did not write
+        (void)fprintf(stderr, "Warning: %s is not a cost ledger journal, spend will not be persisted\n", path);
+        close(fd);
+        return -1;
+    } else {
+        long long records = replay_journal(fd, st.st_size);
+        if (records < 0) {
+            (void)fprintf(stderr, "Warning: cannot read cost ledger %s: %s\n", path, strerror(errno));
+            close(fd);
+            return -1;
+        }
+
+        // A crash mid-append leaves a partial record; drop it so appends stay aligned
+        off_t whole = HEADER_SIZE + (off_t)records * RECORD_SIZE;
+        if (whole != st.st_size && ftruncate(fd, whole) != 0) {
+            (void)fprintf(stderr, "Warning: cannot repair cost ledger %s: %s\n", path, strerror(errno));
+            close(fd);
+            return -1;
+        }
+
+        LedgerTotals total;
+        memset(&total, 0, sizeof(total));
+        for (int m = 0; m < MODEL_SLOTS; m++) {
+            for (int t = 0; t < TOOL_SLOTS; t++) {
+                LedgerTotals cell;
+                snapshot_cell(m, t, &cell);
+                totals_add(&total, &cell);
+            }
+        }
+        (void)fprintf(stderr, "Cost ledger: replayed %lld calls ($%.4f) from %s\n", records, totals_cost(&total), path);
+    }
+
+    journal_fd = fd;
+    return 0;
+}
+
+void ledger_shutdown(void) {
+    if (journal_fd < 0) return;
+    (void)fdatasync(journal_fd);
+    close(journal_fd);
+    journal_fd = -1;
+}
+
+void ledger_record(const char *model, int tool, const UsageInfo *usage, const CostInfo *cost) {
+    int model_slot = model ? usage_model_index(model) : -1;
+    if (model_slot < 0) model_slot = USAGE_MODEL_COUNT;
+    if (tool < 0 || tool > TOOL_COUNT) tool = TOOL_COUNT;
+
+    int64_t now = (int64_t)time(NULL);
+    add_call(model_slot, tool, usage, to_nanos(cost), now);
+
+    if (journal_fd < 0 || __atomic_load_n(&journal_failed, __ATOMIC_RELAXED)) return;
+
+    // O_APPEND keeps each single-write record whole across threads
+    unsigned char rec[RECORD_SIZE];
+    encode_record(rec, model_slot, tool, usage, now);
+    ssize_t n;
+    do {
+        n = write(journal_fd, rec, RECORD_SIZE);
+    } while (n < 0 && errno == EINTR);
+
+    // After a short write later records would be misaligned; stop appending
+    // and let the next startup drop the partial tail
+    if (n != RECORD_SIZE && !__atomic_exchange_n(&journal_failed, 1, __ATOMIC_RELAXED)) {
+        (void)fprintf(stderr, "Warning: cost ledger append failed (%s), spend is no longer persisted\n",
+                      n < 0 ? strerror(errno) : "short write");
+    }
+}
+
+static void append_totals(Buffer *out, const LedgerTotals *totals) {
+    buffer_append_printf(out,
+                         "\"calls\":%llu,\"prompt_tokens\":%llu,\"completion_tokens\":%llu,\"citation_tokens\":%llu,"
+                         "\"reasoning_tokens\":%llu,\"search_queries\":%llu,\"cost_usd\":%.6f",
+                         (unsigned long long)totals->calls, (unsigned long long)totals->prompt_tokens,
+                         (unsigned long long)totals->completion_tokens, (unsigned long long)totals->citation_tokens,
+                         (unsigned long long)totals->reasoning_tokens, (unsigned long long)totals->search_queries,
+                         totals_cost(totals));
+}
+
+int ledger_format_json(Buffer *out) {
+    LedgerTotals snapshot[MODEL_SLOTS][TOOL_SLOTS];
+    LedgerTotals total, by_tool[TOOL_SLOTS];
+    memset(&total, 0, sizeof(total));
+    memset(by_tool, 0, sizeof(by_tool));
+    for (int m = 0; m < MODEL_SLOTS; m++) {
+        for (int t = 0; t < TOOL_SLOTS; t++) {
+            snapshot_cell(m, t, &snapshot[m][t]);
+            totals_add(&total, &snapshot[m][t]);
+            totals_add(&by_tool[t], &snapshot[m][t]);
+        }
+    }
+
+    buffer_append_printf(out, "{\"since\":%lld,\"persisted\":%s,",
+                         (long long)__atomic_load_n(&since, __ATOMIC_RELAXED),
+                         journal_fd >= 0 && !__atomic_load_n(&journal_failed, __ATOMIC_RELAXED) ? "true" : "false");
+    append_totals(out, &total);
+
+    buffer_append_str(out, ",\"models\":{");
+    int first_model = 1;
+    for (int m = 0; m < MODEL_SLOTS; m++) {
+        LedgerTotals model_total;
+        memset(&model_total, 0, sizeof(model_total));
+        for (int t = 0; t < TOOL_SLOTS; t++) totals_add(&model_total, &snapshot[m][t]);
+        if (model_total.calls == 0) continue;
+
+        buffer_append_printf(out, "%s\"%s\":{", first_model ? "" : ",", model_label(m));
+        append_totals(out, &model_total);
+        buffer_append_str(out, ",\"tools\":{");
+        int first_tool = 1;
+        for (int t = 0; t < TOOL_SLOTS; t++) {
+            if (snapshot[m][t].calls == 0) continue;
+            buffer_append_printf(out, "%s\"%s\":{", first_tool ? "" : ",", tool_label(t));
+            append_totals(out, &snapshot[m][t]);
+            buffer_append_str(out, "}");
+            first_tool = 0;
+        }
+        buffer_append_str(out, "}}");
+        first_model = 0;
+    }
+
+    buffer_append_str(out, "},\"tools\":{");
+    int first_tool = 1;
+    for (int t = 0; t < TOOL_SLOTS; t++) {
+        if (by_tool[t].calls == 0) continue;
+        buffer_append_printf(out, "%s\"%s\":{", first_tool ? "" : ",", tool_label(t));
+        append_totals(out, &by_tool[t]);
+        buffer_append_str(out, "}");
+        first_tool = 0;
+    }
+    return buffer_append_str(out, "}}");
+}
+
+void ledger_log_summary(void) {
+    LedgerTotals total;
+    memset(&total, 0, sizeof(total));
+    for (int m = 0; m < MODEL_SLOTS; m++) {
+        LedgerTotals model_total;
+        memset(&model_total, 0, sizeof(model_total));
+        for (int t = 0; t < TOOL_SLOTS; t++) {
+            LedgerTotals cell;
+            snapshot_cell(m, t, &cell);
+            totals_add(&model_total, &cell);
+        }
+        if (model_total.calls == 0) continue;
+        totals_add(&total, &model_total);
+        (void)fprintf(stderr, "Spend %s: %llu calls, %llu tokens in, %llu out, %llu searches, $%.4f\n",
+                      model_label(m), (unsigned long long)model_total.calls,
+                      (unsigned long long)model_total.prompt_tokens, (unsigned long long)model_total.completion_tokens,
+                      (unsigned long long)model_total.search_queries, totals_cost(&model_total));
+    }
+    if (total.calls > 0) {
+        (void)fprintf(stderr, "Spend total: %llu calls, $%.4f\n", (unsigned long long)total.calls, totals_cost(&total));
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef LEDGER_H
+#define LEDGER_H
+
+#include "buffer.h"
+#include "../include/usage.h"
+
+// Cost ledger: running spend per model and tool in atomic counters. With
+// PERPLEXITY_LEDGER_FILE set every billed call is also appended to a
+// compact binary journal, which is replayed on startup so totals survive
+// restarts. Costs are always derived from the pricing table in usage.c.
+
+// Replay the journal (if configured) and open it for appends
+int ledger_init(void);
+void ledger_shutdown(void);
+
+// Ledger slot for a tool name; unknown names share one "other" slot
+int ledger_tool_index(const char *tool_name);
+
+// Add one billed call. cost may be NULL for models without pricing.
+void ledger_record(const char *model, int tool, const UsageInfo *usage, const CostInfo *cost);
+
+// Totals as JSON (the perplexity_stats tool)
+int ledger_format_json(Buffer *out);
+
+// Per-model spend lines for the shutdown log
+void ledger_log_summary(void);
+
+#endif
@@ -2,11 +2,34 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <curl/curl.h>
 #include "mcp_protocol.h"
 #include "http_client.h"
+#include "worker_pool.h"
+#include "event_loop.h"
+#include "response_cache.h"
+#include "singleflight.h"
+#include "stdin_reader.h"
+#include "arena.h"
+#include "metrics.h"
+#include "ledger.h"
+#include "admission.h"
+#include "registry.h"
+#include "models/query_classifier.h"
 #include "../include/constants.h"
 
+// Worker count from PERPLEXITY_MCP_WORKERS, clamped to a sane range
+static int get_worker_count(void) {
+    const char *env = getenv("PERPLEXITY_MCP_WORKERS");
+    if (!env || !*env) return DEFAULT_WORKER_THREADS;
+
+    int count = atoi(env);
+    if (count < 1) return 1;
+    if (count > MAX_WORKER_THREADS) return MAX_WORKER_THREADS;
+    return count;
+}
+
 int main() {
     // Initialize API key
     char *api_key = get_api_key();
@@ -15,25 +38,90 @@ int main() {
         return 1;
     }
 
+    // cJSON allocates from the per-request arena of the calling thread
+    arena_install_cjson_hooks();
+
+    // Name lookups and the initialize/tools/list payloads, built once
+    if (registry_init() != 0) {
+        return 1;
+    }
+
+    // kill -USR1 dumps latency metrics to stderr; must precede other threads
+    if (metrics_start_signal_dump() != 0) {
+        (void)fprintf(stderr, "Warning: SIGUSR1 metrics dump unavailable\n");
+    }
+
     // Initialize curl
     curl_global_init(CURL_GLOBAL_DEFAULT);
+    if (http_client_init() != 0) {
+        (void)fprintf(stderr, "Warning: shared connection cache unavailable\n");
+    }
 
     (void)fprintf(stderr, "Perplexity MCP Server v%s with Intelligent Model Routing\n", SERVER_VERSION);
     (void)fprintf(stderr, "Tools: ask (fast), research (smart), reason (detailed), deep_research (forced)\n");
 
-    char buffer[MAX_LINE_SIZE];
-    while (fgets(buffer, sizeof(buffer), stdin)) {
-        // Remove newline character
-        size_t len = strlen(buffer);
-        if (len > 0 && buffer[len-1] == '\n') {
-            buffer[len-1] = '\0';
-        }
+    response_cache_init();
+    ledger_init();
+    admission_init();
+    query_classifier_init();
+
+    // All HTTP transfers and deep research poll timers run on one event loop thread
+    if (event_loop_start() != 0) {
+        (void)fprintf(stderr, "Warning: event loop unavailable, transfers will block their worker\n");
+    }
+
+    // tools/call is parsed and answered on the pool, but no worker waits for
+    // its transfers; initialize and tools/list stay on this thread
+    int workers = get_worker_count();
+    if (worker_pool_start(workers) != 0) {
+        (void)fprintf(stderr, "Warning: worker pool unavailable, tool calls will run inline\n");
+    } else {
+        (void)fprintf(stderr, "Worker pool: %d threads\n", workers);
+    }
 
-        if (strlen(buffer) > 0) {
-            process_request(buffer);
+    // Requests are newline-delimited and may be arbitrarily large (long
+    // message histories); each line is parsed in place from the read buffer
+    LineReader reader;
+    if (line_reader_init(&reader, STDIN_FILENO, MAX_REQUEST_SIZE) != 0) {
+        (void)fprintf(stderr, "Error: cannot allocate request buffer\n");
+        return 1;
+    }
+
+    char *line;
+    size_t len;
+    while ((line = line_reader_next(&reader, &len)) != NULL) {
+        if (reader.dropped) {
+            // The id is somewhere in the discarded bytes
+            Responder to = {"null", NULL};
+            send_error(&to, JSONRPC_INVALID_REQUEST, reader.dropped);
+        } else if (len > 0) {
+            process_request(line);
         }
     }
+    line_reader_free(&reader);
+
+    // Let in-flight tool calls finish and flush their responses; the pool
+    // waits for calls still on the event loop, so it stops first
+    worker_pool_shutdown();
+    event_loop_stop();
+
+    metrics_stop_signal_dump();
+    metrics_log_summary();
+    ledger_log_summary();
+    admission_log_summary();
+    http_client_log_stats();
+    response_cache_log_stats();
+    (void)fprintf(stderr, "Coalesced duplicate in-flight calls: %lu\n", singleflight_coalesced_count());
 
+    ArenaStats arena_stats;
+    arena_get_stats(&arena_stats);
+    (void)fprintf(stderr, "Request arenas: %lu requests, %lu chunk allocations, peak %zu bytes per request\n",
+                  arena_stats.requests, arena_stats.chunk_mallocs, arena_stats.peak_bytes);
+    arena_pool_cleanup();
+    query_classifier_free();
+    response_cache_shutdown();
+    ledger_shutdown();
+    http_client_cleanup();
     curl_global_cleanup();
     return 0;
 }
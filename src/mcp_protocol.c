@@ -1,204 +1,464 @@
 #include "mcp_protocol.h"
 #include "json_utils.h"
 #include "models/model_router.h"
-#include "../include/constants.h"
+#include "models/async_models.h"
+#include "models/model_stats.h"
+#include "worker_pool.h"
+#include "arena.h"
+#include "metrics.h"
+#include "ledger.h"
+#include "admission.h"
+#include "buffer.h"
+#include "cancel.h"
+#include "batch.h"
+#include "json_scan.h"
+#include "registry.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <cjson/cJSON.h>
 
+// A tools/call in progress. It owns the parsed request, its id and the
+// arena they live in, and releases them when the response is written: on
+// whichever thread the call finishes, as no thread waits for it.
+typedef struct {
+    char *id;               // Raw JSON id
+    ResponseBatch *batch;   // Batch array the call came in, if any
+    const ToolDescriptor *tool;
+    const cJSON *arguments;
+    char *progress_token;
+    cJSON *request;
+    Arena *arena;
+    long long queued_us;
+    long long started_us;
+    MessageArray *msg_array;
+    RequestContext ctx;
+    CancelToken cancel;     // Registered under id while queued and running
+} ToolCallTask;
 
-// Handle initialize request
-void handle_initialize(int id) {
-    cJSON *root = cJSON_CreateObject();
-    cJSON_AddStringToObject(root, "jsonrpc", "2.0");
-    cJSON_AddNumberToObject(root, "id", id);
 
-    cJSON *result = cJSON_CreateObject();
-    cJSON_AddStringToObject(result, "protocolVersion", PROTOCOL_VERSION);
+// Handle initialize request; the result is serialized once at startup
+void handle_initialize(const Responder *to) {
+    size_t len = 0;
+    const char *result = registry_initialize_result(&len);
+    if (result) {
+        send_result_json(to, result, len);
+    } else {
+        send_response(to, NULL, 1, "Server registry unavailable");
+    }
+}
 
-    // capabilities
-    cJSON *capabilities = cJSON_CreateObject();
-    cJSON *tools = cJSON_CreateObject();
-    cJSON_AddBoolToObject(tools, "listChanged", 1);
-    cJSON_AddItemToObject(capabilities, "tools", tools);
-    cJSON_AddItemToObject(result, "capabilities", capabilities);
+// Handle tools/list request
+void handle_tools_list(const Responder *to) {
+    size_t len = 0;
+    const char *result = registry_tools_list_result(&len);
+    if (result) {
+        send_result_json(to, result, len);
+    } else {
+        send_response(to, NULL, 1, "Server registry unavailable");
+    }
+}
 
-    // server info
-    cJSON *server_info = cJSON_CreateObject();
-    cJSON_AddStringToObject(server_info, "name", SERVER_NAME);
-    cJSON_AddStringToObject(server_info, "version", SERVER_VERSION);
-    cJSON_AddItemToObject(result, "serverInfo", server_info);
+// Handle perplexity_stats
+static int handle_stats_tool(const Responder *to) {
+    Buffer out;
+    buffer_init(&out);
+    int ok = buffer_append_str(&out, "{\"latency\":") == 0 && metrics_format_json(&out) == 0 &&
+             buffer_append_str(&out, ",\"spend\":") == 0 && ledger_format_json(&out) == 0 &&
+             buffer_append_str(&out, ",\"routing\":") == 0 && model_stats_format_json(&out) == 0 &&
+             buffer_append_str(&out, ",\"admission\":") == 0 && admission_format_json(&out) == 0 &&
+             buffer_append_str(&out, "}") == 0;
+    if (ok) {
+        send_response(to, out.data, 0, NULL);
+    } else {
+        send_response(to, NULL, 1, "Not enough memory for stats");
+    }
+    buffer_free(&out);
+    return ok;
+}
 
-    cJSON_AddStringToObject(result, "instructions", "Perplexity MCP Server with intelligent model routing: Ask (fast), Research (smart async), Reason (detailed)");
+void init_request_context(RequestContext *ctx, const ToolDescriptor *tool, const cJSON *arguments,
+                          const char *progress_token, CancelToken *cancel) {
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->force_async = tool->id == TOOL_DEEP_RESEARCH;
+    ctx->background = cJSON_IsTrue(cJSON_GetObjectItem(arguments, "background"));
+    ctx->bypass_cache = cJSON_IsFalse(cJSON_GetObjectItem(arguments, "cache"));
+    ctx->progress_token = progress_token;
+    ctx->tool_name = tool->name;
+    ctx->cancel = cancel;
+    cJSON *max_cost = cJSON_GetObjectItem(arguments, "max_cost_usd");
+    ctx->deadline_ms = parse_deadline_ms(arguments);
+    if (cJSON_IsNumber(max_cost) && max_cost->valuedouble > 0) ctx->max_cost_usd = max_cost->valuedouble;
+    cJSON *hedge = cJSON_GetObjectItem(arguments, "hedge");
+    if (cJSON_IsBool(hedge)) ctx->hedge = cJSON_IsTrue(hedge) ? 1 : -1;
+}
 
-    cJSON_AddItemToObject(root, "result", result);
+// Release everything the call owns once its response is out
+static void finish_tool_call(ToolCallTask *task, int ok) {
+    metrics_record_tool_call(task->tool->name, metrics_now_us() - task->started_us, ok);
+    cancel_unregister(&task->cancel);
+    cJSON_free(task->progress_token);
+    cJSON_free(task->id);
+    cJSON_Delete(task->request);
+    arena_release(task->arena);
+    free(task);
+    worker_pool_release();
+}
 
-    char *output = cJSON_Print(root);
-    printf("%s\n", output);
-    (void)fflush(stdout);
+// Routed call answered; a call cancelled by the client gets no response
+// (MCP cancellation)
+static void tool_call_done(char *result, void *userdata) {
+    ToolCallTask *task = (ToolCallTask *)userdata;
+    Responder to = {task->id, task->batch};
+    int ok = 0;
+    free_message_array(task->msg_array);
 
-    free(output);
-    cJSON_Delete(root);
+    if (cancel_token_cancelled(&task->cancel)) {
+        (void)fprintf(stderr, "Dropped cancelled %s call %s\n", task->tool->name, to.id);
+        send_no_response(&to);
+        free(result);
+    } else if (result) {
+        send_response(&to, result, 0, NULL);
+        free(result);
+        ok = 1;
+    } else if (cancel_token_expired(&task->cancel)) {
+        send_response(&to, NULL, 1, "Deadline exceeded before Perplexity API answered");
+    } else {
+        send_response(&to, NULL, 1, task->ctx.error ? task->ctx.error : "Failed to get response from Perplexity API");
+    }
+    finish_tool_call(task, ok);
 }
 
-// Handle tools/list request
-void handle_tools_list(int id) {
-    cJSON *root = cJSON_CreateObject();
-    cJSON_AddStringToObject(root, "jsonrpc", "2.0");
-    cJSON_AddNumberToObject(root, "id", id);
-
-    cJSON *result = cJSON_CreateObject();
-    cJSON *tools_arr = cJSON_CreateArray();
-
-    // Tool: perplexity_ask
-    cJSON *tool1 = cJSON_CreateObject();
-    cJSON_AddStringToObject(tool1, "name", "perplexity_ask");
-    cJSON_AddStringToObject(tool1, "description", "Fast search and Q&A using Sonar Pro model with real-time web search and citations");
-    cJSON *input_schema1 = cJSON_CreateObject();
-    cJSON_AddStringToObject(input_schema1, "type", "object");
-    cJSON *props1 = cJSON_CreateObject();
-    cJSON *msgs_prop1 = cJSON_CreateObject();
-    cJSON_AddStringToObject(msgs_prop1, "type", "array");
-    cJSON_AddItemToObject(props1, "messages", msgs_prop1);
-    cJSON_AddItemToObject(input_schema1, "properties", props1);
-    cJSON *required1 = cJSON_CreateArray();
-    cJSON_AddItemToArray(required1, cJSON_CreateString("messages"));
-    cJSON_AddItemToObject(input_schema1, "required", required1);
-    cJSON_AddItemToObject(tool1, "inputSchema", input_schema1);
-    cJSON_AddItemToArray(tools_arr, tool1);
-
-    // Tool: perplexity_research
-    cJSON *tool2 = cJSON_CreateObject();
-    cJSON_AddStringToObject(tool2, "name", "perplexity_research");
-    cJSON_AddStringToObject(tool2, "description", "Comprehensive research and analysis with intelligent routing - uses fast models for simple queries, deep research for complex topics (auto-detects complexity)");
-    cJSON *input_schema2 = cJSON_CreateObject();
-    cJSON_AddStringToObject(input_schema2, "type", "object");
-    cJSON *props2 = cJSON_CreateObject();
-    cJSON *msgs_prop2 = cJSON_CreateObject();
-    cJSON_AddStringToObject(msgs_prop2, "type", "array");
-    cJSON_AddItemToObject(props2, "messages", msgs_prop2);
-    cJSON_AddItemToObject(input_schema2, "properties", props2);
-    cJSON *required2 = cJSON_CreateArray();
-    cJSON_AddItemToArray(required2, cJSON_CreateString("messages"));
-    cJSON_AddItemToObject(input_schema2, "required", required2);
-    cJSON_AddItemToObject(tool2, "inputSchema", input_schema2);
-    cJSON_AddItemToArray(tools_arr, tool2);
-
-    // Tool: perplexity_reason
-    cJSON *tool3 = cJSON_CreateObject();
-    cJSON_AddStringToObject(tool3, "name", "perplexity_reason");
-    cJSON_AddStringToObject(tool3, "description", "Advanced reasoning and multi-step analysis using Sonar Reasoning Pro with chain-of-thought processing");
-    cJSON *input_schema3 = cJSON_CreateObject();
-    cJSON_AddStringToObject(input_schema3, "type", "object");
-    cJSON *props3 = cJSON_CreateObject();
-    cJSON *msgs_prop3 = cJSON_CreateObject();
-    cJSON_AddStringToObject(msgs_prop3, "type", "array");
-    cJSON_AddItemToObject(props3, "messages", msgs_prop3);
-    cJSON_AddItemToObject(input_schema3, "properties", props3);
-    cJSON *required3 = cJSON_CreateArray();
-    cJSON_AddItemToArray(required3, cJSON_CreateString("messages"));
-    cJSON_AddItemToObject(input_schema3, "required", required3);
-    cJSON_AddItemToObject(tool3, "inputSchema", input_schema3);
-    cJSON_AddItemToArray(tools_arr, tool3);
-
-    // Tool: perplexity_deep_research (for forcing deep research)
-    cJSON *tool4 = cJSON_CreateObject();
-    cJSON_AddStringToObject(tool4, "name", "perplexity_deep_research");
-    cJSON_AddStringToObject(tool4, "description", "Force deep research analysis using Sonar Deep Research model for comprehensive reports (2-5 minutes, use only for complex research tasks)");
-    cJSON *input_schema4 = cJSON_CreateObject();
-    cJSON_AddStringToObject(input_schema4, "type", "object");
-    cJSON *props4 = cJSON_CreateObject();
-    cJSON *msgs_prop4 = cJSON_CreateObject();
-    cJSON_AddStringToObject(msgs_prop4, "type", "array");
-    cJSON_AddItemToObject(props4, "messages", msgs_prop4);
-    cJSON_AddItemToObject(input_schema4, "properties", props4);
-    cJSON *required4 = cJSON_CreateArray();
-    cJSON_AddItemToArray(required4, cJSON_CreateString("messages"));
-    cJSON_AddItemToObject(input_schema4, "required", required4);
-    cJSON_AddItemToObject(tool4, "inputSchema", input_schema4);
-    cJSON_AddItemToArray(tools_arr, tool4);
-
-    cJSON_AddItemToObject(result, "tools", tools_arr);
-    cJSON_AddItemToObject(root, "result", result);
-
-    char *output = cJSON_Print(root);
-    printf("%s\n", output);
-    (void)fflush(stdout);
-
-    free(output);
-    cJSON_Delete(root);
-}
-
-// Handle tools/call request
-void handle_tools_call(int id, const char *tool_name, const cJSON *arguments) {
-    cJSON *messages_json = cJSON_GetObjectItem(arguments, "messages");
-    if (!cJSON_IsArray(messages_json)) {
-        send_response(id, NULL, 1, "Missing or invalid 'messages' parameter");
-        return;
+// perplexity_research_status / perplexity_research_result answered
+static void research_tool_done(char *result, void *userdata) {
+    ToolCallTask *task = (ToolCallTask *)userdata;
+    Responder to = {task->id, task->batch};
+    int ok = 0;
+
+    if (cancel_token_cancelled(&task->cancel)) {
+        (void)fprintf(stderr, "Dropped cancelled %s call %s\n", task->tool->name, to.id);
+        send_no_response(&to);
+        free(result);
+    } else if (result) {
+        send_response(&to, result, 0, NULL);
+        free(result);
+        ok = 1;
+    } else if (cancel_token_expired(&task->cancel)) {
+        send_response(&to, NULL, 1, "Deadline exceeded before Perplexity API answered");
+    } else {
+        send_response(&to, NULL, 1, "Failed to get research status from Perplexity API");
     }
+    finish_tool_call(task, ok);
+}
 
-    MessageArray *msg_array = parse_messages(messages_json);
-    if (!msg_array) {
-        send_response(id, NULL, 1, "Failed to parse messages");
+// Look a job up by id; ids go into the poll URL, so only well-formed ones are
+static void start_research_job_tool(ToolCallTask *task) {
+    Responder to = {task->id, task->batch};
+    cJSON *request_id = cJSON_GetObjectItem(task->arguments, "request_id");
+    if (!cJSON_IsString(request_id) || request_id->valuestring[0] == '\0') {
+        send_response(&to, NULL, 1, "Missing or invalid 'request_id' parameter");
+        finish_tool_call(task, 0);
+        return;
+    }
+    if (!research_request_id_valid(request_id->valuestring)) {
+        send_response(&to, NULL, 1, "Invalid 'request_id' parameter");
+        finish_tool_call(task, 0);
         return;
     }
 
-    int force_async = (strcmp(tool_name, "perplexity_deep_research") == 0) ? 1 : 0;
-    char *result = route_and_execute(msg_array, tool_name, force_async);
+    if (task->tool->id == TOOL_RESEARCH_STATUS) {
+        get_deep_research_status(request_id->valuestring, &task->cancel, research_tool_done, task);
+    } else {
+        get_deep_research_result(request_id->valuestring, &task->cancel, research_tool_done, task);
+    }
+}
 
-    free_message_array(msg_array);
+// perplexity_batch answered; items fail one by one, inside the result
+static void batch_call_done(char *result, const char *error, void *userdata) {
+    ToolCallTask *task = (ToolCallTask *)userdata;
+    Responder to = {task->id, task->batch};
+    int ok = 0;
 
-    if (result) {
-        send_response(id, result, 0, NULL);
+    if (cancel_token_cancelled(&task->cancel)) {
+        (void)fprintf(stderr, "Dropped cancelled perplexity_batch call %s\n", to.id);
+        send_no_response(&to);
+        free(result);
+    } else if (result) {
+        send_response(&to, result, 0, NULL);
         free(result);
+        ok = 1;
     } else {
-        send_response(id, NULL, 1, "Failed to get response from Perplexity API");
+        send_response(&to, NULL, 1, error);
     }
+    finish_tool_call(task, ok);
 }
 
-// Main dispatcher
-void process_request(const char *line) {
-    cJSON *json = cJSON_Parse(line);
-    if (!json) {
-        (void)fprintf(stderr, "Invalid JSON input\n");
+// Start one tool call. Model calls are handed to the event loop with a
+// completion that writes the response, so the thread moves on at once.
+static void start_tool_call(ToolCallTask *task) {
+    Responder to = {task->id, task->batch};
+    const ToolDescriptor *tool = task->tool;
+    CancelToken *cancel = &task->cancel;
+    task->started_us = metrics_now_us();
+
+    if (cancel_token_cancelled(cancel)) {
+        (void)fprintf(stderr, "Skipping cancelled %s call %s\n", tool->name, to.id);
+        send_no_response(&to);
+        finish_tool_call(task, 0);
+        return;
+    }
+    if (cancel_token_expired(cancel)) {
+        send_response(&to, NULL, 1, "Deadline exceeded while queued");
+        finish_tool_call(task, 0);
         return;
     }
+    switch (tool->id) {
+    case TOOL_RESEARCH_STATUS:
+    case TOOL_RESEARCH_RESULT:
+        start_research_job_tool(task);
+        return;
+    case TOOL_STATS:
+        finish_tool_call(task, handle_stats_tool(&to));
+        return;
+    case TOOL_BATCH:
+        batch_execute(task->arguments, task->progress_token, cancel, batch_call_done, task);
+        return;
+    default:
+        break;
+    }
 
+    cJSON *messages_json = cJSON_GetObjectItem(task->arguments, "messages");
+    if (!cJSON_IsArray(messages_json)) {
+        send_response(&to, NULL, 1, "Missing or invalid 'messages' parameter");
+        finish_tool_call(task, 0);
+        return;
+    }
+
+    // The messages go in the request's arena. Nothing else may use it: the
+    // call finishes on whichever thread is free, and releases it there.
+    Arena *previous = arena_active();
+    arena_activate(task->arena);
+    task->msg_array = parse_messages(messages_json);
+    arena_activate(previous);
+    if (!task->msg_array) {
+        send_response(&to, NULL, 1, "Failed to parse messages");
+        finish_tool_call(task, 0);
+        return;
+    }
+
+    init_request_context(&task->ctx, tool, task->arguments, task->progress_token, cancel);
+    route_and_execute(task->msg_array, tool, &task->ctx, tool_call_done, task);
+}
+
+// Worker entry point for a queued tools/call
+static void run_tool_call_task(void *arg) {
+    ToolCallTask *task = (ToolCallTask *)arg;
+    metrics_record_queue_wait(task->tool->name, metrics_now_us() - task->queued_us);
+    start_tool_call(task);
+}
+
+// Hand a tools/call to the worker pool so request parsing and response
+// building don't block stdin. The call takes over the request, its id and
+// its arena, and 1 is returned; 0 means an error was sent instead.
+static int dispatch_tools_call(const Responder *to, cJSON *request, cJSON *params, const ToolDescriptor *tool,
+                               Arena *arena) {
+    ToolCallTask *task = malloc(sizeof(ToolCallTask));
+    if (!task) {
+        send_response(to, NULL, 1, "Not enough memory for request");
+        return 0;
+    }
+
+    // Clients opt into progress (and streaming) via params._meta.progressToken
+    char *progress_token = NULL;
+    cJSON *meta = cJSON_GetObjectItem(params, "_meta");
+    cJSON *token = cJSON_GetObjectItem(meta, "progressToken");
+    if (cJSON_IsString(token) || cJSON_IsNumber(token)) {
+        progress_token = cJSON_PrintUnformatted(token);
+    }
+    const cJSON *arguments = cJSON_GetObjectItem(params, "arguments");
+    long deadline_ms = parse_deadline_ms(arguments);
+
+    task->id = (char *)to->id;
+    task->batch = to->batch;
+    task->tool = tool;
+    task->arguments = arguments;
+    task->progress_token = progress_token;
+    task->request = request;
+    task->arena = arena;
+    task->queued_us = metrics_now_us();
+    task->msg_array = NULL;
+    // The deadline runs from receipt, so time spent queued counts
+    cancel_token_init(&task->cancel, task->id, deadline_ms);
+    cancel_register(&task->cancel);
+
+    // Shutdown waits for the call until its response is written. Stats are
+    // answered right away rather than queued behind other calls, and
+    // without a pool everything runs here. Nothing may touch the arena on
+    // this thread once the call is queued.
+    worker_pool_hold();
+    if ((tool->flags & TOOL_INLINE) || worker_pool_submit(run_tool_call_task, task) != 0) {
+        start_tool_call(task);
+    }
+    return 1;
+}
+
+// The raw JSON at p if it is a usable request id (a string or a number)
+static const char *scan_request_id(const char *p, const char *end, size_t *len) {
+    if (!p || (*p != '"' && *p != '-' && (*p < '0' || *p > '9'))) return NULL;
+    const char *after = json_scan_skip(p, end);
+    if (!after) return NULL;
+    *len = (size_t)(after - p);
+    return p;
+}
+
+// notifications/cancelled: abort the named in-flight call, if any. The id is
+// matched as raw JSON, the way the call registered it.
+static void handle_cancelled(const cJSON *params, const char *raw, const char *raw_end) {
+    size_t len = 0;
+    const char *raw_params = json_scan_member(raw, raw_end, "params");
+    const char *id = raw_params ? scan_request_id(json_scan_member(raw_params, raw_end, "requestId"), raw_end, &len) : NULL;
+    if (!id) return;
+
+    cJSON *reason = cJSON_GetObjectItem(params, "reason");
+    int found = cancel_request(id, len);
+    (void)fprintf(stderr, "Cancel request %.*s%s%s: %s\n", (int)len, id, cJSON_IsString(reason) ? " - " : "",
+                  cJSON_IsString(reason) ? reason->valuestring : "", found ? "aborting" : "not in flight");
+}
+
+// Handle one parsed request; raw is its text, for the id. Returns 1 if a
+// tools/call took ownership of it.
+static int dispatch_request(cJSON *json, const char *raw, const char *raw_end, Arena *arena,
+                            ResponseBatch *batch) {
     cJSON *method = cJSON_GetObjectItem(json, "method");
-    cJSON *id = cJSON_GetObjectItem(json, "id");
     cJSON *params = cJSON_GetObjectItem(json, "params");
+    int method_id = cJSON_IsString(method) ? registry_find_method(method->valuestring, strlen(method->valuestring)) : -1;
 
-    if (!cJSON_IsString(method) || !cJSON_IsNumber(id)) {
-        cJSON_Delete(json);
-        return;
+    // Notifications carry no id
+    if (method_id == METHOD_CANCELLED) {
+        handle_cancelled(params, raw, raw_end);
+        return 0;
     }
 
-    int req_id = (int)id->valuedouble;
+    size_t id_len = 0;
+    const char *raw_id = cJSON_IsObject(json) ? json_scan_member(raw, raw_end, "id") : NULL;
+    if (!raw_id && cJSON_IsObject(json)) {
+        return 0;
+    }
 
-    if (strcmp(method->valuestring, "initialize") == 0) {
-        handle_initialize(req_id);
-    } else if (strcmp(method->valuestring, "tools/list") == 0) {
-        handle_tools_list(req_id);
-    } else if (strcmp(method->valuestring, "tools/call") == 0) {
-        if (!cJSON_IsObject(params)) {
-            send_response(req_id, NULL, 1, "Missing parameters");
-            cJSON_Delete(json);
-            return;
-        }
+    Responder to = {"null", batch};
+    if (batch) response_batch_retain(batch);
+    if (!scan_request_id(raw_id, raw_end, &id_len) || !cJSON_IsString(method)) {
+        send_error(&to, JSONRPC_INVALID_REQUEST, "Invalid Request");
+        return 0;
+    }
+
+    // The id lives with the request; a tools/call that takes it frees it
+    char *id = cJSON_malloc(id_len + 1);
+    if (!id) {
+        send_error(&to, JSONRPC_INTERNAL_ERROR, "Not enough memory for request");
+        return 0;
+    }
+    memcpy(id, raw_id, id_len);
+    id[id_len] = '\0';
+    to.id = id;
 
+    int owned = 0;
+    switch (method_id) {
+    case METHOD_INITIALIZE:
+        handle_initialize(&to);
+        break;
+    case METHOD_TOOLS_LIST:
+        handle_tools_list(&to);
+        break;
+    case METHOD_TOOLS_CALL: {
         cJSON *tool_name = cJSON_GetObjectItem(params, "name");
         cJSON *arguments = cJSON_GetObjectItem(params, "arguments");
-        if (!cJSON_IsString(tool_name) || !cJSON_IsObject(arguments)) {
-            send_response(req_id, NULL, 1, "Invalid tool call parameters");
-            cJSON_Delete(json);
-            return;
+        const ToolDescriptor *tool = NULL;
+        if (!cJSON_IsObject(params)) {
+            send_response(&to, NULL, 1, "Missing parameters");
+        } else if (!cJSON_IsString(tool_name) || !cJSON_IsObject(arguments)) {
+            send_response(&to, NULL, 1, "Invalid tool call parameters");
+        } else if (!(tool = registry_find_tool(tool_name->valuestring, strlen(tool_name->valuestring)))) {
+            send_error(&to, JSONRPC_INVALID_PARAMS, "Unknown tool");
+        } else {
+            owned = dispatch_tools_call(&to, json, params, tool, arena);
         }
+        break;
+    }
+    default:
+        send_error(&to, JSONRPC_METHOD_NOT_FOUND, "Unknown method");
+        break;
+    }
+
+    if (!owned) cJSON_free(id);
+    return owned;
+}
+
+// Handle one message, alone or as an element of a batch array. Everything
+// cJSON allocates for it comes from one arena that is released in a single
+// reset after the response is written.
+static void process_message(const char *p, const char *end, ResponseBatch *batch) {
+    Arena *arena = arena_acquire();
+    arena_activate(arena);
 
-        handle_tools_call(req_id, tool_name->valuestring, arguments);
+    cJSON *json = cJSON_ParseWithLength(p, (size_t)(end - p));
+    if (!json) {
+        (void)fprintf(stderr, "Invalid JSON input\n");
+        Responder to = {"null", batch};
+        if (batch) response_batch_retain(batch);
+        send_error(&to, JSONRPC_PARSE_ERROR, "Parse error");
+    } else if (dispatch_request(json, p, end, arena, batch)) {
+        // A tools/call owns the request and its arena now
+        arena_activate(NULL);
+        return;
     } else {
-        send_response(req_id, NULL, 1, "Unknown method");
+        cJSON_Delete(json);
     }
 
-    cJSON_Delete(json);
+    arena_activate(NULL);
+    arena_release(arena);
+}
+
+// JSON-RPC batch: every element is dispatched like a request of its own, so
+// tool calls run in parallel on the worker pool, and the responses go out
+// together as one array once the last of them is in
+static void process_batch(const char *p, const char *end) {
+    Responder none = {"null", NULL};
+    JsonIter it;
+    if (!json_scan_skip(p, end) || !json_scan_array_begin(&it, p, end)) {
+        (void)fprintf(stderr, "Invalid JSON input\n");
+        send_error(&none, JSONRPC_PARSE_ERROR, "Parse error");
+        return;
+    }
+
+    ResponseBatch *batch = response_batch_create();
+    if (!batch) {
+        send_error(&none, JSONRPC_INTERNAL_ERROR, "Not enough memory for batch");
+        return;
+    }
+
+    int count = 0;
+    const char *value;
+    while (json_scan_array_next(&it, &value)) {
+        const char *value_end = json_scan_skip(value, end);
+        if (!value_end) break;
+        json_scan_iter_skip_to(&it, value_end);
+        process_message(value, value_end, batch);
+        count++;
+    }
+    if (count == 0) {
+        send_error(&none, JSONRPC_INVALID_REQUEST, "Invalid Request");
+    }
+    response_batch_release(batch);
+}
+
+// Main dispatcher
+void process_request(const char *line) {
+    const char *end = line + strlen(line);
+    const char *p = json_scan_ws(line, end);
+    if (p < end && *p == '[') {
+        process_batch(p, end);
+    } else {
+        process_message(line, end, NULL);
+    }
 }
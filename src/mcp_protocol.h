@@ -2,11 +2,18 @@
 #define MCP_PROTOCOL_H
 
 #include <cjson/cJSON.h>
+#include "cancel.h"
+#include "json_utils.h"
+#include "registry.h"
+#include "../include/types.h"
 
 // MCP protocol handlers
-void handle_initialize(int id);
-void handle_tools_list(int id);
-void handle_tools_call(int id, const char *tool_name, const cJSON *arguments);
+void handle_initialize(const Responder *to);
+void handle_tools_list(const Responder *to);
+
+// Call options from tools/call arguments
+void init_request_context(RequestContext *ctx, const ToolDescriptor *tool, const cJSON *arguments,
+                          const char *progress_token, CancelToken *cancel);
 
 // Main request processor
 void process_request(const char *line);
@@ -0,0 +1,315 @@
+#define GNU_SOURCE
+#include "metrics.h"
+#include "http_client.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+
+// Values below 2^SUB_BITS get exact buckets; above that every power of two
+// is split into 2^SUB_BITS linear sub-buckets. Values are microseconds (or
+// plain counts) and are clamped at 2^MAX_EXPONENT (about 25 days in us).
+#define SUB_BITS 4
+#define SUB_COUNT (1 << SUB_BITS)
+#define MAX_EXPONENT 41
+#define BUCKET_COUNT (SUB_COUNT + (MAX_EXPONENT - SUB_BITS) * SUB_COUNT)
+
+typedef struct {
+    uint64_t buckets[BUCKET_COUNT];
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+} Histogram;
+
+static const char *const TOOL_NAMES[] = {
+    "perplexity_ask", "perplexity_research", "perplexity_reason", "perplexity_deep_research",
+    "perplexity_research_status", "perplexity_research_result", "perplexity_stats", "perplexity_batch", "other",
+};
+#define TOOL_COUNT (int)(sizeof(TOOL_NAMES) / sizeof(TOOL_NAMES[0]))
+
+static const char *const MODEL_NAMES[] = {
+    "sonar-pro", "sonar-reasoning-pro", "sonar-deep-research", "other",
+};
+#define MODEL_COUNT (int)(sizeof(MODEL_NAMES) / sizeof(MODEL_NAMES[0]))
+
+typedef struct {
+    uint64_t errors;
+    Histogram latency;
+    Histogram queue_wait;
+} ToolMetrics;
+
+// Phases of one transfer, from CURLINFO_*_TIME_T. DNS, connect and TLS are
+// only recorded for transfers that opened a new connection.
+typedef struct {
+    uint64_t errors;        // curl failures and non-200 responses
+    Histogram total;
+    Histogram dns;
+    Histogram connect;
+    Histogram tls;
+    Histogram ttfb;         // Request sent to first response byte
+    Histogram transfer;     // First byte to last byte
+} ModelMetrics;
+
+typedef struct {
+    uint64_t outcomes[3];   // Indexed by MetricsJobOutcome
+    Histogram polls;
+    Histogram completion;   // Submit to final state
+} ResearchMetrics;
+
+static ToolMetrics tool_metrics[TOOL_COUNT];
+static ModelMetrics model_metrics[MODEL_COUNT];
+static ResearchMetrics research_metrics;
+static long long start_us = 0;
+
+static pthread_t dump_thread;
+static int dump_running = 0;
+static volatile int dump_stopping = 0;
+
+long long metrics_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static int lookup(const char *name, const char *const *names, int count) {
+    if (name) {
+        for (int i = 0; i < count - 1; i++) {
+            if (strcmp(name, names[i]) == 0) return i;
+        }
+    }
+    return count - 1;  // "other"
+}
+
+static int bucket_index(uint64_t value) {
+    if (value < SUB_COUNT) return (int)value;
+
+    int exponent = 63 - __builtin_clzll(value);
+    if (exponent >= MAX_EXPONENT) return BUCKET_COUNT - 1;
+    int shift = exponent - SUB_BITS;
+    return SUB_COUNT + shift * SUB_COUNT + (int)((value >> shift) - SUB_COUNT);
+}
+
+// Midpoint of a bucket, used as the reported value
+static double bucket_value(int index) {
+    if (index < SUB_COUNT) return (double)index;
+
+    int shift = (index - SUB_COUNT) / SUB_COUNT;
+    uint64_t lower = (uint64_t)(SUB_COUNT + (index - SUB_COUNT) % SUB_COUNT) << shift;
+    return (double)lower + (double)(1ULL << shift) / 2.0;
+}
+
+static void histogram_record(Histogram *hist, long long value) {
+    uint64_t v = value > 0 ? (uint64_t)value : 0;
+    __atomic_fetch_add(&hist->buckets[bucket_index(v)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hist->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hist->sum, v, __ATOMIC_RELAXED);
+
+    uint64_t max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+    while (v > max && !__atomic_compare_exchange_n(&hist->max, &max, v, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+// Copy of the buckets, so percentiles are computed from one consistent count
+typedef struct {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    double p50, p90, p99;
+} HistogramSummary;
+
+static void histogram_summarize(const Histogram *hist, HistogramSummary *summary) {
+    static const double PERCENTILES[] = {0.50, 0.90, 0.99};
+    double *targets[] = {&summary->p50, &summary->p90, &summary->p99};
+    uint64_t buckets[BUCKET_COUNT];
+    uint64_t count = 0;
+
+    for (int i = 0; i < BUCKET_COUNT; i++) {
+        buckets[i] = __atomic_load_n(&hist->buckets[i], __ATOMIC_RELAXED);
+        count += buckets[i];
+    }
+    memset(summary, 0, sizeof(*summary));
+    summary->count = count;
+    summary->sum = __atomic_load_n(&hist->sum, __ATOMIC_RELAXED);
+    summary->max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+    if (count == 0) return;
+
+    int p = 0;
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKET_COUNT && p < 3; i++) {
+        seen += buckets[i];
+        while (p < 3 && (double)seen >= PERCENTILES[p] * (double)count) {
+            double value = bucket_value(i);
+            *targets[p++] = value < (double)summary->max ? value : (double)summary->max;
+        }
+    }
+}
+
+void metrics_record_queue_wait(const char *tool_name, long long wait_us) {
+    histogram_record(&tool_metrics[lookup(tool_name, TOOL_NAMES, TOOL_COUNT)].queue_wait, wait_us);
+}
+
+void metrics_record_tool_call(const char *tool_name, long long elapsed_us, int ok) {
+    ToolMetrics *metrics = &tool_metrics[lookup(tool_name, TOOL_NAMES, TOOL_COUNT)];
+    histogram_record(&metrics->latency, elapsed_us);
+    if (!ok) __atomic_fetch_add(&metrics->errors, 1, __ATOMIC_RELAXED);
+}
+
+void metrics_record_transfer(const char *model, CURL *curl, CURLcode res) {
+    ModelMetrics *metrics = &model_metrics[lookup(model, MODEL_NAMES, MODEL_COUNT)];
+
+    long http_code = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+    if (res != CURLE_OK || http_code != 200) {
+        __atomic_fetch_add(&metrics->errors, 1, __ATOMIC_RELAXED);
+    }
+
+    curl_off_t dns = 0, connect = 0, tls = 0, pretransfer = 0, start = 0, total = 0;
+    long new_connections = 0;
+    curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME_T, &dns);
+    curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &connect);
+    curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME_T, &tls);
+    curl_easy_getinfo(curl, CURLINFO_PRETRANSFER_TIME_T, &pretransfer);
+    curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &start);
+    curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &total);
+    curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &new_connections);
+
+    histogram_record(&metrics->total, (long long)total);
+    if (new_connections > 0) {
+        histogram_record(&metrics->dns, (long long)dns);
+        histogram_record(&metrics->connect, (long long)(connect - dns));
+        if (tls > 0) histogram_record(&metrics->tls, (long long)(tls - connect));
+    }
+    if (start > 0) {
+        histogram_record(&metrics->ttfb, (long long)(start - pretransfer));
+        histogram_record(&metrics->transfer, (long long)(total - start));
+    }
+}
+
+void metrics_record_research_job(MetricsJobOutcome outcome, int polls, long long elapsed_us) {
+    __atomic_fetch_add(&research_metrics.outcomes[outcome], 1, __ATOMIC_RELAXED);
+    histogram_record(&research_metrics.polls, polls);
+    histogram_record(&research_metrics.completion, elapsed_us);
+}
+
+// "name":{"count":..,"mean":..,"p50":..} with values scaled by divisor
+static void append_histogram(Buffer *out, const char *name, const Histogram *hist, double divisor) {
+    HistogramSummary s;
+    histogram_summarize(hist, &s);
+    double mean = s.count > 0 ? (double)s.sum / (double)s.count : 0.0;
+    buffer_append_printf(out, "\"%s\":{\"count\":%llu,\"mean\":%.3f,\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f,\"max\":%.3f}",
+                         name, (unsigned long long)s.count, mean / divisor, s.p50 / divisor, s.p90 / divisor,
+                         s.p99 / divisor, (double)s.max / divisor);
+}
+
+int metrics_format_json(Buffer *out) {
+    if (start_us == 0) start_us = metrics_now_us();
+    buffer_append_printf(out, "{\"uptime_s\":%.1f,\"tools\":{", (double)(metrics_now_us() - start_us) / 1e6);
+
+    int first = 1;
+    for (int i = 0; i < TOOL_COUNT; i++) {
+        const ToolMetrics *m = &tool_metrics[i];
+        if (__atomic_load_n(&m->latency.count, __ATOMIC_RELAXED) == 0) continue;
+        buffer_append_printf(out, "%s\"%s\":{\"errors\":%llu,", first ? "" : ",", TOOL_NAMES[i],
+                             (unsigned long long)__atomic_load_n(&m->errors, __ATOMIC_RELAXED));
+        append_histogram(out, "latency_ms", &m->latency, 1000.0);
+        buffer_append_str(out, ",");
+        append_histogram(out, "queue_wait_ms", &m->queue_wait, 1000.0);
+        buffer_append_str(out, "}");
+        first = 0;
+    }
+
+    buffer_append_str(out, "},\"models\":{");
+    first = 1;
+    for (int i = 0; i < MODEL_COUNT; i++) {
+        const ModelMetrics *m = &model_metrics[i];
+        if (__atomic_load_n(&m->total.count, __ATOMIC_RELAXED) == 0) continue;
+        buffer_append_printf(out, "%s\"%s\":{\"errors\":%llu,", first ? "" : ",", MODEL_NAMES[i],
+                             (unsigned long long)__atomic_load_n(&m->errors, __ATOMIC_RELAXED));
+        append_histogram(out, "total_ms", &m->total, 1000.0);
+        buffer_append_str(out, ",");
+        append_histogram(out, "dns_ms", &m->dns, 1000.0);
+        buffer_append_str(out, ",");
+        append_histogram(out, "connect_ms", &m->connect, 1000.0);
+        buffer_append_str(out, ",");
+        append_histogram(out, "tls_ms", &m->tls, 1000.0);
+        buffer_append_str(out, ",");
+        append_histogram(out, "ttfb_ms", &m->ttfb, 1000.0);
+        buffer_append_str(out, ",");
+        append_histogram(out, "transfer_ms", &m->transfer, 1000.0);
+        buffer_append_str(out, "}");
+        first = 0;
+    }
+
+    buffer_append_printf(out, "},\"deep_research\":{\"completed\":%llu,\"failed\":%llu,\"timed_out\":%llu,",
+                         (unsigned long long)__atomic_load_n(&research_metrics.outcomes[METRICS_JOB_COMPLETED], __ATOMIC_RELAXED),
+                         (unsigned long long)__atomic_load_n(&research_metrics.outcomes[METRICS_JOB_FAILED], __ATOMIC_RELAXED),
+                         (unsigned long long)__atomic_load_n(&research_metrics.outcomes[METRICS_JOB_TIMED_OUT], __ATOMIC_RELAXED));
+    append_histogram(out, "polls", &research_metrics.polls, 1.0);
+    buffer_append_str(out, ",");
+    append_histogram(out, "time_to_completion_s", &research_metrics.completion, 1e6);
+
+    HTTPClientStats http;
+    http_client_get_stats(&http);
+    return buffer_append_printf(out, "},\"http\":{\"transfers\":%lu,\"new_connections\":%lu,\"handles_created\":%lu}}",
+                                http.transfers, http.new_connections, http.handles_created);
+}
+
+static void dump_metrics(void) {
+    Buffer out;
+    buffer_init(&out);
+    if (metrics_format_json(&out) == 0) {
+        (void)fprintf(stderr, "Metrics: %s\n", out.data);
+    }
+    buffer_free(&out);
+}
+
+static void *dump_thread_main(void *unused) {
+    (void)unused;
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+
+    for (;;) {
+        int sig = 0;
+        if (sigwait(&set, &sig) != 0) continue;
+        if (dump_stopping) break;
+        dump_metrics();
+    }
+    return NULL;
+}
+
+int metrics_start_signal_dump(void) {
+    if (start_us == 0) start_us = metrics_now_us();
+
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    if (pthread_sigmask(SIG_BLOCK, &set, NULL) != 0) return -1;
+
+    if (pthread_create(&dump_thread, NULL, dump_thread_main, NULL) != 0) return -1;
+    dump_running = 1;
+    return 0;
+}
+
+void metrics_stop_signal_dump(void) {
+    if (!dump_running) return;
+    dump_stopping = 1;
+    (void)pthread_kill(dump_thread, SIGUSR1);
+    (void)pthread_join(dump_thread, NULL);
+    dump_running = 0;
+}
+
+void metrics_log_summary(void) {
+    for (int i = 0; i < TOOL_COUNT; i++) {
+        HistogramSummary s;
+        histogram_summarize(&tool_metrics[i].latency, &s);
+        if (s.count == 0) continue;
+        (void)fprintf(stderr, "%s: %llu calls, %llu errors, latency p50 %.1f ms, p99 %.1f ms, max %.1f ms\n",
+                      TOOL_NAMES[i], (unsigned long long)s.count,
+                      (unsigned long long)__atomic_load_n(&tool_metrics[i].errors, __ATOMIC_RELAXED),
+                      s.p50 / 1000.0, s.p99 / 1000.0, (double)s.max / 1000.0);
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <curl/curl.h>
+#include "buffer.h"
+
+// In-process latency metrics. Histograms are log-linear (HDR-style, about
+// 6% bucket width) and updated with atomics, so recording never blocks.
+
+typedef enum {
+    METRICS_JOB_COMPLETED,
+    METRICS_JOB_FAILED,
+    METRICS_JOB_TIMED_OUT
+} MetricsJobOutcome;
+
+// Monotonic clock in microseconds
+long long metrics_now_us(void);
+
+// One tools/call: time spent queued for a worker, and handling time
+void metrics_record_queue_wait(const char *tool_name, long long wait_us);
+void metrics_record_tool_call(const char *tool_name, long long elapsed_us, int ok);
+
+// One finished upstream transfer for model, with curl's phase timings
+void metrics_record_transfer(const char *model, CURL *curl, CURLcode res);
+
+// One deep research job reaching a final state
+void metrics_record_research_job(MetricsJobOutcome outcome, int polls, long long elapsed_us);
+
+// Snapshot as JSON (the perplexity_stats tool and the SIGUSR1 dump)
+int metrics_format_json(Buffer *out);
+
+// SIGUSR1 dumps the snapshot to stderr. Start before any other thread so
+// they all inherit the blocked signal; only the dump thread receives it.
+int metrics_start_signal_dump(void);
+void metrics_stop_signal_dump(void);
+
+// Per-tool summary lines for the shutdown log
+void metrics_log_summary(void);
+
+#endif
@@ -1,207 +1,755 @@
 #define GNU_SOURCE
 #include "async_models.h"
 #include "../http_client.h"
-#include "../include/usage.h"
+#include "../event_loop.h"
+#include "../metrics.h"
+#include "../ledger.h"
+#include "../admission.h"
+#include "model_stats.h"
+#include "research_jobs.h"
+#include "../response_cache.h"
+#include "../response_decoder.h"
+#include "chat_payload.h"
+#include "../registry.h"
+#include "../worker_pool.h"
+#include "../../include/usage.h"
 #include "../../include/constants.h"
 #include <curl/curl.h>
-#include <cjson/cJSON.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <unistd.h>
 
-// Submit async request
-static char *submit_async_request(MessageArray *msg_array, const char *model) {
-    if (!msg_array || !model) return NULL;
+// Deep research polling schedule (about 3-4 minutes in total)
+#define DEEP_RESEARCH_INITIAL_POLL_INTERVAL 3
+#define DEEP_RESEARCH_MAX_POLL_INTERVAL 8
+#define DEEP_RESEARCH_MAX_POLLS 40
 
-    CURL *curl = curl_easy_init();
-    if (!curl) return NULL;
+// Per status poll
+#define POLL_TIMEOUT_MS 10000L
 
-    HTTPResponse *response = init_http_response();
-
-    // Build nested JSON payload for async API
-    cJSON *root = cJSON_CreateObject();
-    cJSON *request_obj = cJSON_CreateObject();
-    cJSON_AddStringToObject(request_obj, "model", model);
+#define PAST_DEADLINE_LEAD "Deep research did not finish before the deadline and continues in the background."
 
-    // Add reasoning_effort for deep research model
-    if (strcmp(model, "sonar-deep-research") == 0) {
-        cJSON_AddStringToObject(request_obj, "reasoning_effort", "medium");
-    }
+// Request ids are path segments of the poll URL; the API hands out UUIDs
+#define MAX_REQUEST_ID_LEN 128
+#define REQUEST_ID_CHARS "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789_-"
 
-    cJSON *messages_json = cJSON_CreateArray();
-    for (int i = 0; i < msg_array->count; i++) {
-        if (msg_array->messages[i].role && msg_array->messages[i].content) {
-            cJSON *msg_obj = cJSON_CreateObject();
-            cJSON_AddStringToObject(msg_obj, "role", msg_array->messages[i].role);
-            cJSON_AddStringToObject(msg_obj, "content", msg_array->messages[i].content);
-            cJSON_AddItemToArray(messages_json, msg_obj);
-        }
-    }
-    cJSON_AddItemToObject(request_obj, "messages", messages_json);
-    cJSON_AddItemToObject(root, "request", request_obj);
+int research_request_id_valid(const char *request_id) {
+    size_t len = strspn(request_id, REQUEST_ID_CHARS);
+    return len > 0 && len <= MAX_REQUEST_ID_LEN && request_id[len] == '\0';
+}
 
-    char *data = cJSON_Print(root);
+// Configure a leased handle for a status poll of request_id. Returns the
+// headers to free after the transfer, or NULL if the request can't be built.
+static struct curl_slist *setup_poll_request(CURL *curl, const char *request_id, HTTPResponse *response) {
+    // Escaped even when validated: the id must never leave its path segment
+    char *escaped = curl_easy_escape(curl, request_id, 0);
+    if (!escaped) return NULL;
+    char url[MAX_API_URL_SIZE + 256];
+    int len = snprintf(url, sizeof(url), "%s/%s", get_async_api_url(), escaped);
+    curl_free(escaped);
+    if (len < 0 || (size_t)len >= sizeof(url)) return NULL;
 
     struct curl_slist *headers = NULL;
     char auth_header[1024];
     (void)snprintf(auth_header, sizeof(auth_header), "Authorization: Bearer %s", get_api_key());
-
-    headers = curl_slist_append(headers, "Content-Type: application/json");
     headers = curl_slist_append(headers, auth_header);
+    if (!headers) return NULL;
 
-    curl_easy_setopt(curl, CURLOPT_URL, ASYNC_API_URL);
-    curl_easy_setopt(curl, CURLOPT_POST, 1L);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, data);
+    curl_easy_setopt(curl, CURLOPT_URL, url);
     curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)response);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 30L);
-    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
+    http_response_attach(curl, response);
+    http_client_set_deadline(curl, NULL, POLL_TIMEOUT_MS);
 
-    CURLcode res = curl_easy_perform(curl);
-    char *request_id = NULL;
+    return headers;
+}
 
-    if (res == CURLE_OK) {
-        long http_code = 0;
-        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
-        if (http_code == 200) {
-            cJSON *json_res = cJSON_Parse(response->memory);
-            if (json_res) {
-                cJSON *id = cJSON_GetObjectItem(json_res, "id");
-                if (cJSON_IsString(id)) {
-                    request_id = strdup(id->valuestring);
+// Interpret a status poll body. Returns the final text for COMPLETED/FAILED,
+// NULL while the request is still IN_PROGRESS or CREATED. Usage of a
+// finished job is billed to tool in the cost ledger; lookups of jobs this
+// process did not submit pass -1 so re-reads are not counted again.
+static char *parse_async_result(const char *body, size_t len, int tool, ResearchJobStatus *job_status,
+                                ResearchBill *bill) {
+    char *result = NULL;
+    *job_status = RESEARCH_JOB_IN_PROGRESS;
+    memset(bill, 0, sizeof(*bill));
+
+    // Status, report, citations and usage come out of one decoding pass
+    DecodedResponse decoded;
+    if (decode_response(body, len, &decoded) != 0 || !decoded.status) {
+        free_decoded_response(&decoded);
+        return NULL;
+    }
+
+    if (strcmp(decoded.status, "COMPLETED") == 0) {
+        result = take_content_with_citations(&decoded);
+        if (result) {
+            *job_status = RESEARCH_JOB_COMPLETED;
+        }
+
+        if (decoded.has_usage) {
+            CostInfo cost;
+            bill->usage = decoded.usage;
+            if (calculate_cost(&decoded.usage, "sonar-deep-research", &cost) == 0) {
+                bill->cost = cost.total_cost;
+                log_usage_and_cost("sonar-deep-research", &decoded.usage, &cost);
+                if (tool >= 0) {
+                    ledger_record("sonar-deep-research", tool, &decoded.usage, &cost);
+                    model_stats_record_usage("sonar-deep-research", &decoded.usage);
                 }
-                cJSON_Delete(json_res);
             }
+        }
+    } else if (strcmp(decoded.status, "FAILED") == 0) {
+        if (decoded.error_message) {
+            result = decoded.error_message;
+            decoded.error_message = NULL;
         } else {
-            (void)fprintf(stderr, "HTTP response code: %ld\n", http_code);
-            if (response->memory) {
-                (void)fprintf(stderr, "Response body: %s\n", response->memory);
-            }
+            result = strdup("Request failed with unknown error");
         }
-    } else {
-        (void)fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
+        *job_status = RESEARCH_JOB_FAILED;
     }
+    // For IN_PROGRESS or CREATED, return NULL to continue polling
+    free_decoded_response(&decoded);
 
-    free(data);
-    curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
-    cJSON_Delete(root);
-    free_http_response(response);
-
-    return request_id;
+    return result;
 }
 
-// Check async request status and get result
-static char *get_async_result(const char *request_id) {
-    if (!request_id) return NULL;
+// Poll request_id once (blocking, used without the event loop). Returns 0 when the API answered, with
+// *job_status NOT_FOUND on a 404, else the job's state and, once it
+// finished, its text in *result. Returns -1 when the status is unknown:
+// the poll failed, was throttled, or got any other reply.
+static int get_async_result(const char *request_id, int tool, ResearchJobStatus *job_status, char **result,
+                            ResearchBill *bill_out) {
+    *result = NULL;
+    if (bill_out) memset(bill_out, 0, sizeof(*bill_out));
 
-    CURL *curl = curl_easy_init();
-    if (!curl) return NULL;
+    CURL *curl = http_client_acquire();
+    if (!curl) return -1;
 
     HTTPResponse *response = init_http_response();
-    char url[512];
-    (void)snprintf(url, sizeof(url), "%s/%s", ASYNC_API_URL, request_id);
-
-    struct curl_slist *headers = NULL;
-    char auth_header[1024];
-    (void)snprintf(auth_header, sizeof(auth_header), "Authorization: Bearer %s", get_api_key());
-    headers = curl_slist_append(headers, auth_header);
-
-    curl_easy_setopt(curl, CURLOPT_URL, url);
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)response);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L);
+    struct curl_slist *headers = response ? setup_poll_request(curl, request_id, response) : NULL;
+    if (!headers) {
+        http_client_release(curl);
+        free_http_response(response);
+        return -1;
+    }
 
-    CURLcode res = curl_easy_perform(curl);
-    char *result = NULL;
+    AdmissionSpec admission = {"sonar-deep-research", ADMISSION_POLL, NULL, POLL_TIMEOUT_MS, response};
+    CURLcode res = CURLE_OK;
+    AdmissionResult admitted = admission_perform(curl, &admission, &res);
+    int status = -1;
+    ResearchBill bill;
 
-    if (res == CURLE_OK) {
+    if (admitted == ADMISSION_PERFORMED && res == CURLE_OK) {
         long http_code = 0;
         curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
         if (http_code == 200) {
-            cJSON *json_res = cJSON_Parse(response->memory);
-            if (json_res) {
-                cJSON *status = cJSON_GetObjectItem(json_res, "status");
-                if (cJSON_IsString(status)) {
-                    if (strcmp(status->valuestring, "COMPLETED") == 0) {
-                        cJSON *response_obj = cJSON_GetObjectItem(json_res, "response");
-                        if (response_obj) {
-                            cJSON *choices = cJSON_GetObjectItem(response_obj, "choices");
-                            if (cJSON_IsArray(choices) && cJSON_GetArraySize(choices) > 0) {
-                                cJSON *first = cJSON_GetArrayItem(choices, 0);
-                                cJSON *msg = cJSON_GetObjectItem(first, "message");
-                                cJSON *content = cJSON_GetObjectItem(msg, "content");
-                                if (cJSON_IsString(content)) {
-                                    result = strdup(content->valuestring);
-                                }
-                            }
-
-                            // NEW: Parse and log usage/cost for completed async requests
-                            UsageInfo *usage = parse_usage_from_response(response->memory);
-                            if (usage) {
-                                CostInfo *cost = calculate_cost(usage, "sonar-deep-research");
-                                if (cost) {
-                                    log_usage_and_cost("sonar-deep-research", usage, cost);
-                                    free_cost_info(cost);
-                                }
-                                free_usage_info(usage);
-                            }
-                        }
-                    } else if (strcmp(status->valuestring, "FAILED") == 0) {
-                        cJSON *error_msg = cJSON_GetObjectItem(json_res, "error_message");
-                        if (cJSON_IsString(error_msg)) {
-                            result = strdup(error_msg->valuestring);
-                        } else {
-                            result = strdup("Request failed with unknown error");
-                        }
-                    }
-                    // For IN_PROGRESS or CREATED, return NULL to continue polling
-                }
-                cJSON_Delete(json_res);
-            }
+            *result = parse_async_result(response->memory, response->size, tool, job_status, &bill);
+            if (bill_out) *bill_out = bill;
+            status = 0;
+        } else if (http_code == 404) {
+            *job_status = RESEARCH_JOB_NOT_FOUND;
+            status = 0;
         }
     }
 
     curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
+    http_client_release(curl);
     free_http_response(response);
 
-    return result;
+    return status;
 }
 
-char *execute_sonar_deep_research(MessageArray *msg_array) {
-    char *request_id = submit_async_request(msg_array, "sonar-deep-research");
-    if (!request_id) {
+// Next poll interval: exponential backoff up to 8 seconds (3, 4, 5, 6, 8, 8...)
+static int next_poll_interval(int poll_interval) {
+    if (poll_interval < DEEP_RESEARCH_MAX_POLL_INTERVAL) {
+        poll_interval = (poll_interval * 4) / 3;
+        if (poll_interval > DEEP_RESEARCH_MAX_POLL_INTERVAL) poll_interval = DEEP_RESEARCH_MAX_POLL_INTERVAL;
+    }
+    return poll_interval;
+}
+
+// Polling state for one deep research job, driven by event loop timers
+typedef struct {
+    ResearchJob *job;
+    char *request_id;
+    int poll_interval;     // Seconds until the next poll
+    int polls;             // Polls issued so far
+    int tool;              // Cost ledger slot of the tool that submitted the job
+    long long started_us;  // Submission time, for time-to-completion
+    CacheKey key;          // Model + history of the request
+    const char *cache_tool;  // Reports kept in the background are cached under key with this tool's TTL
+    CURL *curl;            // In-flight poll, NULL between polls
+    HTTPResponse *response;
+    struct curl_slist *headers;
+} ResearchPoll;
+
+static void schedule_poll(ResearchPoll *poll);
+
+// Map a final job status onto the metrics outcome
+static MetricsJobOutcome job_outcome(ResearchJobStatus status) {
+    if (status == RESEARCH_JOB_COMPLETED) return METRICS_JOB_COMPLETED;
+    if (status == RESEARCH_JOB_TIMED_OUT) return METRICS_JOB_TIMED_OUT;
+    return METRICS_JOB_FAILED;
+}
+
+// Publish the outcome to the job and drop the poller
+static void finish_poll(ResearchPoll *poll, ResearchJobStatus status, char *result, const ResearchBill *bill) {
+    metrics_record_research_job(job_outcome(status), poll->polls, metrics_now_us() - poll->started_us);
+    // Nobody waits for a background report, so a later identical call can hit the cache
+    if (status == RESEARCH_JOB_COMPLETED && result && research_job_is_background(poll->job)) {
+        response_cache_put(&poll->key, poll->cache_tool, result, bill ? bill->cost : 0.0);
+    }
+    research_job_finish(poll->job, status, result, bill);
+    free(poll->request_id);
+    free(poll);
+}
+
+// A poll transfer finished (event loop thread)
+static void poll_transfer_done(CURL *curl, CURLcode res, void *userdata) {
+    ResearchPoll *poll = (ResearchPoll *)userdata;
+    ResearchJobStatus status = RESEARCH_JOB_IN_PROGRESS;
+    char *result = NULL;
+    ResearchBill bill;
+
+    metrics_record_transfer("sonar-deep-research", curl, res);
+    long http_code = 0;
+    if (res == CURLE_OK) curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+    admission_record("sonar-deep-research", res, http_code);
+    if (res == CURLE_OK) {
+        if (http_code == 200) {
+            result = parse_async_result(poll->response->memory, poll->response->size, poll->tool, &status, &bill);
+        }
+    }
+
+    curl_slist_free_all(poll->headers);
+    http_client_release(curl);
+    free_http_response(poll->response);
+    poll->curl = NULL;
+    poll->headers = NULL;
+    poll->response = NULL;
+
+    if (result) {
+        finish_poll(poll, status, result, &bill);
+        return;
+    }
+
+    if (res == CURLE_ABORTED_BY_CALLBACK) {
+        finish_poll(poll, RESEARCH_JOB_FAILED, strdup("Research polling was aborted"), NULL);
+        return;
+    }
+
+    if (poll->polls >= DEEP_RESEARCH_MAX_POLLS) {
+        finish_poll(poll, RESEARCH_JOB_TIMED_OUT,
+                    strdup("Research request timed out. Try using perplexity_ask for simpler questions."), NULL);
+        return;
+    }
+
+    (void)fprintf(stderr, "Waiting for research completion %s... (%d/%d)\n",
+                  poll->request_id, poll->polls, DEEP_RESEARCH_MAX_POLLS);
+    poll->poll_interval = next_poll_interval(poll->poll_interval);
+    schedule_poll(poll);
+}
+
+// Poll timer fired: issue the status request (event loop thread)
+static void poll_timer_fired(void *userdata) {
+    ResearchPoll *poll = (ResearchPoll *)userdata;
+    // Every caller was cancelled: stop polling rather than finish a report nobody reads
+    if (research_job_drop_abandoned(poll->job)) {
+        (void)fprintf(stderr, "Stopped polling cancelled research %s\n", poll->request_id);
+        metrics_record_research_job(METRICS_JOB_FAILED, poll->polls, metrics_now_us() - poll->started_us);
+        free(poll->request_id);
+        free(poll);
+        return;
+    }
+    poll->polls++;
+    research_job_note_poll(poll->job);
+
+    // While the API is failing, skip this poll rather than add to the load
+    if (admission_try("sonar-deep-research") != 0) {
+        if (poll->polls >= DEEP_RESEARCH_MAX_POLLS) {
+            finish_poll(poll, RESEARCH_JOB_FAILED,
+                        strdup("Perplexity API is failing; research status unknown"), NULL);
+        } else {
+            poll->poll_interval = next_poll_interval(poll->poll_interval);
+            schedule_poll(poll);
+        }
+        return;
+    }
+
+    poll->curl = http_client_acquire();
+    if (!poll->curl) {
+        admission_withdraw("sonar-deep-research");
+        finish_poll(poll, RESEARCH_JOB_FAILED, strdup("Failed to start research status poll"), NULL);
+        return;
+    }
+
+    poll->response = init_http_response();
+    poll->headers = poll->response ? setup_poll_request(poll->curl, poll->request_id, poll->response) : NULL;
+
+    if (!poll->headers || event_loop_add_transfer(poll->curl, poll_transfer_done, poll) != 0) {
+        admission_withdraw("sonar-deep-research");
+        curl_slist_free_all(poll->headers);
+        http_client_release(poll->curl);
+        free_http_response(poll->response);
+        finish_poll(poll, RESEARCH_JOB_FAILED, strdup("Failed to start research status poll"), NULL);
+    }
+}
+
+static void schedule_poll(ResearchPoll *poll) {
+    if (event_loop_add_timer((long)poll->poll_interval * 1000L, poll_timer_fired, poll) != 0) {
+        finish_poll(poll, RESEARCH_JOB_FAILED, strdup("Failed to schedule research status poll"), NULL);
+    }
+}
+
+// Handle text for a job that keeps running after its call returned
+static char *format_job_handle(const char *lead, const char *request_id) {
+    char *handle = NULL;
+    if (asprintf(&handle,
+                 "%s\n"
+                 "request_id: %s\n"
+                 "Check progress with perplexity_research_status and fetch the report with "
+                 "perplexity_research_result using this request_id.",
+                 lead, request_id) < 0) {
+        handle = NULL;
+    }
+    return handle;
+}
+
+// What a deep research call answers with
+typedef enum {
+    RESEARCH_WAIT,          // The report, or a job handle once the deadline passes
+    RESEARCH_HANDLE,        // A job handle as soon as the job is submitted (background=true)
+    RESEARCH_SUBMIT,        // The bare request_id (hedged research)
+    RESEARCH_AWAIT          // A background job's report, if it completes in time
+} ResearchMode;
+
+// One deep research call. No thread waits for it: the submit runs on the
+// event loop, and the job's waiter list wakes it when the report lands.
+typedef struct {
+    ResearchMode mode;
+    MessageArray *msg_array;
+    RequestContext *ctx;
+    CURL *curl;             // Submit transfer
+    HTTPResponse *response;
+    ChatPayload payload;
+    struct curl_slist *headers;
+    char *request_id;
+    ResearchJobStatus status;   // Outcome of the wait
+    char *result;
+    ResearchBill bill;
+    call_done_fn on_done;
+    void *userdata;
+} ResearchCall;
+
+static ResearchCall *new_research_call(ResearchMode mode, MessageArray *msg_array, RequestContext *ctx,
+                                       call_done_fn on_done, void *userdata) {
+    ResearchCall *call = calloc(1, sizeof(ResearchCall));
+    if (!call) {
+        on_done(NULL, userdata);
         return NULL;
     }
+    call->mode = mode;
+    call->msg_array = msg_array;
+    call->ctx = ctx;
+    call->status = RESEARCH_JOB_IN_PROGRESS;
+    call->on_done = on_done;
+    call->userdata = userdata;
+    return call;
+}
 
-    (void)fprintf(stderr, "Submitted async research request: %s\n", request_id);
+// Turn the outcome into the call's answer (worker thread)
+static void deliver_research(void *arg) {
+    ResearchCall *call = (ResearchCall *)arg;
+    RequestContext *ctx = call->ctx;
+    char *result = NULL;
 
-    // Reduced polling for better user experience
-    int poll_interval = 3; // Start with 3 seconds
-    int max_polls = 40;    // Maximum 40 polls (about 3-4 minutes)
+    switch (call->mode) {
+    case RESEARCH_WAIT:
+        result = call->result;
+        if (call->status == RESEARCH_JOB_IN_PROGRESS && !cancel_token_cancelled(ctx->cancel) && call->request_id) {
+            // Past the client's deadline; the job was moved to the background
+            free(result);
+            result = format_job_handle(PAST_DEADLINE_LEAD, call->request_id);
+        }
+        ctx->cost += call->bill.cost;
+        usage_add(&ctx->usage, &call->bill.usage);
+        ctx->complete = call->status == RESEARCH_JOB_COMPLETED;
+        break;
+    case RESEARCH_HANDLE:
+        if (call->request_id) result = format_job_handle("Deep research started in the background.", call->request_id);
+        break;
+    case RESEARCH_SUBMIT:
+        result = call->request_id;
+        call->request_id = NULL;
+        break;
+    case RESEARCH_AWAIT:
+        if (call->status != RESEARCH_JOB_COMPLETED) {
+            free(call->result);
+            break;
+        }
+        result = call->result;
+        ctx->cost += call->bill.cost;
+        usage_add(&ctx->usage, &call->bill.usage);
+        ctx->complete = 1;
+        break;
+    }
 
-    for (int i = 0; i < max_polls; i++) {
-        sleep(poll_interval);
-        char *result = get_async_result(request_id);
+    call_done_fn on_done = call->on_done;
+    void *userdata = call->userdata;
+    free(call->request_id);
+    free(call);
+    on_done(result, userdata);
+}
+
+// Answers are built on the pool, never on the event loop thread
+static void finish_research(ResearchCall *call) {
+    worker_pool_dispatch(deliver_research, call);
+}
+
+static void research_waited(ResearchJobStatus status, char *result, const ResearchBill *bill, void *userdata) {
+    ResearchCall *call = (ResearchCall *)userdata;
+    call->status = status;
+    call->result = result;
+    call->bill = *bill;
+    finish_research(call);
+}
+
+// Blocking poll loop for when the event loop is not running
+static void poll_until_complete(ResearchCall *call) {
+    int poll_interval = DEEP_RESEARCH_INITIAL_POLL_INTERVAL;
+    ResearchJobStatus status;
+    ResearchBill bill;
+    long long started = metrics_now_us();
+    RequestContext *ctx = call->ctx;
+
+    for (int i = 0; i < DEEP_RESEARCH_MAX_POLLS; i++) {
+        if (cancel_token_sleep(ctx->cancel, (long long)poll_interval * 1000LL)) {
+            // Still IN_PROGRESS: a job handle unless the call was cancelled
+            metrics_record_research_job(METRICS_JOB_FAILED, i, metrics_now_us() - started);
+            return;
+        }
+        char *result = NULL;
+        (void)get_async_result(call->request_id, ledger_tool_index(ctx->tool_name), &status, &result, &bill);
 
         if (result) {
-            free(request_id);
-            return result;
+            metrics_record_research_job(job_outcome(status), i + 1, metrics_now_us() - started);
+            call->status = status;
+            call->result = result;
+            call->bill = bill;
+            return;
         }
 
-        // Exponential backoff up to 8 seconds
-        if (poll_interval < 8) {
-            poll_interval = (poll_interval * 4) / 3; // 3, 4, 5, 6, 8, 8...
-            if (poll_interval > 8) poll_interval = 8;
+        poll_interval = next_poll_interval(poll_interval);
+        (void)fprintf(stderr, "Waiting for research completion... (%d/%d)\n", i + 1, DEEP_RESEARCH_MAX_POLLS);
+    }
+
+    metrics_record_research_job(METRICS_JOB_TIMED_OUT, DEEP_RESEARCH_MAX_POLLS, metrics_now_us() - started);
+    call->status = RESEARCH_JOB_TIMED_OUT;
+    call->result = strdup("Research request timed out. Try using perplexity_ask for simpler questions.");
+}
+
+// The job exists (submitted or joined): wait for it or answer right away
+static void research_job_ready(ResearchCall *call, ResearchJob *job) {
+    if (call->mode == RESEARCH_WAIT) {
+        research_job_wait(job, call->ctx->cancel, research_waited, call);
+    } else {
+        finish_research(call);
+    }
+}
+
+// Register a submitted request as a job polled on the event loop
+static void register_research_job(ResearchCall *call, const CacheKey *key) {
+    RequestContext *ctx = call->ctx;
+    int background = call->mode != RESEARCH_WAIT;
+    ResearchJob *job = research_job_create(call->request_id, background, key);
+    if (!job) {
+        ctx->error = "Not enough memory for research job";
+        free(call->request_id);
+        call->request_id = NULL;
+        finish_research(call);
+        return;
+    }
+
+    ResearchPoll *poll = calloc(1, sizeof(ResearchPoll));
+    if (!poll) {
+        research_job_finish(job, RESEARCH_JOB_FAILED, NULL, NULL);
+        ctx->error = "Not enough memory for research polling";
+        free(call->request_id);
+        call->request_id = NULL;
+        research_job_ready(call, job);
+        return;
+    }
+    poll->job = job;
+    poll->request_id = strdup(call->request_id);
+    poll->poll_interval = DEEP_RESEARCH_INITIAL_POLL_INTERVAL;
+    poll->tool = ledger_tool_index(ctx->tool_name);
+    poll->started_us = metrics_now_us();
+    poll->key = *key;
+    poll->cache_tool = ctx->force_async ? "perplexity_deep_research" : "perplexity_research";
+    schedule_poll(poll);
+
+    research_job_ready(call, job);
+}
+
+// Submit transfer settled (event loop thread, or this one without the loop)
+static void research_submitted(CURL *curl, AdmissionResult admitted, CURLcode res, void *userdata) {
+    ResearchCall *call = (ResearchCall *)userdata;
+    const char *model = registry_model(MODEL_SONAR_DEEP_RESEARCH)->name;
+    long http_code = 0;
+
+    if (admitted != ADMISSION_PERFORMED) {
+        (void)fprintf(stderr, "%s submit not sent\n", model);
+    } else if (res == CURLE_OK) {
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+        if (http_code == 200) {
+            DecodedResponse decoded;
+            if (decode_response(call->response->memory, call->response->size, &decoded) == 0) {
+                call->request_id = decoded.id;
+                decoded.id = NULL;
+            }
+            free_decoded_response(&decoded);
+        } else {
+            (void)fprintf(stderr, "HTTP response code: %ld\n", http_code);
+            if (call->response->memory) {
+                (void)fprintf(stderr, "Response body: %s\n", call->response->memory);
+            }
+        }
+    } else {
+        (void)fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
+    }
+    if (!call->request_id) call->ctx->error = admission_error(admitted, res, http_code);
+
+    chat_payload_free(&call->payload);
+    curl_slist_free_all(call->headers);
+    http_client_release(call->curl);
+    free_http_response(call->response);
+    call->headers = NULL;
+    call->curl = NULL;
+    call->response = NULL;
+
+    if (!call->request_id) {
+        finish_research(call);
+        return;
+    }
+    (void)fprintf(stderr, "Submitted async research request: %s\n", call->request_id);
+
+    if (!event_loop_is_running()) {
+        // Only foreground calls get here without the loop; poll on this thread
+        poll_until_complete(call);
+        finish_research(call);
+        return;
+    }
+    CacheKey key;
+    cache_key_compute(&key, model, call->msg_array);
+    register_research_job(call, &key);
+}
+
+// Submit the async request; research_submitted carries on
+static void submit_async_request(ResearchCall *call) {
+    const ModelDescriptor *descriptor = registry_model(MODEL_SONAR_DEEP_RESEARCH);
+    const char *model = descriptor->name;
+
+    call->curl = http_client_acquire();
+    call->response = init_http_response();
+
+    // Nested payload for the async API
+    ChatPayloadSpec spec = {model, call->msg_array, descriptor->reasoning_effort, 0, 1};
+    if (!call->curl || !call->response || chat_payload_init(&call->payload, &spec) != 0) {
+        research_submitted(call->curl, ADMISSION_PERFORMED, CURLE_OUT_OF_MEMORY, call);
+        return;
+    }
+
+    char auth_header[1024];
+    (void)snprintf(auth_header, sizeof(auth_header), "Authorization: Bearer %s", get_api_key());
+
+    call->headers = curl_slist_append(call->headers, "Content-Type: application/json");
+    call->headers = curl_slist_append(call->headers, auth_header);
+
+    curl_easy_setopt(call->curl, CURLOPT_URL, get_async_api_url());
+    chat_payload_attach(call->curl, &call->payload);
+    curl_easy_setopt(call->curl, CURLOPT_HTTPHEADER, call->headers);
+    http_response_attach(call->curl, call->response);
+    curl_easy_setopt(call->curl, CURLOPT_CONNECTTIMEOUT, 10L);
+
+    AdmissionSpec admission = {model, ADMISSION_REQUEST, call->ctx->cancel, descriptor->timeout_ms, call->response};
+    admission_submit(call->curl, &admission, research_submitted, call);
+}
+
+// Submit deep research and register a job polled on the event loop. An
+// identical request already in progress is joined instead of resubmitted.
+static void start_research_job(ResearchCall *call) {
+    CacheKey key;
+    cache_key_compute(&key, "sonar-deep-research", call->msg_array);
+
+    ResearchJob *job = research_job_attach(&key, call->mode != RESEARCH_WAIT, &call->request_id);
+    if (job) {
+        (void)fprintf(stderr, "Joining in-progress research request: %s\n",
+                      call->request_id ? call->request_id : "?");
+        research_job_ready(call, job);
+        return;
+    }
+    submit_async_request(call);
+}
+
+void execute_sonar_deep_research(MessageArray *msg_array, RequestContext *ctx, call_done_fn on_done,
+                                 void *userdata) {
+    ResearchCall *call = new_research_call(RESEARCH_WAIT, msg_array, ctx, on_done, userdata);
+    if (!call) return;
+
+    if (!event_loop_is_running()) {
+        submit_async_request(call);
+        return;
+    }
+    // Polls run as timers on the event loop; the job wakes this call when it finishes
+    start_research_job(call);
+}
+
+void start_sonar_deep_research(MessageArray *msg_array, RequestContext *ctx, call_done_fn on_done, void *userdata) {
+    if (!event_loop_is_running()) {
+        execute_sonar_deep_research(msg_array, ctx, on_done, userdata);
+        return;
+    }
+
+    ResearchCall *call = new_research_call(RESEARCH_HANDLE, msg_array, ctx, on_done, userdata);
+    if (call) start_research_job(call);
+}
+
+void submit_background_research(MessageArray *msg_array, RequestContext *ctx, call_done_fn on_submitted,
+                                void *userdata) {
+    if (!event_loop_is_running()) {
+        on_submitted(NULL, userdata);
+        return;
+    }
+
+    ResearchCall *call = new_research_call(RESEARCH_SUBMIT, msg_array, ctx, on_submitted, userdata);
+    if (call) start_research_job(call);
+}
+
+void await_background_research(const char *request_id, long long timeout_ms, RequestContext *ctx,
+                               call_done_fn on_done, void *userdata) {
+    ResearchCall *call = new_research_call(RESEARCH_AWAIT, NULL, ctx, on_done, userdata);
+    if (!call) return;
+
+    if (research_job_await(request_id, ctx->cancel, timeout_ms, research_waited, call) != 0) {
+        finish_research(call);
+    }
+}
+
+static char *format_status_line(const char *request_id, ResearchJobStatus status) {
+    char *text = NULL;
+    if (asprintf(&text, "request_id: %s\nstatus: %s", request_id, research_job_status_name(status)) < 0) {
+        text = NULL;
+    }
+    return text;
+}
+
+// Text of a tracked job for the status tool, or with want_result its report
+// once finished
+static char *tracked_job_text(const char *request_id, const ResearchJobInfo *info, int want_result) {
+    if (want_result && info->status != RESEARCH_JOB_IN_PROGRESS && info->result) {
+        return strdup(info->result);
+    }
+    char *text = NULL;
+    if (asprintf(&text, "request_id: %s\nstatus: %s\npolls: %d\nelapsed: %llds",
+                 request_id, research_job_status_name(info->status), info->polls, info->elapsed_ms / 1000) < 0) {
+        text = NULL;
+    }
+    return text;
+}
+
+// Lookup of a job this process is not tracking (e.g. submitted before a
+// restart): one poll through admission, answered from its completion
+typedef struct {
+    char *request_id;
+    int want_result;
+    CURL *curl;
+    HTTPResponse *response;
+    struct curl_slist *headers;
+    char *text;
+    const CancelToken *cancel;  // Aborts the poll; must outlive the lookup
+    call_done_fn on_done;
+    void *userdata;
+} StatusCall;
+
+static void deliver_status(void *arg) {
+    StatusCall *call = (StatusCall *)arg;
+    call_done_fn on_done = call->on_done;
+    void *userdata = call->userdata;
+    char *text = call->text;
+    free(call->request_id);
+    free(call);
+    on_done(text, userdata);
+}
+
+// The poll settled (event loop thread). Only a 404 means the job is
+// unknown; any other failure leaves the status unknown and the text NULL.
+static void status_polled(CURL *curl, AdmissionResult admitted, CURLcode res, void *userdata) {
+    StatusCall *call = (StatusCall *)userdata;
+
+    if (admitted == ADMISSION_PERFORMED && res == CURLE_OK) {
+        long http_code = 0;
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+        if (http_code == 200) {
+            ResearchJobStatus status;
+            ResearchBill bill;
+            char *result = parse_async_result(call->response->memory, call->response->size, -1, &status, &bill);
+            if (result && call->want_result) {
+                call->text = result;
+            } else {
+                free(result);
+                call->text = format_status_line(call->request_id, status);
+            }
+        } else if (http_code == 404) {
+            call->text = format_status_line(call->request_id, RESEARCH_JOB_NOT_FOUND);
         }
+    }
+
+    curl_slist_free_all(call->headers);
+    http_client_release(call->curl);
+    free_http_response(call->response);
+    worker_pool_dispatch(deliver_status, call);
+}
 
-        (void)fprintf(stderr, "Waiting for research completion... (%d/%d)\n", i + 1, max_polls);
+static void lookup_research_job(const char *request_id, int want_result, const CancelToken *cancel,
+                                call_done_fn on_done, void *userdata) {
+    ResearchJobInfo info;
+    if (research_job_lookup(request_id, &info) == 0) {
+        char *text = tracked_job_text(request_id, &info, want_result);
+        free(info.result);
+        on_done(text, userdata);
+        return;
+    }
+
+    StatusCall *call = calloc(1, sizeof(StatusCall));
+    if (!call) {
+        on_done(NULL, userdata);
+        return;
+    }
+    call->request_id = strdup(request_id);
+    call->want_result = want_result;
+    call->cancel = cancel;
+    call->on_done = on_done;
+    call->userdata = userdata;
+    call->curl = http_client_acquire();
+    call->response = init_http_response();
+    if (call->request_id && call->curl && call->response) {
+        call->headers = setup_poll_request(call->curl, request_id, call->response);
     }
+    if (!call->headers) {
+        status_polled(call->curl, ADMISSION_PERFORMED, CURLE_OUT_OF_MEMORY, call);
+        return;
+    }
+
+    AdmissionSpec admission = {"sonar-deep-research", ADMISSION_POLL, cancel, POLL_TIMEOUT_MS, call->response};
+    admission_submit(call->curl, &admission, status_polled, call);
+}
+
+void get_deep_research_status(const char *request_id, const CancelToken *cancel, call_done_fn on_done,
+                              void *userdata) {
+    lookup_research_job(request_id, 0, cancel, on_done, userdata);
+}
 
-    free(request_id);
-    return strdup("Research request timed out. Try using perplexity_ask for simpler questions.");
+void get_deep_research_result(const char *request_id, const CancelToken *cancel, call_done_fn on_done,
+                              void *userdata) {
+    lookup_research_job(request_id, 1, cancel, on_done, userdata);
 }
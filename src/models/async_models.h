@@ -2,7 +2,35 @@
 #define ASYNC_MODELS_H
 
 #include "../../include/types.h"
+#include "../cancel.h"
 
-char *execute_sonar_deep_research(MessageArray *msg_array);
+// Deep research calls answer through on_done (on a pool worker) instead of
+// waiting on a thread: execute delivers the report, or a job handle once the
+// deadline passes; start delivers a job handle as soon as the job is submitted.
+void execute_sonar_deep_research(MessageArray *msg_array, RequestContext *ctx, call_done_fn on_done,
+                                 void *userdata);
+void start_sonar_deep_research(MessageArray *msg_array, RequestContext *ctx, call_done_fn on_done, void *userdata);
+
+// Deep research as a background job (hedged research). Submit delivers the
+// request_id, or NULL without the event loop; await waits up to timeout_ms
+// and delivers the report once completed, else NULL.
+void submit_background_research(MessageArray *msg_array, RequestContext *ctx, call_done_fn on_submitted,
+                                void *userdata);
+void await_background_research(const char *request_id, long long timeout_ms, RequestContext *ctx,
+                               call_done_fn on_done, void *userdata);
+
+// Background job handles (perplexity_research_status / perplexity_research_result).
+// Ids from clients must pass research_request_id_valid (letters, digits, '_'
+// and '-') before they are looked up or polled.
+int research_request_id_valid(const char *request_id);
+
+// on_done gets the status text, or the report once finished for the result
+// tool; NULL when the API could not say or cancel expired first. Jobs this
+// process tracks answer on this thread, others after one poll on a pool
+// worker.
+void get_deep_research_status(const char *request_id, const CancelToken *cancel, call_done_fn on_done,
+                              void *userdata);
+void get_deep_research_result(const char *request_id, const CancelToken *cancel, call_done_fn on_done,
+                              void *userdata);
 
 #endif
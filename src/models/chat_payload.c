@@ -0,0 +1,174 @@
+#define GNU_SOURCE
+#include "chat_payload.h"
+#include "../json_escape.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Bodies above this are streamed instead of written into the buffer
+#define PAYLOAD_STREAM_THRESHOLD (256 * 1024)
+
+static void add_segment(ChatPayload *payload, const char *data, size_t len, int escaped) {
+    PayloadSegment *segment = &payload->segments[payload->count++];
+    segment->data = data;
+    segment->len = len;
+    segment->escaped = escaped;
+    payload->length += escaped ? json_escaped_length(data, len) + 2 : len;
+}
+
+#define ADD_LITERAL(payload, text) add_segment((payload), (text), sizeof(text) - 1, 0)
+#define ADD_STRING(payload, str) add_segment((payload), (str), strlen(str), 1)
+
+int chat_payload_init(ChatPayload *payload, const ChatPayloadSpec *spec) {
+    memset(payload, 0, sizeof(*payload));
+
+    // Per message: {"role": R ,"content": C } plus a separator
+    int max_segments = 12 + spec->messages->count * 6;
+    payload->segments = malloc(sizeof(PayloadSegment) * (size_t)max_segments);
+    if (!payload->segments) return -1;
+
+    if (spec->async_envelope) ADD_LITERAL(payload, "{\"request\":");
+    ADD_LITERAL(payload, "{\"model\":");
+    ADD_STRING(payload, spec->model);
+    if (spec->reasoning_effort) {
+        ADD_LITERAL(payload, ",\"reasoning_effort\":");
+        ADD_STRING(payload, spec->reasoning_effort);
+    }
+
+    ADD_LITERAL(payload, ",\"messages\":[");
+    int first = 1;
+    for (int i = 0; i < spec->messages->count; i++) {
+        const ChatMessage *msg = &spec->messages->messages[i];
+        if (!msg->role || !msg->content) continue;
+
+        if (first) {
+            ADD_LITERAL(payload, "{\"role\":");
+            first = 0;
+        } else {
+            ADD_LITERAL(payload, ",{\"role\":");
+        }
+        ADD_STRING(payload, msg->role);
+        ADD_LITERAL(payload, ",\"content\":");
+        ADD_STRING(payload, msg->content);
+        ADD_LITERAL(payload, "}");
+    }
+    ADD_LITERAL(payload, "]");
+
+    if (spec->stream) ADD_LITERAL(payload, ",\"stream\":true");
+    ADD_LITERAL(payload, "}");
+    if (spec->async_envelope) ADD_LITERAL(payload, "}");
+
+    return 0;
+}
+
+void chat_payload_rewind(ChatPayload *payload) {
+    payload->index = 0;
+    payload->offset = 0;
+    payload->phase = 0;
+    payload->pending_len = 0;
+    payload->pending_pos = 0;
+}
+
+// Copy up to size bytes of the body into dest; returns 0 at the end
+size_t chat_payload_read(ChatPayload *payload, char *dest, size_t size) {
+    size_t written = 0;
+
+    while (written < size) {
+        // Finish an escape sequence split across reads
+        if (payload->pending_pos < payload->pending_len) {
+            size_t n = payload->pending_len - payload->pending_pos;
+            if (n > size - written) n = size - written;
+            memcpy(dest + written, payload->pending + payload->pending_pos, n);
+            payload->pending_pos += n;
+            written += n;
+            continue;
+        }
+
+        if (payload->index >= payload->count) break;
+        const PayloadSegment *segment = &payload->segments[payload->index];
+
+        if (!segment->escaped) {
+            size_t n = segment->len - payload->offset;
+            if (n > size - written) n = size - written;
+            memcpy(dest + written, segment->data + payload->offset, n);
+            payload->offset += n;
+            written += n;
+        } else if (payload->phase == 0) {
+            dest[written++] = '"';
+            payload->phase = 1;
+            continue;
+        } else if (payload->phase == 1) {
+            const char *src = segment->data + payload->offset;
+            size_t remaining = segment->len - payload->offset;
+            size_t room = size - written;
+
+            size_t run = json_escape_safe_run(src, remaining < room ? remaining : room);
+            memcpy(dest + written, src, run);
+            payload->offset += run;
+            written += run;
+
+            if (payload->offset < segment->len && written < size && run < room) {
+                payload->pending_len = json_escape_byte((unsigned char)segment->data[payload->offset],
+                                                        payload->pending);
+                payload->pending_pos = 0;
+                payload->offset++;
+                continue;
+            }
+            if (payload->offset == segment->len) payload->phase = 2;
+            continue;
+        } else {
+            dest[written++] = '"';
+            payload->offset = segment->len;
+        }
+
+        if (payload->offset == segment->len && (!segment->escaped || payload->phase == 2)) {
+            payload->index++;
+            payload->offset = 0;
+            payload->phase = 0;
+        }
+    }
+    return written;
+}
+
+static size_t payload_read_callback(char *dest, size_t size, size_t nmemb, void *userp) {
+    return chat_payload_read((ChatPayload *)userp, dest, size * nmemb);
+}
+
+// curl rewinds the body when it has to resend it (e.g. on a reused connection)
+static int payload_seek_callback(void *userp, curl_off_t offset, int origin) {
+    if (offset != 0 || origin != SEEK_SET) return CURL_SEEKFUNC_CANTSEEK;
+    chat_payload_rewind((ChatPayload *)userp);
+    return CURL_SEEKFUNC_OK;
+}
+
+// Configure the POST body. The payload must stay alive until the transfer is done.
+void chat_payload_attach(CURL *curl, ChatPayload *payload) {
+    curl_easy_setopt(curl, CURLOPT_POST, 1L);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)payload->length);
+
+    if (payload->length <= PAYLOAD_STREAM_THRESHOLD) {
+        Buffer *buf = &payload->body;
+        buffer_reset(buf);
+
+        if (buffer_reserve(buf, payload->length) == 0) {
+            chat_payload_rewind(payload);
+            buf->len = chat_payload_read(payload, buf->data, payload->length);
+            buf->data[buf->len] = '\0';
+            curl_easy_setopt(curl, CURLOPT_POSTFIELDS, buf->data);
+            return;
+        }
+    }
+
+    chat_payload_rewind(payload);
+    curl_easy_setopt(curl, CURLOPT_READFUNCTION, payload_read_callback);
+    curl_easy_setopt(curl, CURLOPT_READDATA, (void *)payload);
+    curl_easy_setopt(curl, CURLOPT_SEEKFUNCTION, payload_seek_callback);
+    curl_easy_setopt(curl, CURLOPT_SEEKDATA, (void *)payload);
+}
+
+void chat_payload_free(ChatPayload *payload) {
+    free(payload->segments);
+    payload->segments = NULL;
+    payload->count = 0;
+    buffer_free(&payload->body);
+}
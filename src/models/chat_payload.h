@@ -0,0 +1,51 @@
+#ifndef CHAT_PAYLOAD_H
+#define CHAT_PAYLOAD_H
+
+#include <stddef.h>
+#include <curl/curl.h>
+#include "../buffer.h"
+#include "../../include/types.h"
+
+// What goes into a chat completion request body
+typedef struct {
+    const char *model;
+    const MessageArray *messages;
+    const char *reasoning_effort;   // Optional
+    int stream;                     // Adds "stream":true
+    int async_envelope;             // Wrap as {"request":{...}} for the async API
+} ChatPayloadSpec;
+
+// One piece of the body: literal JSON, or a string that is quoted and escaped on output
+typedef struct {
+    const char *data;
+    size_t len;
+    int escaped;
+} PayloadSegment;
+
+// Compact JSON body, produced segment by segment. Small bodies are written
+// into the payload's own buffer (the transfer outlives the thread that built
+// it); large ones are streamed to curl through CURLOPT_READFUNCTION so the
+// history is never copied into a second buffer.
+typedef struct {
+    PayloadSegment *segments;
+    int count;
+    size_t length;          // Exact serialized size (the Content-Length)
+
+    // Read position
+    int index;
+    size_t offset;
+    int phase;              // Escaped segments: 0 open quote, 1 body, 2 close quote
+    char pending[6];        // Escape sequence that did not fit into the last read
+    size_t pending_len;
+    size_t pending_pos;
+
+    Buffer body;            // Serialized small body (CURLOPT_POSTFIELDS)
+} ChatPayload;
+
+int chat_payload_init(ChatPayload *payload, const ChatPayloadSpec *spec);
+void chat_payload_attach(CURL *curl, ChatPayload *payload);
+size_t chat_payload_read(ChatPayload *payload, char *dest, size_t size);
+void chat_payload_rewind(ChatPayload *payload);
+void chat_payload_free(ChatPayload *payload);
+
+#endif
@@ -2,83 +2,56 @@
 #include "model_router.h"
 #include "sync_models.h"
 #include "async_models.h"
+#include "../response_cache.h"
+#include "../singleflight.h"
+#include "query_classifier.h"
+#include "model_stats.h"
+#include "../metrics.h"
+#include "../registry.h"
+#include "../worker_pool.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
 
 // Analyze query complexity to determine if deep research is needed
 int is_complex_research_query(const char *content) {
     if (!content) return 0;
 
-    // Convert to lowercase for analysis
-    char *lower_content = strdup(content);
-    if (!lower_content) return 0;  // Added null check
-
-    // Fixed: Use size_t for string iteration and cast to unsigned char
-    for (size_t i = 0; lower_content[i] != '\0'; i++) {
-        lower_content[i] = (char)tolower((unsigned char)lower_content[i]);
-    }
-
-    // Simple patterns that indicate basic questions (don't need deep research)
-    const char *simple_patterns[] = {
-        "how many", "what is", "calculate", "solve", "math", "arithmetic",
-        "add", "subtract", "multiply", "divide", "plus", "minus",
-        "apples", "oranges", "basic", "simple", "quick question",
-        NULL
-    };
-
-    // Complex patterns that indicate research-worthy queries
-    const char *complex_patterns[] = {
-        "analysis", "comprehensive", "report", "industry", "market",
-        "economic", "policy", "framework", "strategy", "trends",
-        "future", "projection", "forecast", "impact", "implications",
-        "comparison", "evaluate", "assess", "study", "research",
-        "technological", "regulatory", "commercial viability",
-        "net-zero", "carbon emissions", "heavy industry",
-        NULL
-    };
-
-    int simple_score = 0;
-    int complex_score = 0;
-    size_t content_length = strlen(content);  // Fixed: Use size_t for string length
-
-    // Fixed: Use size_t for array iteration
-    for (size_t i = 0; simple_patterns[i] != NULL; i++) {
-        if (strstr(lower_content, simple_patterns[i])) {
-            simple_score += 2;
-        }
-    }
-
-    // Fixed: Use size_t for array iteration
-    for (size_t i = 0; complex_patterns[i] != NULL; i++) {
-        if (strstr(lower_content, complex_patterns[i])) {
-            complex_score += 3;
-        }
-    }
-
-    // Length-based scoring (longer queries often need more research)
-    if (content_length > 200) complex_score += 2;
-    if (content_length > 500) complex_score += 3;
+    ClassifierResult result;
+    query_classifier_classify(content, &result);
+    return result.is_complex;
+}
 
-    free(lower_content);
+#define MAX_CANDIDATES 3
+#define HEDGE_DEFAULT_BUDGET_MS 30000   // Hedged research without a deadline_ms
+#define HEDGED_TOOL_NAME "perplexity_research_hedged"
 
-    // Return 1 if complex research is needed, 0 for simple queries
-    return (complex_score > simple_score + 1);
-}
+// Models a tool may use, best answer first. Fallbacks step down in latency
+// and cost; a tier is skipped when it misses the caller's deadline or
+// budget, is running slow, or is failing.
+typedef struct {
+    ModelId models[MAX_CANDIDATES];
+    int count;
+} Candidates;
 
-// Main routing function
-char *route_and_execute(MessageArray *msg_array, const char *tool_name, int force_async) {
-    if (!msg_array || !tool_name) return NULL;
+static const Candidates ASK_MODELS = {{MODEL_SONAR_PRO, MODEL_SONAR_REASONING_PRO}, 2};
+static const Candidates REASON_MODELS = {{MODEL_SONAR_REASONING_PRO, MODEL_SONAR_PRO}, 2};
+static const Candidates DEEP_MODELS = {{MODEL_SONAR_DEEP_RESEARCH, MODEL_SONAR_REASONING_PRO, MODEL_SONAR_PRO}, 3};
+static const Candidates FORCED_DEEP_MODELS = {{MODEL_SONAR_DEEP_RESEARCH}, 1};
 
-    if (strcmp(tool_name, "perplexity_ask") == 0) {
-        return execute_sonar_pro(msg_array);
-    } else if (strcmp(tool_name, "perplexity_research") == 0) {
+// Pick the candidate models for a tool call. borderline is set for research
+// queries the classifier could have gone either way on.
+static const Candidates *select_candidates(MessageArray *msg_array, const ToolDescriptor *tool,
+                                           const RequestContext *ctx, int *borderline) {
+    switch (tool->id) {
+    case TOOL_ASK:
+        return &ASK_MODELS;
+    case TOOL_RESEARCH:
         (void)fprintf(stderr, "Starting intelligent research analysis...\n");
 
         // Check if query needs deep research (unless forced)
-        if (!force_async) {
-            char *last_user_content = NULL;
+        if (!ctx->force_async) {
+            const char *last_user_content = NULL;
             for (int i = msg_array->count - 1; i >= 0; i--) {
                 if (msg_array->messages[i].role && msg_array->messages[i].content &&
                     strcmp(msg_array->messages[i].role, "user") == 0) {
@@ -87,19 +60,346 @@ char *route_and_execute(MessageArray *msg_array, const char *tool_name, int forc
                 }
             }
 
-            if (last_user_content && !is_complex_research_query(last_user_content)) {
-                (void)fprintf(stderr, "Query appears simple, using sonar-pro instead of deep research\n");
-                return execute_sonar_pro(msg_array);
+            if (last_user_content) {
+                ClassifierResult result;
+                char breakdown[512];
+                query_classifier_classify(last_user_content, &result);
+                query_classifier_describe(&result, breakdown, sizeof(breakdown));
+                (void)fprintf(stderr, "Query classification: %s\n", breakdown);
+                *borderline = result.borderline;
+
+                if (!result.is_complex) {
+                    (void)fprintf(stderr, "Query appears simple, using sonar-pro instead of deep research\n");
+                    return &ASK_MODELS;
+                }
             }
         }
 
-        return execute_sonar_deep_research(msg_array);
-    } else if (strcmp(tool_name, "perplexity_reason") == 0) {
-        return execute_sonar_reasoning_pro(msg_array);
-    } else if (strcmp(tool_name, "perplexity_deep_research") == 0) {
+        return &DEEP_MODELS;
+    case TOOL_REASON:
+        return &REASON_MODELS;
+    case TOOL_DEEP_RESEARCH:
         (void)fprintf(stderr, "Starting forced deep research analysis...\n");
-        return execute_sonar_deep_research(msg_array);
+        return &FORCED_DEEP_MODELS;
+    default:
+        return NULL;
     }
+}
 
+// Rough input size: about four characters per token
+static int estimate_prompt_tokens(const MessageArray *msg_array) {
+    size_t chars = 0;
+    for (int i = 0; i < msg_array->count; i++) {
+        if (msg_array->messages[i].content) chars += strlen(msg_array->messages[i].content);
+    }
+    chars /= 4;
+    return chars > 0x7fffffff ? 0x7fffffff : (int)chars;
+}
+
+// Why estimate does not fit the call, or NULL when it does
+static const char *misfit_reason(const ModelEstimate *estimate, long deadline_ms, double max_cost_usd) {
+    if (deadline_ms > 0 && estimate->latency_ms > (double)deadline_ms) return "over the deadline";
+    if (max_cost_usd > 0 && estimate->cost_usd > max_cost_usd) return "over budget";
+    if (estimate->error_rate > 0.5) return "failing";
+    if (estimate->slow) return "running slow";
     return NULL;
 }
+
+// First candidate that fits; when none does, the fastest one under a
+// deadline, else the cheapest
+static const ModelDescriptor *choose_model(const Candidates *candidates, const MessageArray *msg_array,
+                                           const RequestContext *ctx) {
+    const ModelDescriptor *models[MAX_CANDIDATES];
+    for (int i = 0; i < candidates->count; i++) {
+        models[i] = registry_model(candidates->models[i]);
+    }
+    if (candidates->count == 1) return models[0];
+
+    // A background job answers at once, so only the budget applies
+    long deadline_ms = ctx->background ? 0 : ctx->deadline_ms;
+    int prompt_tokens = estimate_prompt_tokens(msg_array);
+
+    ModelEstimate estimates[MAX_CANDIDATES];
+    const char *first_reason = NULL;
+    for (int i = 0; i < candidates->count; i++) {
+        if (model_stats_estimate(models[i]->name, prompt_tokens, &estimates[i]) != 0) continue;
+        const char *reason = misfit_reason(&estimates[i], deadline_ms, ctx->max_cost_usd);
+        if (!reason) {
+            if (i > 0) {
+                (void)fprintf(stderr, "Routing to %s: %s is %s (est. %.0f ms, $%.4f)\n", models[i]->name,
+                              models[0]->name, first_reason, estimates[0].latency_ms, estimates[0].cost_usd);
+            }
+            return models[i];
+        }
+        if (i == 0) first_reason = reason;
+    }
+
+    int best = 0;
+    for (int i = 1; i < candidates->count; i++) {
+        int better = deadline_ms > 0 ? estimates[i].latency_ms < estimates[best].latency_ms
+                                     : estimates[i].cost_usd < estimates[best].cost_usd;
+        if (better) best = i;
+    }
+    (void)fprintf(stderr, "No model fits the request (%s is %s); using %s\n", models[0]->name, first_reason,
+                  models[best]->name);
+    return models[best];
+}
+
+// One routed call on its way through hedging, the cache and singleflight.
+// Each step hands the call to the next one's completion; no thread waits.
+typedef struct {
+    MessageArray *msg_array;
+    const ToolDescriptor *tool;
+    RequestContext *ctx;
+    const Candidates *candidates;
+    const ModelDescriptor *descriptor;
+    CacheKey key;
+    CacheKey flight_key;
+    InflightCall *flight;
+    long long started;
+    // Hedged research
+    long long budget_ms;
+    long long hedge_started;
+    const char *tool_name;      // Billed name of the call, restored if the hedge falls back
+    char *request_id;
+    char *fast;
+    // Answer handed over by the leader of an identical call
+    char *shared;
+    int complete;
+    const char *error;
+    call_done_fn on_done;
+    void *userdata;
+} RouteCall;
+
+static void finish_route(RouteCall *call, char *result) {
+    call_done_fn on_done = call->on_done;
+    void *userdata = call->userdata;
+    free(call->request_id);
+    free(call->fast);
+    free(call);
+    on_done(result, userdata);
+}
+
+static void execute_model(const ModelDescriptor *model, MessageArray *msg_array, RequestContext *ctx,
+                          call_done_fn on_done, void *userdata) {
+    if (model->endpoint == MODEL_ENDPOINT_CHAT) {
+        execute_chat_model(model, msg_array, ctx, on_done, userdata);
+    } else if (ctx->background) {
+        start_sonar_deep_research(msg_array, ctx, on_done, userdata);
+    } else {
+        execute_sonar_deep_research(msg_array, ctx, on_done, userdata);
+    }
+}
+
+static void route_model(RouteCall *call);
+
+// Hedge a research call when asked to (arguments.hedge), or by default for
+// borderline queries that come with a deadline
+static int should_hedge(const ToolDescriptor *tool, int borderline, const RequestContext *ctx) {
+    if (tool->id != TOOL_RESEARCH || ctx->force_async || ctx->background) return 0;
+    if (ctx->hedge != 0) return ctx->hedge > 0;
+    return borderline && ctx->deadline_ms > 0;
+}
+
+// Hedged research: deep research runs as a background job while sonar-pro
+// answers. The report is returned if it lands within the latency budget;
+// otherwise the fast answer is, along with the request_id of the report,
+// which is also cached once it completes. Both legs are billed to the
+// hedged ledger slot. Falls back to plain routing when the background job
+// cannot be submitted.
+static void hedge_report_done(char *report, void *userdata) {
+    RouteCall *call = (RouteCall *)userdata;
+    RequestContext *ctx = call->ctx;
+
+    if (report) {
+        (void)fprintf(stderr, "Hedged research: deep report %s arrived within budget\n", call->request_id);
+        ctx->model_used = registry_model(MODEL_SONAR_DEEP_RESEARCH)->name;
+        finish_route(call, report);
+        return;
+    }
+
+    // The combined text is not cached; the fast answer alone is no substitute for the report
+    ctx->complete = 0;
+    ctx->model_used = registry_model(MODEL_SONAR_PRO)->name;
+    char *result = NULL;
+    if (asprintf(&result,
+                 "%s\n\n---\nDeep research is still running in the background (request_id: %s). "
+                 "Fetch the full report with perplexity_research_result, or ask again later to get it from the cache.",
+                 call->fast ? call->fast : "The fast answer failed.", call->request_id) < 0) {
+        result = call->fast;
+        call->fast = NULL;
+    }
+    (void)fprintf(stderr, "Hedged research: answering with sonar-pro after %lld ms, report %s pending\n",
+                  (metrics_now_us() - call->hedge_started) / 1000, call->request_id);
+    finish_route(call, result);
+}
+
+static void hedge_fast_done(char *fast, void *userdata) {
+    RouteCall *call = (RouteCall *)userdata;
+    RequestContext *ctx = call->ctx;
+    call->fast = fast;
+    model_stats_record_call(registry_model(MODEL_SONAR_PRO)->name, metrics_now_us() - call->started,
+                            fast && ctx->complete);
+
+    long long left_ms = call->budget_ms - (metrics_now_us() - call->hedge_started) / 1000;
+    await_background_research(call->request_id, left_ms > 0 ? left_ms : 0, ctx, hedge_report_done, call);
+}
+
+static void hedge_submitted(char *request_id, void *userdata) {
+    RouteCall *call = (RouteCall *)userdata;
+    if (!request_id) {
+        // Plain routing is billed as the tool that was called
+        call->ctx->tool_name = call->tool_name;
+        route_model(call);
+        return;
+    }
+    call->request_id = request_id;
+    (void)fprintf(stderr, "Hedging research: sonar-pro now, deep research %s within %lld ms\n", request_id,
+                  call->budget_ms);
+
+    call->started = metrics_now_us();
+    execute_model(registry_model(MODEL_SONAR_PRO), call->msg_array, call->ctx, hedge_fast_done, call);
+}
+
+static void execute_hedged(RouteCall *call) {
+    RequestContext *ctx = call->ctx;
+    call->budget_ms = ctx->deadline_ms > 0 ? ctx->deadline_ms : HEDGE_DEFAULT_BUDGET_MS;
+    call->hedge_started = metrics_now_us();
+    call->tool_name = ctx->tool_name;
+    ctx->tool_name = HEDGED_TOOL_NAME;
+
+    submit_background_research(call->msg_array, ctx, hedge_submitted, call);
+}
+
+// Leader: publish the answer to the followers of this call
+static void route_executed(char *result, void *userdata) {
+    RouteCall *call = (RouteCall *)userdata;
+    RequestContext *ctx = call->ctx;
+    const char *model = call->descriptor->name;
+
+    int expired = cancel_token_expired(ctx->cancel);
+    // A call its client gave up on says nothing about the model
+    if (!ctx->background && !expired) {
+        model_stats_record_call(model, metrics_now_us() - call->started, result && ctx->complete);
+    }
+    if (result && ctx->complete) {
+        response_cache_put(&call->key, call->tool->name, result, ctx->cost);
+    }
+    singleflight_complete(call->flight, result, expired && !result ? -1 : ctx->complete, ctx->error);
+    finish_route(call, result);
+}
+
+static void join_flight(RouteCall *call);
+
+// Follower: answered by the leader, or cancelled while waiting
+static void follower_answered(void *arg) {
+    RouteCall *call = (RouteCall *)arg;
+    RequestContext *ctx = call->ctx;
+    char *shared = call->shared;
+    call->shared = NULL;
+
+    if (call->complete >= 0) {
+        ctx->complete = call->complete;
+        if (!shared) ctx->error = call->error;
+        finish_route(call, shared);
+        return;
+    }
+    // The leader's client gave up; take over unless this call's did too
+    free(shared);
+    if (cancel_token_expired(ctx->cancel)) {
+        finish_route(call, NULL);
+        return;
+    }
+    join_flight(call);
+}
+
+// May run on the event loop thread (cancel watch); carry on from the pool
+static void route_followed(char *result, int complete, const char *error, void *userdata) {
+    RouteCall *call = (RouteCall *)userdata;
+    call->shared = result;
+    call->complete = complete;
+    call->error = error;
+    worker_pool_dispatch(follower_answered, call);
+}
+
+// Identical calls already in flight share one upstream request
+static void join_flight(RouteCall *call) {
+    int is_leader = 1;
+    call->flight = singleflight_join(&call->flight_key, &is_leader);
+    if (!is_leader) {
+        (void)fprintf(stderr, "Joining identical in-flight %s request\n", call->descriptor->name);
+        singleflight_follow(call->flight, call->ctx->cancel, route_followed, call);
+        return;
+    }
+
+    call->started = metrics_now_us();
+    execute_model(call->descriptor, call->msg_array, call->ctx, route_executed, call);
+}
+
+static void route_model(RouteCall *call) {
+    RequestContext *ctx = call->ctx;
+    const ModelDescriptor *descriptor = ctx->model ? registry_find_model(ctx->model, strlen(ctx->model))
+                                                   : choose_model(call->candidates, call->msg_array, ctx);
+    if (!descriptor || !descriptor->routable) {
+        finish_route(call, NULL);
+        return;
+    }
+    const char *model = descriptor->name;
+    call->descriptor = descriptor;
+    ctx->model_used = model;
+
+    // Identical (model, history) pairs are answered from the cache
+    cache_key_compute(&call->key, model, call->msg_array);
+    if (!ctx->bypass_cache) {
+        char *cached = response_cache_get(&call->key, model);
+        if (cached) {
+            ctx->complete = 1;
+            finish_route(call, cached);
+            return;
+        }
+    }
+
+    // Background calls get a job handle rather than an answer, so they coalesce separately
+    call->flight_key = call->key;
+    if (ctx->background) call->flight_key.hi ^= 0x6261636b67726f75ULL;
+    join_flight(call);
+}
+
+// Main routing function
+void route_and_execute(MessageArray *msg_array, const ToolDescriptor *tool, RequestContext *ctx,
+                       call_done_fn on_done, void *userdata) {
+    if (!msg_array || !tool || !ctx) {
+        on_done(NULL, userdata);
+        return;
+    }
+
+    int borderline = 0;
+    const Candidates *candidates = select_candidates(msg_array, tool, ctx, &borderline);
+    RouteCall *call = candidates ? calloc(1, sizeof(RouteCall)) : NULL;
+    if (!call) {
+        on_done(NULL, userdata);
+        return;
+    }
+    call->msg_array = msg_array;
+    call->tool = tool;
+    call->ctx = ctx;
+    call->candidates = candidates;
+    call->on_done = on_done;
+    call->userdata = userdata;
+
+    if (!ctx->model && should_hedge(tool, borderline, ctx)) {
+        // A finished report for this question beats hedging again
+        CacheKey deep_key;
+        cache_key_compute(&deep_key, "sonar-deep-research", msg_array);
+        char *cached = ctx->bypass_cache ? NULL : response_cache_get(&deep_key, "sonar-deep-research");
+        if (cached) {
+            ctx->complete = 1;
+            ctx->model_used = registry_model(MODEL_SONAR_DEEP_RESEARCH)->name;
+            finish_route(call, cached);
+            return;
+        }
+        execute_hedged(call);
+        return;
+    }
+    route_model(call);
+}
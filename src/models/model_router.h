@@ -2,11 +2,15 @@
 #define MODEL_ROUTER_H
 
 #include "../../include/types.h"
+#include "../registry.h"
 
 // Query complexity analysis
 int is_complex_research_query(const char *content);
 
-// Main routing function
-char *route_and_execute(MessageArray *msg_array, const char *tool_name, int force_async);
+// Main routing function. on_done gets the answer once, on a pool worker or
+// on this thread when the call ends before any transfer starts; msg_array
+// and ctx must stay alive until then.
+void route_and_execute(MessageArray *msg_array, const ToolDescriptor *tool, RequestContext *ctx,
+                       call_done_fn on_done, void *userdata);
 
 #endif
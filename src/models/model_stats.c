@@ -0,0 +1,148 @@
+#define GNU_SOURCE
+#include "model_stats.h"
+#include "../metrics.h"
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#define EWMA_ALPHA 0.2
+#define SLOW_FACTOR 2.5                 // Latency over prior * factor counts as slow
+#define RECOVERY_US (120LL * 1000000)   // Idle time after which the priors are back
+#define REPORT_PROMPT_TOKENS 500        // Prompt size for the expected cost in stats
+
+// Typical call per model, indexed like the pricing table
+typedef struct {
+    double latency_ms;
+    double completion_tokens;
+    double citation_tokens;
+    double reasoning_tokens;
+    double search_queries;
+} ModelPrior;
+
+static const ModelPrior PRIORS[USAGE_MODEL_COUNT] = {
+    [0] = {3000.0, 400.0, 0.0, 0.0, 0.0},               // sonar
+    [1] = {6000.0, 800.0, 0.0, 0.0, 0.0},               // sonar-pro
+    [2] = {8000.0, 1200.0, 0.0, 0.0, 0.0},              // sonar-reasoning
+    [3] = {15000.0, 2000.0, 0.0, 0.0, 0.0},             // sonar-reasoning-pro
+    [4] = {180000.0, 8000.0, 20000.0, 60000.0, 20.0}    // sonar-deep-research
+};
+
+typedef struct {
+    double latency_ms;
+    double error_rate;
+    double completion_tokens;
+    double citation_tokens;
+    double reasoning_tokens;
+    double search_queries;
+    long calls;
+    long billed;
+    long long last_call_us;
+    long long last_billed_us;
+} ModelState;
+
+static ModelState states[USAGE_MODEL_COUNT];
+static int states_seeded = 0;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Callers hold stats_lock
+static void seed_states(void) {
+    if (states_seeded) return;
+    for (int i = 0; i < USAGE_MODEL_COUNT; i++) {
+        states[i].latency_ms = PRIORS[i].latency_ms;
+        states[i].completion_tokens = PRIORS[i].completion_tokens;
+        states[i].citation_tokens = PRIORS[i].citation_tokens;
+        states[i].reasoning_tokens = PRIORS[i].reasoning_tokens;
+        states[i].search_queries = PRIORS[i].search_queries;
+    }
+    states_seeded = 1;
+}
+
+// The prior counts as one sample, so the first observation moves halfway
+static double ewma(double current, double sample, long samples) {
+    double weight = samples < 4 ? 1.0 / (double)(samples + 2) : EWMA_ALPHA;
+    return current + (sample - current) * weight;
+}
+
+// Blend value back toward prior as the last observation ages
+static double recover(double value, double prior, long long last_us, long long now_us) {
+    if (last_us == 0) return prior;
+    long long age = now_us - last_us;
+    if (age >= RECOVERY_US) return prior;
+    double fresh = 1.0 - (double)age / (double)RECOVERY_US;
+    return prior + (value - prior) * fresh;
+}
+
+void model_stats_record_call(const char *model, long long elapsed_us, int ok) {
+    int index = model ? usage_model_index(model) : -1;
+    if (index < 0) return;
+
+    pthread_mutex_lock(&stats_lock);
+    seed_states();
+    ModelState *state = &states[index];
+    // Failures say little about latency; a timeout would inflate it for minutes
+    if (ok) {
+        state->latency_ms = ewma(state->latency_ms, (double)elapsed_us / 1000.0, state->calls);
+    }
+    state->error_rate = ewma(state->error_rate, ok ? 0.0 : 1.0, state->calls);
+    state->calls++;
+    state->last_call_us = metrics_now_us();
+    pthread_mutex_unlock(&stats_lock);
+}
+
+void model_stats_record_usage(const char *model, const UsageInfo *usage) {
+    int index = model ? usage_model_index(model) : -1;
+    if (index < 0) return;
+
+    pthread_mutex_lock(&stats_lock);
+    seed_states();
+    ModelState *state = &states[index];
+    state->completion_tokens = ewma(state->completion_tokens, usage->completion_tokens, state->billed);
+    state->citation_tokens = ewma(state->citation_tokens, usage->citation_tokens, state->billed);
+    state->reasoning_tokens = ewma(state->reasoning_tokens, usage->reasoning_tokens, state->billed);
+    state->search_queries = ewma(state->search_queries, usage->num_search_queries, state->billed);
+    state->billed++;
+    state->last_billed_us = metrics_now_us();
+    pthread_mutex_unlock(&stats_lock);
+}
+
+int model_stats_estimate(const char *model, int prompt_tokens, ModelEstimate *out) {
+    int index = model ? usage_model_index(model) : -1;
+    if (index < 0) return -1;
+
+    const ModelPrior *prior = &PRIORS[index];
+    long long now = metrics_now_us();
+    UsageInfo usage;
+    memset(&usage, 0, sizeof(usage));
+
+    pthread_mutex_lock(&stats_lock);
+    seed_states();
+    const ModelState *state = &states[index];
+    out->latency_ms = recover(state->latency_ms, prior->latency_ms, state->last_call_us, now);
+    out->error_rate = recover(state->error_rate, 0.0, state->last_call_us, now);
+    out->samples = state->calls;
+    usage.completion_tokens = (int)recover(state->completion_tokens, prior->completion_tokens, state->last_billed_us, now);
+    usage.citation_tokens = (int)recover(state->citation_tokens, prior->citation_tokens, state->last_billed_us, now);
+    usage.reasoning_tokens = (int)recover(state->reasoning_tokens, prior->reasoning_tokens, state->last_billed_us, now);
+    usage.num_search_queries = (int)(recover(state->search_queries, prior->search_queries, state->last_billed_us, now) + 0.5);
+    pthread_mutex_unlock(&stats_lock);
+
+    // Priced with the same table as billing
+    usage.prompt_tokens = prompt_tokens;
+    CostInfo cost;
+    out->cost_usd = calculate_cost(&usage, model, &cost) == 0 ? cost.total_cost : 0.0;
+    out->slow = out->latency_ms > prior->latency_ms * SLOW_FACTOR;
+    return 0;
+}
+
+int model_stats_format_json(Buffer *out) {
+    buffer_append_str(out, "{");
+    for (int i = 0; i < USAGE_MODEL_COUNT; i++) {
+        ModelEstimate estimate;
+        model_stats_estimate(usage_model_name(i), REPORT_PROMPT_TOKENS, &estimate);
+        buffer_append_printf(out, "%s\"%s\":{\"calls\":%ld,\"latency_ms\":%.1f,\"error_rate\":%.3f,"
+                             "\"expected_cost_usd\":%.6f,\"slow\":%s}",
+                             i ? "," : "", usage_model_name(i), estimate.samples, estimate.latency_ms,
+                             estimate.error_rate, estimate.cost_usd, estimate.slow ? "true" : "false");
+    }
+    return buffer_append_str(out, "}");
+}
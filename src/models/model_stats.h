@@ -0,0 +1,32 @@
+#ifndef MODEL_STATS_H
+#define MODEL_STATS_H
+
+#include "../buffer.h"
+#include "../../include/usage.h"
+
+// Live per-model estimates for routing: EWMAs of call latency, failure rate
+// and billed usage, seeded with priors so the first calls route sensibly.
+// Estimates drift back to the priors while a model gets no traffic, so a
+// tier that was skipped for being slow is tried again later.
+
+typedef struct {
+    double latency_ms;      // Expected end-to-end call time
+    double error_rate;      // Recent fraction of failed calls
+    double cost_usd;        // Expected cost for the prompt size asked about
+    int slow;               // Latency well above the model's usual
+    long samples;           // Calls observed
+} ModelEstimate;
+
+// One finished call (ok: a complete answer was returned)
+void model_stats_record_call(const char *model, long long elapsed_us, int ok);
+
+// Usage billed for one call; drives the expected cost
+void model_stats_record_usage(const char *model, const UsageInfo *usage);
+
+// Estimate a call with about prompt_tokens of input. Returns -1 for unknown models.
+int model_stats_estimate(const char *model, int prompt_tokens, ModelEstimate *out);
+
+// Current estimates as JSON (the perplexity_stats tool)
+int model_stats_format_json(Buffer *out);
+
+#endif
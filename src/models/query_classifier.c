@@ -0,0 +1,383 @@
+#define GNU_SOURCE
+#include "query_classifier.h"
+#include <ctype.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Pattern file format (PERPLEXITY_CLASSIFIER_FILE), one rule per line:
+//
+//   simple  <weight> <pattern>     matched text suggests a quick answer
+//   complex <weight> <pattern>     matched text suggests deep research
+//   length  <min_bytes> <weight>   bonus to the complex score for long queries
+//   margin  <n>                    complex if complex > simple + n
+//
+// Patterns may contain spaces and are matched case-insensitively anywhere in
+// the query; each pattern counts once. '#' starts a comment line.
+
+#define MAX_PATTERNS 512
+#define MAX_LENGTH_RULES 8
+#define MAX_PATTERN_LEN 128
+#define BORDERLINE_SPAN 2     // Points either side of the margin that count as borderline
+
+typedef enum {
+    PATTERN_SIMPLE,
+    PATTERN_COMPLEX
+} PatternKind;
+
+typedef struct {
+    char *text;
+    int weight;
+    PatternKind kind;
+} Pattern;
+
+typedef struct {
+    size_t min_len;
+    int weight;
+} LengthRule;
+
+// Aho-Corasick automaton compiled to a DFA over a folded alphabet: bytes
+// that occur in no pattern share class 0, and upper case maps to lower case.
+typedef struct {
+    Pattern patterns[MAX_PATTERNS];
+    int pattern_count;
+    LengthRule length_rules[MAX_LENGTH_RULES];
+    int length_rule_count;
+    int margin;
+
+    uint8_t byte_class[256];
+    int class_count;
+    int state_count;
+    uint32_t *next;         // row + class -> row of the next state (row = state * class_count)
+    uint32_t report_row;    // Rows at or past this belong to states that complete a pattern
+    int *output;            // Pattern ending at this state, or -1
+    int *dict_link;         // Nearest suffix state with an output, or -1
+    int *report;            // First state on the output chain of this state, or -1
+} Classifier;
+
+static Classifier classifier;
+static pthread_once_t classifier_once = PTHREAD_ONCE_INIT;
+static int classifier_ready = 0;
+
+// Defaults, matching the original hand-written router rules
+static const struct {
+    const char *text;
+    int weight;
+    PatternKind kind;
+} DEFAULT_PATTERNS[] = {
+    {"how many", 2, PATTERN_SIMPLE}, {"what is", 2, PATTERN_SIMPLE}, {"calculate", 2, PATTERN_SIMPLE},
+    {"solve", 2, PATTERN_SIMPLE}, {"math", 2, PATTERN_SIMPLE}, {"arithmetic", 2, PATTERN_SIMPLE},
+    {"add", 2, PATTERN_SIMPLE}, {"subtract", 2, PATTERN_SIMPLE}, {"multiply", 2, PATTERN_SIMPLE},
+    {"divide", 2, PATTERN_SIMPLE}, {"plus", 2, PATTERN_SIMPLE}, {"minus", 2, PATTERN_SIMPLE},
+    {"apples", 2, PATTERN_SIMPLE}, {"oranges", 2, PATTERN_SIMPLE}, {"basic", 2, PATTERN_SIMPLE},
+    {"simple", 2, PATTERN_SIMPLE}, {"quick question", 2, PATTERN_SIMPLE},
+
+    {"analysis", 3, PATTERN_COMPLEX}, {"comprehensive", 3, PATTERN_COMPLEX}, {"report", 3, PATTERN_COMPLEX},
+    {"industry", 3, PATTERN_COMPLEX}, {"market", 3, PATTERN_COMPLEX}, {"economic", 3, PATTERN_COMPLEX},
+    {"policy", 3, PATTERN_COMPLEX}, {"framework", 3, PATTERN_COMPLEX}, {"strategy", 3, PATTERN_COMPLEX},
+    {"trends", 3, PATTERN_COMPLEX}, {"future", 3, PATTERN_COMPLEX}, {"projection", 3, PATTERN_COMPLEX},
+    {"forecast", 3, PATTERN_COMPLEX}, {"impact", 3, PATTERN_COMPLEX}, {"implications", 3, PATTERN_COMPLEX},
+    {"comparison", 3, PATTERN_COMPLEX}, {"evaluate", 3, PATTERN_COMPLEX}, {"assess", 3, PATTERN_COMPLEX},
+    {"study", 3, PATTERN_COMPLEX}, {"research", 3, PATTERN_COMPLEX}, {"technological", 3, PATTERN_COMPLEX},
+    {"regulatory", 3, PATTERN_COMPLEX}, {"commercial viability", 3, PATTERN_COMPLEX},
+    {"net-zero", 3, PATTERN_COMPLEX}, {"carbon emissions", 3, PATTERN_COMPLEX},
+    {"heavy industry", 3, PATTERN_COMPLEX},
+};
+
+static int add_pattern(Classifier *c, const char *text, int weight, PatternKind kind) {
+    if (c->pattern_count >= MAX_PATTERNS || !text[0] || strlen(text) > MAX_PATTERN_LEN) return -1;
+
+    char *lower = strdup(text);
+    if (!lower) return -1;
+    for (char *p = lower; *p; p++) *p = (char)tolower((unsigned char)*p);
+
+    Pattern *pattern = &c->patterns[c->pattern_count++];
+    pattern->text = lower;
+    pattern->weight = weight;
+    pattern->kind = kind;
+    return 0;
+}
+
+static void load_defaults(Classifier *c) {
+    for (size_t i = 0; i < sizeof(DEFAULT_PATTERNS) / sizeof(DEFAULT_PATTERNS[0]); i++) {
+        (void)add_pattern(c, DEFAULT_PATTERNS[i].text, DEFAULT_PATTERNS[i].weight, DEFAULT_PATTERNS[i].kind);
+    }
+    c->length_rules[0] = (LengthRule){200, 2};
+    c->length_rules[1] = (LengthRule){500, 3};
+    c->length_rule_count = 2;
+    c->margin = 1;
+}
+
+static char *trim(char *s) {
+    while (isspace((unsigned char)*s)) s++;
+    char *end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1])) *--end = '\0';
+    return s;
+}
+
+static int load_file(Classifier *c, const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file) return -1;
+
+    char line[512];
+    int line_no = 0;
+    while (fgets(line, sizeof(line), file)) {
+        line_no++;
+        char *rule = trim(line);
+        if (!rule[0] || rule[0] == '#') continue;
+
+        char kind[16];
+        long a = 0, b = 0;
+        int consumed = 0;
+        if (sscanf(rule, "%15s %ld%n", kind, &a, &consumed) < 2) {
+            (void)fprintf(stderr, "%s:%d: ignoring malformed rule\n", path, line_no);
+            continue;
+        }
+        char *rest = trim(rule + consumed);
+
+        if (strcmp(kind, "simple") == 0 || strcmp(kind, "complex") == 0) {
+            PatternKind pattern_kind = kind[0] == 's' ? PATTERN_SIMPLE : PATTERN_COMPLEX;
+            if (add_pattern(c, rest, (int)a, pattern_kind) != 0) {
+                (void)fprintf(stderr, "%s:%d: ignoring pattern\n", path, line_no);
+            }
+        } else if (strcmp(kind, "length") == 0 && sscanf(rest, "%ld", &b) == 1 &&
+                   c->length_rule_count < MAX_LENGTH_RULES && a >= 0) {
+            c->length_rules[c->length_rule_count++] = (LengthRule){(size_t)a, (int)b};
+        } else if (strcmp(kind, "margin") == 0) {
+            c->margin = (int)a;
+        } else {
+            (void)fprintf(stderr, "%s:%d: ignoring unknown rule '%s'\n", path, line_no, kind);
+        }
+    }
+
+    (void)fclose(file);
+    return 0;
+}
+
+// Compile the patterns: trie, then breadth-first failure links folded into
+// a full transition table so the scan does one lookup per byte
+static int build_automaton(Classifier *c) {
+    memset(c->byte_class, 0, sizeof(c->byte_class));
+    c->class_count = 1;
+    size_t max_states = 1;
+    for (int i = 0; i < c->pattern_count; i++) {
+        for (const unsigned char *p = (const unsigned char *)c->patterns[i].text; *p; p++) {
+            if (c->byte_class[*p] == 0) {
+                c->byte_class[*p] = (uint8_t)c->class_count++;
+                if (isalpha(*p)) c->byte_class[toupper(*p)] = c->byte_class[*p];
+            }
+        }
+        max_states += strlen(c->patterns[i].text);
+    }
+    if (max_states * (size_t)c->class_count > UINT32_MAX) return -1;
+
+    int classes = c->class_count;
+    c->next = calloc(max_states * (size_t)classes, sizeof(uint32_t));
+    c->output = malloc(max_states * sizeof(int));
+    c->dict_link = malloc(max_states * sizeof(int));
+    c->report = malloc(max_states * sizeof(int));
+    int *fail = calloc(max_states, sizeof(int));
+    int *queue = malloc(max_states * sizeof(int));
+    if (!c->next || !c->output || !c->dict_link || !c->report || !fail || !queue) {
+        free(fail);
+        free(queue);
+        return -1;
+    }
+
+    // Trie; 0 in the table means "no edge" until links are filled in
+    c->state_count = 1;
+    c->output[0] = -1;
+    for (int i = 0; i < c->pattern_count; i++) {
+        int state = 0;
+        for (const unsigned char *p = (const unsigned char *)c->patterns[i].text; *p; p++) {
+            uint32_t *edge = &c->next[state * classes + c->byte_class[*p]];
+            if (*edge == 0) {
+                *edge = (uint32_t)c->state_count;
+                c->output[c->state_count] = -1;
+                c->state_count++;
+            }
+            state = *edge;
+        }
+        if (c->output[state] < 0) c->output[state] = i;  // Duplicates count once
+    }
+
+    // Breadth-first: failure links, dictionary links, and missing edges
+    int head = 0, tail = 0;
+    c->dict_link[0] = -1;
+    for (int cls = 0; cls < classes; cls++) {
+        int child = c->next[cls];
+        if (child) {
+            fail[child] = 0;
+            c->dict_link[child] = -1;
+            queue[tail++] = child;
+        }
+    }
+    while (head < tail) {
+        int state = queue[head++];
+        for (int cls = 0; cls < classes; cls++) {
+            uint32_t *edge = &c->next[state * classes + cls];
+            int fallback = (int)c->next[fail[state] * classes + cls];
+            if (*edge) {
+                int child = (int)*edge;
+                fail[child] = fallback;
+                c->dict_link[child] = c->output[fallback] >= 0 ? fallback : c->dict_link[fallback];
+                queue[tail++] = child;
+            } else {
+                *edge = (uint32_t)fallback;
+            }
+        }
+    }
+
+    // Scan-time layout. States whose output chain is non-empty are numbered
+    // last, so one compare tells whether a byte completed any pattern, and
+    // edges hold row offsets (state * classes) to keep the per-byte work to a
+    // single dependent load.
+    int *renumber = fail;  // Failure links are no longer needed
+    int reporting = 0;
+    for (int state = 0; state < c->state_count; state++) {
+        c->report[state] = c->output[state] >= 0 ? state : c->dict_link[state];
+        if (c->report[state] >= 0) reporting++;
+    }
+    int quiet_id = 0, reporting_id = c->state_count - reporting;
+    for (int state = 0; state < c->state_count; state++) {
+        renumber[state] = c->report[state] >= 0 ? reporting_id++ : quiet_id++;
+    }
+    c->report_row = (uint32_t)(c->state_count - reporting) * (uint32_t)classes;
+
+    uint32_t *rows = malloc((size_t)c->state_count * (size_t)classes * sizeof(uint32_t));
+    int *scratch = queue;
+    if (!rows) {
+        free(fail);
+        free(queue);
+        return -1;
+    }
+    for (int state = 0; state < c->state_count; state++) {
+        for (int cls = 0; cls < classes; cls++) {
+            int target = (int)c->next[state * classes + cls];
+            rows[(size_t)renumber[state] * (size_t)classes + (size_t)cls] = (uint32_t)renumber[target] * (uint32_t)classes;
+        }
+    }
+    free(c->next);
+    c->next = rows;
+
+    int *tables[] = {c->output, c->dict_link, c->report};
+    for (size_t t = 0; t < sizeof(tables) / sizeof(tables[0]); t++) {
+        memcpy(scratch, tables[t], (size_t)c->state_count * sizeof(int));
+        for (int state = 0; state < c->state_count; state++) {
+            int value = scratch[state];
+            if (t > 0 && value >= 0) value = renumber[value];  // Links name states
+            tables[t][renumber[state]] = value;
+        }
+    }
+
+    free(fail);
+    free(queue);
+    return 0;
+}
+
+static void classifier_build(void) {
+    Classifier *c = &classifier;
+    const char *path = getenv("PERPLEXITY_CLASSIFIER_FILE");
+
+    if (path && *path) {
+        c->margin = 1;
+        if (load_file(c, path) != 0) {
+            (void)fprintf(stderr, "Warning: cannot read classifier patterns from %s, using defaults\n", path);
+        } else if (c->pattern_count == 0) {
+            (void)fprintf(stderr, "Warning: no patterns in %s, using defaults\n", path);
+        }
+    }
+    if (c->pattern_count == 0) {
+        c->length_rule_count = 0;
+        load_defaults(c);
+    }
+
+    if (build_automaton(c) != 0) {
+        (void)fprintf(stderr, "Warning: query classifier unavailable\n");
+        return;
+    }
+    classifier_ready = 1;
+    (void)fprintf(stderr, "Query classifier: %d patterns, %d states\n", c->pattern_count, c->state_count);
+}
+
+void query_classifier_init(void) {
+    (void)pthread_once(&classifier_once, classifier_build);
+}
+
+void query_classifier_free(void) {
+    Classifier *c = &classifier;
+    for (int i = 0; i < c->pattern_count; i++) free(c->patterns[i].text);
+    free(c->next);
+    free(c->output);
+    free(c->dict_link);
+    free(c->report);
+    memset(c, 0, sizeof(*c));
+    classifier_ready = 0;
+}
+
+static void record_match(const Classifier *c, int index, unsigned char *seen, ClassifierResult *result) {
+    if (seen[index]) return;
+    seen[index] = 1;
+
+    const Pattern *pattern = &c->patterns[index];
+    if (pattern->kind == PATTERN_SIMPLE) {
+        result->simple_score += pattern->weight;
+    } else {
+        result->complex_score += pattern->weight;
+    }
+    if (result->matched_count < CLASSIFIER_MAX_REPORTED) {
+        result->matched[result->matched_count++] = pattern->text;
+    }
+}
+
+void query_classifier_classify(const char *query, ClassifierResult *result) {
+    memset(result, 0, sizeof(*result));
+    if (!query) return;
+
+    query_classifier_init();
+    const Classifier *c = &classifier;
+    size_t len = 0;
+
+    if (classifier_ready) {
+        unsigned char seen[MAX_PATTERNS];
+        memset(seen, 0, (size_t)c->pattern_count);
+
+        const uint32_t *next = c->next;
+        const uint8_t *byte_class = c->byte_class;
+        const uint32_t report_row = c->report_row;
+        uint32_t row = 0;
+        const unsigned char *p = (const unsigned char *)query;
+        for (; *p; p++) {
+            row = next[row + byte_class[*p]];
+            if (row >= report_row) {
+                for (int s = c->report[row / (uint32_t)c->class_count]; s >= 0; s = c->dict_link[s]) {
+                    record_match(c, c->output[s], seen, result);
+                }
+            }
+        }
+        len = (size_t)(p - (const unsigned char *)query);
+    } else {
+        len = strlen(query);
+    }
+
+    // Length-based scoring (longer queries often need more research)
+    for (int i = 0; i < c->length_rule_count; i++) {
+        if (len > c->length_rules[i].min_len) result->length_score += c->length_rules[i].weight;
+    }
+
+    int complex_total = result->complex_score + result->length_score;
+    int lead = complex_total - result->simple_score - c->margin;
+    result->is_complex = lead > 0;
+    result->borderline = lead >= -BORDERLINE_SPAN && lead <= BORDERLINE_SPAN;
+}
+
+void query_classifier_describe(const ClassifierResult *result, char *buf, size_t size) {
+    int written = snprintf(buf, size, "complex %d (+%d length) vs simple %d",
+                           result->complex_score, result->length_score, result->simple_score);
+    for (int i = 0; i < result->matched_count && written > 0 && (size_t)written < size; i++) {
+        written += snprintf(buf + written, size - (size_t)written, "%s%s", i == 0 ? "; matched: " : ", ",
+                            result->matched[i]);
+    }
+}
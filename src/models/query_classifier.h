@@ -0,0 +1,31 @@
+#ifndef QUERY_CLASSIFIER_H
+#define QUERY_CLASSIFIER_H
+
+#include <stddef.h>
+
+// Most matched patterns reported in a breakdown
+#define CLASSIFIER_MAX_REPORTED 16
+
+// Score breakdown for one query
+typedef struct {
+    int simple_score;       // Patterns that point at a quick answer
+    int complex_score;      // Patterns that point at deep research
+    int length_score;       // Bonus for long queries (added to complex)
+    int is_complex;
+    int borderline;         // Within a couple of points of the decision either way
+    int matched_count;
+    const char *matched[CLASSIFIER_MAX_REPORTED];
+} ClassifierResult;
+
+// Build the automaton once: from PERPLEXITY_CLASSIFIER_FILE if set, else the
+// built-in patterns. Safe to call more than once.
+void query_classifier_init(void);
+void query_classifier_free(void);
+
+// Single linear pass over query; ASCII case is folded during the scan
+void query_classifier_classify(const char *query, ClassifierResult *result);
+
+// One-line human readable breakdown
+void query_classifier_describe(const ClassifierResult *result, char *buf, size_t size);
+
+#endif
@@ -0,0 +1,364 @@
+#define GNU_SOURCE
+#include "research_jobs.h"
+#include "../event_loop.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Finished background jobs are kept this long for perplexity_research_result
+#define JOB_RETENTION_MS (60LL * 60LL * 1000LL)
+#define MAX_FINISHED_JOBS 256
+
+// A caller waiting for a job. Foreground waiters are counted in waiters and
+// own a share of the job; others only want the report of a background job.
+typedef struct JobWaiter {
+    struct ResearchJob *job;
+    int foreground;
+    const CancelToken *cancel;
+    CancelWatch watch;          // Wakes the waiter when its call expires
+    research_wait_fn on_done;
+    void *userdata;
+    struct JobWaiter *next;
+} JobWaiter;
+
+struct ResearchJob {
+    char *request_id;
+    CacheKey key;               // Model + history, for attaching duplicate requests
+    int background;             // Result is kept for the job tools after completion
+    int waiters;                // Foreground callers that have not been answered yet
+    int cost_claimed;           // Cost already reported to one waiter
+    int abandoned;              // Every waiter was cancelled; polling should stop
+    ResearchJobStatus status;
+    int polls;
+    long long submitted_ms;
+    long long finished_ms;
+    char *result;
+    ResearchBill bill;          // Billed for the completed request
+    JobWaiter *wait_list;       // Registered waiters not yet woken
+    int waking;                 // Taken off wait_list by finish, not yet woken
+    struct ResearchJob *next;
+};
+
+static pthread_mutex_t jobs_lock = PTHREAD_MUTEX_INITIALIZER;
+static ResearchJob *jobs = NULL;
+
+static void free_job(ResearchJob *job) {
+    free(job->request_id);
+    free(job->result);
+    free(job);
+}
+
+// Unlink a job; caller holds jobs_lock
+static void unlink_job(ResearchJob *job) {
+    for (ResearchJob **slot = &jobs; *slot; slot = &(*slot)->next) {
+        if (*slot == job) {
+            *slot = job->next;
+            return;
+        }
+    }
+}
+
+// Drop expired finished jobs and cap how many are retained. Jobs with
+// waiters still to wake are kept; the last foreground waiter frees them.
+// Caller holds jobs_lock.
+static void purge_finished_jobs(long long now) {
+    int finished = 0;
+    ResearchJob **slot = &jobs;
+
+    while (*slot) {
+        ResearchJob *job = *slot;
+        if (job->status != RESEARCH_JOB_IN_PROGRESS && job->background && job->waiters == 0 &&
+            !job->wait_list && job->waking == 0 && (now - job->finished_ms > JOB_RETENTION_MS || finished >= MAX_FINISHED_JOBS)) {
+            *slot = job->next;
+            free_job(job);
+            continue;
+        }
+        if (job->status != RESEARCH_JOB_IN_PROGRESS) finished++;
+        slot = &job->next;
+    }
+}
+
+static ResearchJob *find_job(const char *request_id) {
+    for (ResearchJob *job = jobs; job; job = job->next) {
+        if (strcmp(job->request_id, request_id) == 0) return job;
+    }
+    return NULL;
+}
+
+ResearchJob *research_job_create(const char *request_id, int background, const CacheKey *key) {
+    ResearchJob *job = calloc(1, sizeof(ResearchJob));
+    if (!job) return NULL;
+
+    job->request_id = strdup(request_id);
+    if (!job->request_id) {
+        free(job);
+        return NULL;
+    }
+    job->key = *key;
+    job->background = background;
+    job->waiters = background ? 0 : 1;
+    job->status = RESEARCH_JOB_IN_PROGRESS;
+    job->submitted_ms = event_loop_now_ms();
+
+    pthread_mutex_lock(&jobs_lock);
+    purge_finished_jobs(job->submitted_ms);
+    job->next = jobs;
+    jobs = job;
+    pthread_mutex_unlock(&jobs_lock);
+
+    return job;
+}
+
+// Attach to an in-progress job for the same model and history instead of
+// submitting a duplicate. Foreground callers must then research_job_wait().
+ResearchJob *research_job_attach(const CacheKey *key, int background, char **request_id) {
+    pthread_mutex_lock(&jobs_lock);
+    for (ResearchJob *job = jobs; job; job = job->next) {
+        if (job->status != RESEARCH_JOB_IN_PROGRESS ||
+            job->key.lo != key->lo || job->key.hi != key->hi) {
+            continue;
+        }
+
+        if (background) {
+            job->background = 1;
+        } else {
+            job->waiters++;
+        }
+        job->abandoned = 0;
+        if (request_id) *request_id = strdup(job->request_id);
+        pthread_mutex_unlock(&jobs_lock);
+        return job;
+    }
+    pthread_mutex_unlock(&jobs_lock);
+    return NULL;
+}
+
+void research_job_note_poll(ResearchJob *job) {
+    pthread_mutex_lock(&jobs_lock);
+    job->polls++;
+    pthread_mutex_unlock(&jobs_lock);
+}
+
+// Answer a waiter, either taken off the wait list by finish (taken) or still
+// on it when its watch fired: with the outcome of a finished job, or
+// empty-handed when its call expired first
+static void wake_waiter(JobWaiter *waiter, int taken) {
+    ResearchJob *job = waiter->job;
+    ResearchJobStatus status = RESEARCH_JOB_IN_PROGRESS;
+    ResearchBill bill;
+    memset(&bill, 0, sizeof(bill));
+    char *result = NULL;
+    int release = 0;
+
+    pthread_mutex_lock(&jobs_lock);
+    if (taken) {
+        job->waking--;
+    } else {
+        for (JobWaiter **slot = &job->wait_list; *slot; slot = &(*slot)->next) {
+            if (*slot == waiter) {
+                *slot = waiter->next;
+                break;
+            }
+        }
+    }
+
+    if (job->status == RESEARCH_JOB_IN_PROGRESS) {
+        // A waiter whose call expires gives up. If it was cancelled and nobody
+        // else wants the report the job is abandoned; if its deadline passed
+        // the job carries on in the background, so the report can still be
+        // fetched by request_id and is cached when it lands.
+        if (waiter->foreground) {
+            job->waiters--;
+            if (!cancel_token_cancelled(waiter->cancel)) {
+                job->background = 1;
+            } else if (job->waiters == 0 && !job->background) {
+                job->abandoned = 1;
+            }
+        }
+    } else {
+        status = job->status;
+        result = job->result ? strdup(job->result) : NULL;
+        if (!waiter->foreground) {
+            bill = job->bill;
+        } else {
+            // The bill goes to the first foreground waiter only
+            if (!job->cost_claimed) bill = job->bill;
+            job->cost_claimed = 1;
+            release = --job->waiters == 0 && !job->background;
+            if (release) unlink_job(job);
+        }
+    }
+    pthread_mutex_unlock(&jobs_lock);
+
+    waiter->on_done(status, result, &bill, waiter->userdata);
+    free(waiter);
+    if (release) free_job(job);
+}
+
+// Watch expiry (event loop thread): the waiter is still on the list
+static void waiter_expired(void *userdata) {
+    wake_waiter((JobWaiter *)userdata, 0);
+}
+
+// Register a waiter; caller holds jobs_lock. Returns 0 if it must be woken
+// right away instead (the job is finished or its call already expired).
+static int add_waiter(ResearchJob *job, JobWaiter *waiter, long long until_ms) {
+    if (job->status != RESEARCH_JOB_IN_PROGRESS || cancel_token_expired(waiter->cancel)) return 0;
+    if (until_ms > 0 && event_loop_now_ms() >= until_ms) return 0;
+
+    waiter->next = job->wait_list;
+    job->wait_list = waiter;
+    // Without the loop nothing expires the wait; the job still finishes
+    (void)cancel_watch(&waiter->watch, waiter->cancel, until_ms, waiter_expired, waiter);
+    return 1;
+}
+
+// Record the outcome; takes ownership of result, and wakes the waiters whose
+// watch has not fired yet (those that fired wake themselves). An abandoned
+// job nobody waits for any more is freed instead.
+void research_job_finish(ResearchJob *job, ResearchJobStatus status, char *result, const ResearchBill *bill) {
+    JobWaiter *ready = NULL;
+
+    pthread_mutex_lock(&jobs_lock);
+    job->status = status;
+    job->result = result;
+    if (bill) job->bill = *bill;
+    job->finished_ms = event_loop_now_ms();
+    JobWaiter **slot = &job->wait_list;
+    while (*slot) {
+        JobWaiter *waiter = *slot;
+        if (cancel_unwatch(&waiter->watch)) {
+            *slot = waiter->next;
+            waiter->next = ready;
+            ready = waiter;
+            job->waking++;
+        } else {
+            slot = &waiter->next;
+        }
+    }
+    // Logged under the lock: once it is released a purge may free the job
+    if (job->background) {
+        (void)fprintf(stderr, "Background research %s finished: %s\n",
+                      job->request_id, research_job_status_name(status));
+    }
+    int drop = job->abandoned && job->waiters == 0 && !job->background && !job->wait_list && job->waking == 0;
+    if (drop) unlink_job(job);
+    pthread_mutex_unlock(&jobs_lock);
+
+    if (drop) {
+        free_job(job);
+        return;
+    }
+    while (ready) {
+        JobWaiter *waiter = ready;
+        ready = waiter->next;
+        wake_waiter(waiter, 1);
+    }
+}
+
+void research_job_wait(ResearchJob *job, const CancelToken *cancel, research_wait_fn on_done, void *userdata) {
+    JobWaiter *waiter = calloc(1, sizeof(JobWaiter));
+    if (!waiter) {
+        ResearchBill bill;
+        memset(&bill, 0, sizeof(bill));
+        on_done(RESEARCH_JOB_IN_PROGRESS, NULL, &bill, userdata);
+        return;
+    }
+    waiter->job = job;
+    waiter->foreground = 1;
+    waiter->cancel = cancel;
+    waiter->on_done = on_done;
+    waiter->userdata = userdata;
+
+    pthread_mutex_lock(&jobs_lock);
+    int added = add_waiter(job, waiter, 0);
+    pthread_mutex_unlock(&jobs_lock);
+    if (!added) wake_waiter(waiter, 0);
+}
+
+int research_job_await(const char *request_id, const CancelToken *cancel, long long timeout_ms,
+                       research_wait_fn on_done, void *userdata) {
+    JobWaiter *waiter = calloc(1, sizeof(JobWaiter));
+    if (!waiter) return -1;
+    waiter->cancel = cancel;
+    waiter->on_done = on_done;
+    waiter->userdata = userdata;
+
+    pthread_mutex_lock(&jobs_lock);
+    ResearchJob *job = find_job(request_id);
+    if (!job) {
+        pthread_mutex_unlock(&jobs_lock);
+        free(waiter);
+        return -1;
+    }
+    waiter->job = job;
+    // Count as waking until answered, so a purge keeps the job
+    int added = add_waiter(job, waiter, event_loop_now_ms() + (timeout_ms > 0 ? timeout_ms : 0));
+    if (!added) job->waking++;
+    pthread_mutex_unlock(&jobs_lock);
+
+    if (!added) wake_waiter(waiter, 1);
+    return 0;
+}
+
+// The report is wanted after the job finishes (a background request, or a
+// waiter whose deadline passed)
+int research_job_is_background(ResearchJob *job) {
+    pthread_mutex_lock(&jobs_lock);
+    int background = job->background;
+    pthread_mutex_unlock(&jobs_lock);
+    return background;
+}
+
+// Remove a job every waiter has given up on; returns 1 if it was removed and
+// its poller should stop
+int research_job_drop_abandoned(ResearchJob *job) {
+    pthread_mutex_lock(&jobs_lock);
+    int drop = job->abandoned && job->waiters == 0 && !job->background && !job->wait_list && job->waking == 0;
+    if (drop) unlink_job(job);
+    pthread_mutex_unlock(&jobs_lock);
+
+    if (drop) free_job(job);
+    return drop;
+}
+
+// Fill info from job; caller holds jobs_lock
+static void snapshot_job(const ResearchJob *job, ResearchJobInfo *info) {
+    info->status = job->status;
+    info->polls = job->polls;
+    if (job->status == RESEARCH_JOB_IN_PROGRESS) {
+        info->elapsed_ms = event_loop_now_ms() - job->submitted_ms;
+    } else {
+        info->elapsed_ms = job->finished_ms - job->submitted_ms;
+        info->bill = job->bill;
+        if (job->result) info->result = strdup(job->result);
+    }
+}
+
+// Look up a job by request id; returns 0 if found. info->result must be freed.
+int research_job_lookup(const char *request_id, ResearchJobInfo *info) {
+    memset(info, 0, sizeof(*info));
+
+    pthread_mutex_lock(&jobs_lock);
+    ResearchJob *job = find_job(request_id);
+    if (!job) {
+        pthread_mutex_unlock(&jobs_lock);
+        return -1;
+    }
+    snapshot_job(job, info);
+    pthread_mutex_unlock(&jobs_lock);
+
+    return 0;
+}
+
+const char *research_job_status_name(ResearchJobStatus status) {
+    switch (status) {
+        case RESEARCH_JOB_IN_PROGRESS: return "IN_PROGRESS";
+        case RESEARCH_JOB_COMPLETED: return "COMPLETED";
+        case RESEARCH_JOB_FAILED: return "FAILED";
+        case RESEARCH_JOB_TIMED_OUT: return "TIMED_OUT";
+        case RESEARCH_JOB_NOT_FOUND: return "NOT_FOUND";
+    }
+    return "UNKNOWN";
+}
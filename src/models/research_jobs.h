@@ -0,0 +1,60 @@
+#ifndef RESEARCH_JOBS_H
+#define RESEARCH_JOBS_H
+
+#include "../response_cache.h"
+#include "../cancel.h"
+#include "../../include/usage.h"
+
+// Lifecycle of a submitted deep research request
+typedef enum {
+    RESEARCH_JOB_IN_PROGRESS = 0,
+    RESEARCH_JOB_COMPLETED,
+    RESEARCH_JOB_FAILED,
+    RESEARCH_JOB_TIMED_OUT,
+    RESEARCH_JOB_NOT_FOUND      // Unknown to this server and the API
+} ResearchJobStatus;
+
+// What a finished job was billed
+typedef struct {
+    double cost;            // USD
+    UsageInfo usage;
+} ResearchBill;
+
+// Snapshot of a job for the status/result tools
+typedef struct {
+    ResearchJobStatus status;
+    int polls;
+    long long elapsed_ms;   // Since submission (or until completion once finished)
+    char *result;           // Copy of the report/error text when finished, else NULL
+    ResearchBill bill;      // Once finished
+} ResearchJobInfo;
+
+typedef struct ResearchJob ResearchJob;
+
+// Outcome of a wait: result is a malloc'd copy of the report or error text,
+// NULL with status IN_PROGRESS when the wait expired before the job finished
+typedef void (*research_wait_fn)(ResearchJobStatus status, char *result, const ResearchBill *bill, void *userdata);
+
+// Registry of deep research jobs keyed by Perplexity request id
+ResearchJob *research_job_create(const char *request_id, int background, const CacheKey *key);
+ResearchJob *research_job_attach(const CacheKey *key, int background, char **request_id);
+void research_job_note_poll(ResearchJob *job);
+void research_job_finish(ResearchJob *job, ResearchJobStatus status, char *result, const ResearchBill *bill);
+int research_job_is_background(ResearchJob *job);
+int research_job_drop_abandoned(ResearchJob *job);
+int research_job_lookup(const char *request_id, ResearchJobInfo *info);
+const char *research_job_status_name(ResearchJobStatus status);
+
+// Waits hold no thread. on_done runs once: on the thread that finishes the
+// job, on the event loop thread when cancel expires (or timeout_ms passes)
+// first, or right away when the job is already finished.
+//
+// research_job_wait is for foreground callers of create/attach; the bill is
+// reported to the first of them and the last one removes the job unless a
+// background request also holds it. research_job_await waits for the report
+// of a background job by request id; returns -1 if the job is unknown.
+void research_job_wait(ResearchJob *job, const CancelToken *cancel, research_wait_fn on_done, void *userdata);
+int research_job_await(const char *request_id, const CancelToken *cancel, long long timeout_ms,
+                       research_wait_fn on_done, void *userdata);
+
+#endif
@@ -1,111 +1,275 @@
 #define GNU_SOURCE
 #include "sync_models.h"
 #include "../http_client.h"
+#include "../json_utils.h"
+#include "chat_payload.h"
+#include "../sse_parser.h"
+#include "../response_decoder.h"
+#include "../event_loop.h"
+#include "../ledger.h"
+#include "../admission.h"
+#include "../worker_pool.h"
+#include "model_stats.h"
 #include "../../include/usage.h"  // Add this include
 #include "../../include/constants.h"
 #include <curl/curl.h>
-#include <cjson/cJSON.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-// Perform sync chat completion request
-static char *perform_sync_chat_completion(MessageArray *msg_array, const char *model) {
-    if (!msg_array || !model) return NULL;
+// Partial content is forwarded at most this often while streaming
+#define STREAM_PROGRESS_INTERVAL_MS 100
 
-    CURL *curl = curl_easy_init();
-    if (!curl) return NULL;
+// State for one streamed (SSE) completion
+typedef struct {
+    SSEParser parser;
+    CURL *curl;
+    HTTPResponse *content;      // Aggregated delta text
+    HTTPResponse *raw;          // Raw body, kept for error reporting on non-200
+    DecodedResponse summary;    // Usage and citations from the latest chunks that carried them
+    const char *progress_token;
+    size_t notified_len;        // Bytes of content already forwarded to the client
+    long long last_notify_ms;
+    int notifications;
+} StreamState;
 
-    HTTPResponse *response = init_http_response();
+// Forward content received since the last notification
+static void flush_stream_progress(StreamState *state, int force) {
+    size_t pending = state->content->size - state->notified_len;
+    if (pending == 0) return;
 
-    // Build JSON payload
-    cJSON *root = cJSON_CreateObject();
-    cJSON_AddStringToObject(root, "model", model);
-    cJSON *messages_json = cJSON_CreateArray();
+    long long now = event_loop_now_ms();
+    if (!force && state->notifications > 0 && now - state->last_notify_ms < STREAM_PROGRESS_INTERVAL_MS) {
+        return;
+    }
 
-    for (int i = 0; i < msg_array->count; i++) {
-        if (msg_array->messages[i].role && msg_array->messages[i].content) {
-            cJSON *msg_obj = cJSON_CreateObject();
-            cJSON_AddStringToObject(msg_obj, "role", msg_array->messages[i].role);
-            cJSON_AddStringToObject(msg_obj, "content", msg_array->messages[i].content);
-            cJSON_AddItemToArray(messages_json, msg_obj);
-        }
+    send_progress_notification(state->progress_token, (double)state->content->size,
+                               state->content->memory + state->notified_len);
+    state->notified_len = state->content->size;
+    state->last_notify_ms = now;
+    state->notifications++;
+}
+
+// One SSE event: a chat.completion.chunk, or the [DONE] sentinel
+static void handle_stream_event(const char *data, size_t len, void *userdata) {
+    StreamState *state = (StreamState *)userdata;
+    if (len == 6 && memcmp(data, "[DONE]", 6) == 0) return;
+
+    DecodedResponse chunk;
+    if (decode_response(data, len, &chunk) != 0) {
+        free_decoded_response(&chunk);
+        return;
     }
-    cJSON_AddItemToObject(root, "messages", messages_json);
 
-    char *data = cJSON_Print(root);
+    if (chunk.content && chunk.content[0] != '\0') {
+        WriteMemoryCallback(chunk.content, 1, strlen(chunk.content), state->content);
+    }
 
-    struct curl_slist *headers = NULL;
-    char auth_header[1024];
-    (void)snprintf(auth_header, sizeof(auth_header), "Authorization: Bearer %s", get_api_key());
+    // Keep the latest usage and citations; they usually arrive with the last chunk
+    if (chunk.has_usage) {
+        state->summary.usage = chunk.usage;
+        state->summary.has_usage = 1;
+    }
+    if (chunk.citation_count > 0) {
+        for (int i = 0; i < state->summary.citation_count; i++) free(state->summary.citations[i]);
+        free(state->summary.citations);
+        state->summary.citations = chunk.citations;
+        state->summary.citation_count = chunk.citation_count;
+        chunk.citations = NULL;
+        chunk.citation_count = 0;
+    }
+    free_decoded_response(&chunk);
 
-    headers = curl_slist_append(headers, "Content-Type: application/json");
-    headers = curl_slist_append(headers, auth_header);
+    flush_stream_progress(state, 0);
+}
 
-    curl_easy_setopt(curl, CURLOPT_URL, API_URL);
-    curl_easy_setopt(curl, CURLOPT_POST, 1L);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, data);
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)response);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 60L);
-    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
+// curl write callback for streamed responses
+static size_t StreamWriteCallback(const void *contents, size_t size, size_t nmemb, void *userp) {
+    size_t realsize = size * nmemb;
+    StreamState *state = (StreamState *)userp;
 
-    CURLcode res = curl_easy_perform(curl);
+    long http_code = 0;
+    curl_easy_getinfo(state->curl, CURLINFO_RESPONSE_CODE, &http_code);
+    if (http_code != 200) {
+        return WriteMemoryCallback(contents, size, nmemb, state->raw);
+    }
+
+    if (sse_parser_feed(&state->parser, (const char *)contents, realsize) != 0) {
+        (void)fprintf(stderr, "Not enough memory for streamed response\n");
+        return 0;
+    }
+    return realsize;
+}
+
+// Log usage/cost from a completion (or final stream chunk), add it to the
+// call and to the cost ledger
+static void record_usage(const UsageInfo *usage, const char *model, RequestContext *ctx) {
+    CostInfo cost;
+    int priced = calculate_cost(usage, model, &cost) == 0;
+    usage_add(&ctx->usage, usage);
+    if (priced) {
+        ctx->cost += cost.total_cost;
+        log_usage_and_cost(model, usage, &cost);
+    }
+    ledger_record(model, ledger_tool_index(ctx->tool_name), usage, priced ? &cost : NULL);
+    model_stats_record_usage(model, usage);
+}
+
+// One chat completion in flight. The worker that starts it moves on; the
+// transfer runs on the event loop and the answer is decoded on the pool.
+typedef struct {
+    const ModelDescriptor *descriptor;
+    RequestContext *ctx;
+    CURL *curl;
+    HTTPResponse *response;
+    ChatPayload payload;
+    struct curl_slist *headers;
+    int stream;
+    StreamState state;
+    AdmissionResult admitted;
+    CURLcode res;
+    call_done_fn on_done;
+    void *userdata;
+} ChatCall;
+
+static void free_chat_call(ChatCall *call) {
+    if (call->stream) {
+        sse_parser_free(&call->state.parser);
+        free_http_response(call->state.content);
+        free_decoded_response(&call->state.summary);
+    }
+    chat_payload_free(&call->payload);
+    curl_slist_free_all(call->headers);
+    http_client_release(call->curl);
+    free_http_response(call->response);
+    free(call);
+}
+
+// Decode the finished transfer and hand the answer on (worker thread)
+static void finish_chat_call(void *arg) {
+    ChatCall *call = (ChatCall *)arg;
+    RequestContext *ctx = call->ctx;
+    const char *model = call->descriptor->name;
+    AdmissionResult admitted = call->admitted;
+    CURLcode res = call->res;
+    StreamState *state = &call->state;
+    long http_code = 0;
 
     char *answer = NULL;
-    if (res != CURLE_OK) {
+    if (admitted == ADMISSION_CIRCUIT_OPEN || admitted == ADMISSION_THROTTLED) {
+        (void)fprintf(stderr, "%s call not sent: %s\n", model, admission_error(admitted, res, 0));
+    } else if (admitted == ADMISSION_EXPIRED) {
+        (void)fprintf(stderr, "%s call cancelled while waiting for a rate limit token\n", model);
+    } else if (res != CURLE_OK) {
         (void)fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
     } else {
-        long http_code = 0;
-        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
-        if (http_code == 200) {
-            cJSON *json_res = cJSON_Parse(response->memory);
-            if (json_res) {
-                cJSON *choices = cJSON_GetObjectItem(json_res, "choices");
-                if (cJSON_IsArray(choices) && cJSON_GetArraySize(choices) > 0) {
-                    cJSON *first = cJSON_GetArrayItem(choices, 0);
-                    cJSON *msg = cJSON_GetObjectItem(first, "message");
-                    cJSON *content = cJSON_GetObjectItem(msg, "content");
-                    if (cJSON_IsString(content)) {
-                        answer = strdup(content->valuestring);
-                    }
-                }
+        curl_easy_getinfo(call->curl, CURLINFO_RESPONSE_CODE, &http_code);
+        if (http_code == 200 && call->stream) {
+            sse_parser_finish(&state->parser);
+            flush_stream_progress(state, 1);
 
-                // NEW: Parse and log usage/cost
-                UsageInfo *usage = parse_usage_from_response(response->memory);
-                if (usage) {
-                    CostInfo *cost = calculate_cost(usage, model);
-                    if (cost) {
-                        log_usage_and_cost(model, usage, cost);
-                        free_cost_info(cost);
-                    }
-                    free_usage_info(usage);
-                }
+            if (state->content->size > 0) {
+                state->summary.content = strdup(state->content->memory);
+                answer = take_content_with_citations(&state->summary);
+                ctx->complete = answer != NULL;
+            }
+            if (state->summary.has_usage) {
+                record_usage(&state->summary.usage, model, ctx);
+            }
+            (void)fprintf(stderr, "Streamed %zu bytes in %d progress notifications\n",
+                          state->content->size, state->notifications);
+        } else if (http_code == 200) {
+            // One pass pulls out content, citations and usage
+            DecodedResponse decoded;
+            if (decode_response(call->response->memory, call->response->size, &decoded) == 0) {
+                answer = take_content_with_citations(&decoded);
+                ctx->complete = answer != NULL;
 
-                cJSON_Delete(json_res);
+                if (decoded.has_usage) {
+                    record_usage(&decoded.usage, model, ctx);
+                }
             }
+            free_decoded_response(&decoded);
         } else {
             (void)fprintf(stderr, "HTTP response code: %ld\n", http_code);
-            if (response->memory) {
-                (void)fprintf(stderr, "Response body: %s\n", response->memory);
+            if (call->response->memory) {
+                (void)fprintf(stderr, "Response body: %s\n", call->response->memory);
             }
         }
     }
+    if (!answer) ctx->error = admission_error(admitted, res, http_code);
 
-    free(data);
-    curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
-    cJSON_Delete(root);
-    free_http_response(response);
-
-    return answer;
+    call_done_fn on_done = call->on_done;
+    void *userdata = call->userdata;
+    free_chat_call(call);
+    on_done(answer, userdata);
 }
 
-char *execute_sonar_pro(MessageArray *msg_array) {
-    return perform_sync_chat_completion(msg_array, "sonar-pro");
+// Admission settled (event loop thread): decoding belongs on the pool
+static void chat_transfer_done(CURL *curl, AdmissionResult admitted, CURLcode res, void *userdata) {
+    (void)curl;
+    ChatCall *call = (ChatCall *)userdata;
+    call->admitted = admitted;
+    call->res = res;
+    worker_pool_dispatch(finish_chat_call, call);
 }
 
-char *execute_sonar_reasoning_pro(MessageArray *msg_array) {
-    return perform_sync_chat_completion(msg_array, "sonar-reasoning-pro");
+// Start a chat completion request. With a progress token the completion is
+// streamed and partial content is forwarded as notifications/progress.
+void execute_chat_model(const ModelDescriptor *descriptor, MessageArray *msg_array, RequestContext *ctx,
+                        call_done_fn on_done, void *userdata) {
+    ChatCall *call = msg_array && descriptor ? calloc(1, sizeof(ChatCall)) : NULL;
+    if (!call) {
+        on_done(NULL, userdata);
+        return;
+    }
+    const char *model = descriptor->name;
+    call->descriptor = descriptor;
+    call->ctx = ctx;
+    call->on_done = on_done;
+    call->userdata = userdata;
+    call->stream = ctx->progress_token != NULL;
+
+    call->curl = http_client_acquire();
+    call->response = init_http_response();
+
+    // Compact body, serialized straight from the message array
+    ChatPayloadSpec spec = {model, msg_array, NULL, call->stream, 0};
+    if (!call->curl || !call->response || chat_payload_init(&call->payload, &spec) != 0) {
+        call->stream = 0;
+        free_chat_call(call);
+        on_done(NULL, userdata);
+        return;
+    }
+    CURL *curl = call->curl;
+
+    char auth_header[1024];
+    (void)snprintf(auth_header, sizeof(auth_header), "Authorization: Bearer %s", get_api_key());
+
+    call->headers = curl_slist_append(call->headers, "Content-Type: application/json");
+    call->headers = curl_slist_append(call->headers, auth_header);
+
+    curl_easy_setopt(curl, CURLOPT_URL, get_api_url());
+    chat_payload_attach(curl, &call->payload);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
+
+    if (call->stream) {
+        StreamState *state = &call->state;
+        state->curl = curl;
+        state->content = init_http_response();
+        state->raw = call->response;
+        state->progress_token = ctx->progress_token;
+        sse_parser_init(&state->parser, handle_stream_event, state);
+
+        call->headers = curl_slist_append(call->headers, "Accept: text/event-stream");
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, StreamWriteCallback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)state);
+    } else {
+        http_response_attach(curl, call->response);
+    }
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, call->headers);
+
+    // Waits for a rate limit token and retries transient failures
+    AdmissionSpec admission = {model, ADMISSION_REQUEST, ctx->cancel, descriptor->timeout_ms, call->response};
+    admission_submit(curl, &admission, chat_transfer_done, call);
 }
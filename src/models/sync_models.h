@@ -2,8 +2,13 @@
 #define SYNC_MODELS_H
 
 #include "../../include/types.h"
+#include "../registry.h"
 
-char *execute_sonar_pro(MessageArray *msg_array);
-char *execute_sonar_reasoning_pro(MessageArray *msg_array);
+// One chat completion with a /chat/completions model, streamed when the
+// call has a progress token. on_done runs once with the answer, on a pool
+// worker (or on this thread when the call cannot be started); msg_array and
+// ctx must stay alive until then.
+void execute_chat_model(const ModelDescriptor *model, MessageArray *msg_array, RequestContext *ctx,
+                        call_done_fn on_done, void *userdata);
 
 #endif
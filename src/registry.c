@@ -0,0 +1,246 @@
+#define GNU_SOURCE
+#include "registry.h"
+#include "buffer.h"
+#include "../include/constants.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Schema fragments shared by the tools that take a conversation
+#define MESSAGES_PROPERTY "\"messages\":{\"type\":\"array\"}"
+#define CACHE_PROPERTY \
+    "\"cache\":{\"type\":\"boolean\",\"description\":\"Set to false to skip cached answers for identical questions\"}"
+#define DEADLINE_PROPERTY \
+    "\"deadline_ms\":{\"type\":\"number\",\"description\":\"Give up after this many milliseconds; slower models " \
+    "are skipped and deep research still running then continues in the background\"}"
+#define MAX_COST_PROPERTY \
+    "\"max_cost_usd\":{\"type\":\"number\",\"description\":\"Maximum expected cost in USD; pricier models are skipped\"}"
+#define BACKGROUND_PROPERTY \
+    "\"background\":{\"type\":\"boolean\",\"description\":\"Return a request_id immediately and keep researching " \
+    "in the background\"}"
+#define HEDGE_PROPERTY \
+    "\"hedge\":{\"type\":\"boolean\",\"description\":\"Run deep research and sonar-pro together: answer with the " \
+    "deep report if it lands within deadline_ms (default 30s), else with sonar-pro and a request_id for the " \
+    "report. Defaults to on for borderline queries with a deadline_ms\"}"
+#define ROUTING_PROPERTIES CACHE_PROPERTY "," DEADLINE_PROPERTY "," MAX_COST_PROPERTY
+
+#define OBJECT_SCHEMA(properties, required) \
+    "{\"type\":\"object\",\"properties\":{" properties "}" required "}"
+#define REQUIRED(name) ",\"required\":[\"" name "\"]"
+
+#define REQUEST_ID_SCHEMA OBJECT_SCHEMA("\"request_id\":{\"type\":\"string\"}", REQUIRED("request_id"))
+
+#define BATCH_ITEMS_PROPERTY \
+    "\"items\":{\"type\":\"array\",\"description\":\"Queries as {messages, tool?, model?, cache?, " \
+    "max_cost_usd?}; tool is perplexity_ask (default), perplexity_research, perplexity_reason or " \
+    "perplexity_deep_research, model is sonar-pro, sonar-reasoning-pro or sonar-deep-research\"," \
+    "\"items\":{\"type\":\"object\"}}"
+#define BATCH_CONCURRENCY_PROPERTY \
+    "\"max_concurrency\":{\"type\":\"number\",\"description\":\"Queries in flight at once (default 4, at most 16)\"}"
+
+// Listed in this order by tools/list; indexed by ToolId
+static const ToolDescriptor TOOLS[TOOL_COUNT] = {
+    {TOOL_ASK, "perplexity_ask",
+     "Fast search and Q&A using Sonar Pro model with real-time web search and citations",
+     OBJECT_SCHEMA(MESSAGES_PROPERTY "," ROUTING_PROPERTIES, REQUIRED("messages")),
+     TOOL_ROUTED | TOOL_BATCHABLE},
+    {TOOL_RESEARCH, "perplexity_research",
+     "Comprehensive research and analysis with intelligent routing - uses fast models for simple queries, "
+     "deep research for complex topics (auto-detects complexity)",
+     OBJECT_SCHEMA(MESSAGES_PROPERTY "," ROUTING_PROPERTIES "," BACKGROUND_PROPERTY "," HEDGE_PROPERTY,
+                   REQUIRED("messages")),
+     TOOL_ROUTED | TOOL_BATCHABLE},
+    {TOOL_REASON, "perplexity_reason",
+     "Advanced reasoning and multi-step analysis using Sonar Reasoning Pro with chain-of-thought processing",
+     OBJECT_SCHEMA(MESSAGES_PROPERTY "," ROUTING_PROPERTIES, REQUIRED("messages")),
+     TOOL_ROUTED | TOOL_BATCHABLE},
+    {TOOL_DEEP_RESEARCH, "perplexity_deep_research",
+     "Force deep research analysis using Sonar Deep Research model for comprehensive reports "
+     "(2-5 minutes, use only for complex research tasks)",
+     OBJECT_SCHEMA(MESSAGES_PROPERTY "," CACHE_PROPERTY "," BACKGROUND_PROPERTY "," DEADLINE_PROPERTY,
+                   REQUIRED("messages")),
+     TOOL_ROUTED | TOOL_BATCHABLE},
+    {TOOL_RESEARCH_STATUS, "perplexity_research_status",
+     "Check the status of a background deep research request started with background=true",
+     REQUEST_ID_SCHEMA, 0},
+    {TOOL_RESEARCH_RESULT, "perplexity_research_result",
+     "Fetch the report of a background deep research request; returns its status if it is still running",
+     REQUEST_ID_SCHEMA, 0},
+    {TOOL_BATCH, "perplexity_batch",
+     "Run up to 64 independent queries concurrently and return their results in order as JSON, each with its "
+     "own error, model, usage and cost; items take the arguments of perplexity_ask plus an optional tool and model, "
+     "and share the deadline_ms of the batch",
+     OBJECT_SCHEMA(BATCH_ITEMS_PROPERTY "," BATCH_CONCURRENCY_PROPERTY "," DEADLINE_PROPERTY, REQUIRED("items")),
+     0},
+    {TOOL_STATS, "perplexity_stats",
+     "Server latency metrics as JSON: per-tool latency and queue wait, per-model HTTP phase timings (DNS, connect, "
+     "TLS, TTFB, transfer) and deep research poll counts, plus token and dollar spend per model and tool from the "
+     "cost ledger, the live per-model estimates used for routing, and rate limiter, retry and circuit breaker state",
+     OBJECT_SCHEMA("", ""), TOOL_INLINE},
+};
+
+// Indexed by ModelId; usage_index must match the pricing table in usage.c.
+static const ModelDescriptor MODELS[MODEL_COUNT] = {
+    {MODEL_SONAR, "sonar", 0, MODEL_ENDPOINT_CHAT, 60000L, NULL, 0},
+    {MODEL_SONAR_PRO, "sonar-pro", 1, MODEL_ENDPOINT_CHAT, 60000L, NULL, 1},
+    {MODEL_SONAR_REASONING, "sonar-reasoning", 2, MODEL_ENDPOINT_CHAT, 60000L, NULL, 0},
+    {MODEL_SONAR_REASONING_PRO, "sonar-reasoning-pro", 3, MODEL_ENDPOINT_CHAT, 60000L, NULL, 1},
+    {MODEL_SONAR_DEEP_RESEARCH, "sonar-deep-research", 4, MODEL_ENDPOINT_ASYNC, 30000L, "medium", 1},
+};
+
+static const char *const METHODS[METHOD_COUNT] = {
+    "initialize", "tools/list", "tools/call", "notifications/cancelled"
+};
+
+#define INITIALIZE_INSTRUCTIONS \
+    "Perplexity MCP Server with intelligent model routing: Ask (fast), Research (smart async), Reason (detailed)"
+
+// Perfect hash over a fixed name set: FNV-1a with a seed chosen at startup
+// so that no two names share a slot. A lookup is one hash and one compare.
+#define INDEX_SLOTS 64
+#define INDEX_MAX_SEEDS 100000
+
+typedef const char *(*NameAt)(int index);
+
+typedef struct {
+    uint32_t seed;
+    signed char slots[INDEX_SLOTS];     // Entry, or -1
+    NameAt name_at;
+} NameIndex;
+
+static NameIndex method_index;
+static NameIndex tool_index;
+static NameIndex model_index;
+static Buffer initialize_result;
+static Buffer tools_list_result;
+static int registry_ready = -1;
+static pthread_once_t registry_once = PTHREAD_ONCE_INIT;
+
+static const char *method_name_at(int index) {
+    return METHODS[index];
+}
+
+static const char *tool_name_at(int index) {
+    return TOOLS[index].name;
+}
+
+static const char *model_name_at(int index) {
+    return MODELS[index].name;
+}
+
+static uint32_t name_hash(const char *name, size_t len, uint32_t seed) {
+    uint32_t hash = 2166136261u ^ seed;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+    return hash ^ (hash >> 15);
+}
+
+static int index_build(NameIndex *index, NameAt name_at, int count) {
+    index->name_at = name_at;
+    for (uint32_t seed = 0; seed < INDEX_MAX_SEEDS; seed++) {
+        memset(index->slots, -1, sizeof(index->slots));
+        int i = 0;
+        for (; i < count; i++) {
+            const char *name = name_at(i);
+            uint32_t slot = name_hash(name, strlen(name), seed) % INDEX_SLOTS;
+            if (index->slots[slot] >= 0) break;
+            index->slots[slot] = (signed char)i;
+        }
+        if (i == count) {
+            index->seed = seed;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int index_find(const NameIndex *index, const char *name, size_t len) {
+    int entry = index->slots[name_hash(name, len, index->seed) % INDEX_SLOTS];
+    if (entry < 0) return -1;
+    const char *candidate = index->name_at(entry);
+    return strlen(candidate) == len && memcmp(candidate, name, len) == 0 ? entry : -1;
+}
+
+static int build_initialize_result(Buffer *out) {
+    buffer_append_str(out, "{\"protocolVersion\":\"" PROTOCOL_VERSION "\","
+                           "\"capabilities\":{\"tools\":{\"listChanged\":true}},"
+                           "\"serverInfo\":{\"name\":\"" SERVER_NAME "\",\"version\":\"" SERVER_VERSION "\"},"
+                           "\"instructions\":");
+    buffer_append_json_string(out, INITIALIZE_INSTRUCTIONS);
+    return buffer_append_str(out, "}");
+}
+
+static int build_tools_list_result(Buffer *out) {
+    buffer_append_str(out, "{\"tools\":[");
+    for (int i = 0; i < TOOL_COUNT; i++) {
+        buffer_append_str(out, i ? ",{\"name\":" : "{\"name\":");
+        buffer_append_json_string(out, TOOLS[i].name);
+        buffer_append_str(out, ",\"description\":");
+        buffer_append_json_string(out, TOOLS[i].description);
+        buffer_append_str(out, ",\"inputSchema\":");
+        buffer_append_str(out, TOOLS[i].input_schema);
+        buffer_append_str(out, "}");
+    }
+    return buffer_append_str(out, "]}");
+}
+
+static void build_registry(void) {
+    buffer_init(&initialize_result);
+    buffer_init(&tools_list_result);
+    if (index_build(&method_index, method_name_at, METHOD_COUNT) != 0 ||
+        index_build(&tool_index, tool_name_at, TOOL_COUNT) != 0 ||
+        index_build(&model_index, model_name_at, MODEL_COUNT) != 0) {
+        (void)fprintf(stderr, "Error: no perfect hash for the registry names\n");
+        return;
+    }
+    if (build_initialize_result(&initialize_result) != 0 || build_tools_list_result(&tools_list_result) != 0) {
+        (void)fprintf(stderr, "Error: not enough memory for the registry payloads\n");
+        return;
+    }
+    registry_ready = 0;
+}
+
+int registry_init(void) {
+    (void)pthread_once(&registry_once, build_registry);
+    return registry_ready;
+}
+
+int registry_find_method(const char *name, size_t len) {
+    if (registry_init() != 0) return -1;
+    return index_find(&method_index, name, len);
+}
+
+const ToolDescriptor *registry_find_tool(const char *name, size_t len) {
+    if (registry_init() != 0) return NULL;
+    int entry = index_find(&tool_index, name, len);
+    return entry >= 0 ? &TOOLS[entry] : NULL;
+}
+
+const ModelDescriptor *registry_find_model(const char *name, size_t len) {
+    if (registry_init() != 0) return NULL;
+    int entry = index_find(&model_index, name, len);
+    return entry >= 0 ? &MODELS[entry] : NULL;
+}
+
+const ToolDescriptor *registry_tool(ToolId id) {
+    return &TOOLS[id];
+}
+
+const ModelDescriptor *registry_model(ModelId id) {
+    return &MODELS[id];
+}
+
+const char *registry_initialize_result(size_t *len) {
+    if (registry_init() != 0) return NULL;
+    *len = initialize_result.len;
+    return initialize_result.data;
+}
+
+const char *registry_tools_list_result(size_t *len) {
+    if (registry_init() != 0) return NULL;
+    *len = tools_list_result.len;
+    return tools_list_result.data;
+}
@@ -0,0 +1,83 @@
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include <stddef.h>
+
+// Static descriptors for everything the server exposes: JSON-RPC methods,
+// MCP tools and Perplexity models. Names are looked up through a perfect
+// hash built once at startup, and the initialize and tools/list results
+// are serialized then too. Adding a tool or a model is a table entry.
+
+typedef enum {
+    METHOD_INITIALIZE,
+    METHOD_TOOLS_LIST,
+    METHOD_TOOLS_CALL,
+    METHOD_CANCELLED,           // notifications/cancelled
+    METHOD_COUNT
+} MethodId;
+
+typedef enum {
+    TOOL_ASK,
+    TOOL_RESEARCH,
+    TOOL_REASON,
+    TOOL_DEEP_RESEARCH,
+    TOOL_RESEARCH_STATUS,
+    TOOL_RESEARCH_RESULT,
+    TOOL_BATCH,
+    TOOL_STATS,
+    TOOL_COUNT
+} ToolId;
+
+// ToolDescriptor.flags
+#define TOOL_ROUTED 0x1         // Takes messages and runs through route_and_execute
+#define TOOL_INLINE 0x2         // Answered on the reader thread, never queued
+#define TOOL_BATCHABLE 0x4      // Allowed as a perplexity_batch item
+
+typedef struct {
+    ToolId id;
+    const char *name;
+    const char *description;
+    const char *input_schema;   // JSON Schema text
+    unsigned int flags;
+} ToolDescriptor;
+
+typedef enum {
+    MODEL_SONAR,
+    MODEL_SONAR_PRO,
+    MODEL_SONAR_REASONING,
+    MODEL_SONAR_REASONING_PRO,
+    MODEL_SONAR_DEEP_RESEARCH,
+    MODEL_COUNT
+} ModelId;
+
+typedef enum {
+    MODEL_ENDPOINT_CHAT,        // /chat/completions, answered (or streamed) in one call
+    MODEL_ENDPOINT_ASYNC        // /async/chat/completions, submitted then polled
+} ModelEndpoint;
+
+typedef struct {
+    ModelId id;
+    const char *name;
+    int usage_index;            // Pricing table row (usage_model_index)
+    ModelEndpoint endpoint;
+    long timeout_ms;            // Chat call or async submit; a closer deadline shortens it
+    const char *reasoning_effort;  // Sent with async submits; NULL for none
+    int routable;               // Tools route to it and batch items may pin it
+} ModelDescriptor;
+
+// Build the lookup tables and payloads; lookups also do it on first use
+int registry_init(void);
+
+// Lookup by name (len bytes, not necessarily NUL-terminated); NULL if unknown
+int registry_find_method(const char *name, size_t len);     // MethodId or -1
+const ToolDescriptor *registry_find_tool(const char *name, size_t len);
+const ModelDescriptor *registry_find_model(const char *name, size_t len);
+
+const ToolDescriptor *registry_tool(ToolId id);
+const ModelDescriptor *registry_model(ModelId id);
+
+// Serialized result objects of initialize and tools/list
+const char *registry_initialize_result(size_t *len);
+const char *registry_tools_list_result(size_t *len);
+
+#endif
@@ -0,0 +1,548 @@
+#define GNU_SOURCE
+#include "response_cache.h"
+#include <ctype.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// In-memory LRU defaults (override with PERPLEXITY_CACHE_ENTRIES / PERPLEXITY_CACHE_MB)
+#define CACHE_BUCKETS 1024
+#define DEFAULT_CACHE_ENTRIES 512
+#define DEFAULT_CACHE_MB 64
+
+// On-disk store defaults (PERPLEXITY_CACHE_FILE / PERPLEXITY_CACHE_FILE_MB)
+#define DISK_CACHE_MAGIC 0x4548434158505050ULL  // "PPPXACHE" little-endian
+#define DISK_CACHE_VERSION 2
+#define DISK_CACHE_SLOTS 8192
+#define DISK_CACHE_PROBES 16
+#define DEFAULT_DISK_CACHE_MB 64
+
+// Per-tool time-to-live in seconds; 0 disables caching for that tool
+typedef struct {
+    const char *tool_name;
+    const char *env_name;
+    long default_ttl;
+    long ttl;
+} ToolTTL;
+
+static ToolTTL tool_ttls[] = {
+    {"perplexity_ask", "PERPLEXITY_CACHE_TTL_ASK", 3600, 0},
+    {"perplexity_reason", "PERPLEXITY_CACHE_TTL_REASON", 3600, 0},
+    {"perplexity_research", "PERPLEXITY_CACHE_TTL_RESEARCH", 6 * 3600, 0},
+    {"perplexity_deep_research", "PERPLEXITY_CACHE_TTL_DEEP_RESEARCH", 24 * 3600, 0},
+};
+
+// Streaming 2x64-bit hasher fed with the normalized history
+typedef struct {
+    uint64_t h1;
+    uint64_t h2;
+    uint64_t word;
+    unsigned int word_bytes;
+    uint64_t total;
+} KeyHasher;
+
+// LRU entry, chained in a hash bucket and in recency order
+typedef struct CacheEntry {
+    CacheKey key;
+    char *value;
+    size_t value_len;
+    time_t expires_at;
+    double cost;
+    struct CacheEntry *bucket_next;
+    struct CacheEntry *lru_prev;
+    struct CacheEntry *lru_next;
+} CacheEntry;
+
+// Memory-mapped store layout: header, slot table, then a data ring.
+// Data offsets are logical (ever-increasing); a record is still intact
+// while data_head - offset <= data_capacity. Nothing in the file is
+// trusted: slots are bounds-checked against the ring, and a checksum over
+// the slot and its bytes catches torn writes and edited files.
+typedef struct {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t slot_count;
+    uint64_t data_capacity;
+    uint64_t data_head;
+    uint64_t reserved[4];
+} DiskHeader;
+
+typedef struct {
+    uint64_t key_lo;
+    uint64_t key_hi;
+    int64_t expires_at;
+    uint64_t offset;
+    uint64_t length;
+    double cost;
+    uint64_t checksum;          // Over the fields above and the record's bytes
+} DiskSlot;
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static int cache_enabled = 0;
+static CacheEntry *buckets[CACHE_BUCKETS];
+static CacheEntry *lru_head = NULL;     // Most recently used
+static CacheEntry *lru_tail = NULL;     // Eviction candidate
+static size_t entry_count = 0;
+static size_t bytes_used = 0;
+static size_t max_entries = DEFAULT_CACHE_ENTRIES;
+static size_t max_bytes = (size_t)DEFAULT_CACHE_MB * 1024 * 1024;
+static CacheStats cache_stats;
+
+static int disk_fd = -1;
+static void *disk_map = NULL;
+static size_t disk_map_size = 0;
+static DiskHeader *disk_header = NULL;
+static DiskSlot *disk_slots = NULL;
+static char *disk_data = NULL;
+
+/* ---- Key hashing ---- */
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t fmix64(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+static inline void hasher_mix(KeyHasher *h, uint64_t w) {
+    h->h1 ^= rotl64(w * 0x87c37b91114253d5ULL, 31) * 0x4cf5ad432745937fULL;
+    h->h1 = rotl64(h->h1, 27) * 5 + 0x52dce729;
+    h->h2 ^= rotl64(w * 0x4cf5ad432745937fULL, 33) * 0x87c37b91114253d5ULL;
+    h->h2 = rotl64(h->h2, 31) * 5 + 0x38495ab5;
+}
+
+static void hasher_init(KeyHasher *h) {
+    memset(h, 0, sizeof(*h));
+    h->h1 = 0x9E3779B97F4A7C15ULL;
+    h->h2 = 0xC2B2AE3D27D4EB4FULL;
+}
+
+static void hasher_update(KeyHasher *h, const char *data, size_t len) {
+    const unsigned char *p = (const unsigned char *)data;
+    h->total += len;
+
+    // Finish a partially filled word first
+    while (len > 0 && h->word_bytes != 0) {
+        h->word |= (uint64_t)*p++ << (8 * h->word_bytes);
+        len--;
+        if (++h->word_bytes == 8) {
+            hasher_mix(h, h->word);
+            h->word = 0;
+            h->word_bytes = 0;
+        }
+    }
+
+    // Bulk 8-byte words
+    while (len >= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        hasher_mix(h, w);
+        p += 8;
+        len -= 8;
+    }
+
+    while (len > 0) {
+        h->word |= (uint64_t)*p++ << (8 * h->word_bytes);
+        h->word_bytes++;
+        len--;
+    }
+}
+
+static void hasher_byte(KeyHasher *h, char c) {
+    hasher_update(h, &c, 1);
+}
+
+// Feed text with surrounding whitespace trimmed and inner runs collapsed to one space
+static void hasher_update_normalized(KeyHasher *h, const char *text) {
+    const char *p = text;
+    int need_space = 0;
+
+    while (*p) {
+        while (*p && isspace((unsigned char)*p)) p++;
+        if (!*p) break;
+
+        const char *word = p;
+        while (*p && !isspace((unsigned char)*p)) p++;
+
+        if (need_space) hasher_byte(h, ' ');
+        hasher_update(h, word, (size_t)(p - word));
+        need_space = 1;
+    }
+}
+
+void cache_key_compute(CacheKey *key, const char *model, const MessageArray *msg_array) {
+    KeyHasher h;
+    hasher_init(&h);
+
+    // Unit/record separators keep field boundaries unambiguous
+    hasher_update(&h, model, strlen(model));
+    hasher_byte(&h, '\x1e');
+
+    for (int i = 0; i < msg_array->count; i++) {
+        const ChatMessage *msg = &msg_array->messages[i];
+        if (!msg->role || !msg->content) continue;  // Dropped from the payload too
+
+        hasher_update(&h, msg->role, strlen(msg->role));
+        hasher_byte(&h, '\x1f');
+        hasher_update_normalized(&h, msg->content);
+        hasher_byte(&h, '\x1e');
+    }
+
+    if (h.word_bytes > 0) hasher_mix(&h, h.word);
+    uint64_t h1 = h.h1 ^ h.total;
+    uint64_t h2 = h.h2 ^ h.total;
+    h1 += h2;
+    h2 += h1;
+    key->lo = fmix64(h1);
+    key->hi = fmix64(h2);
+}
+
+/* ---- In-memory LRU ---- */
+
+static long ttl_for_tool(const char *tool_name) {
+    for (size_t i = 0; i < sizeof(tool_ttls) / sizeof(tool_ttls[0]); i++) {
+        if (strcmp(tool_ttls[i].tool_name, tool_name) == 0) return tool_ttls[i].ttl;
+    }
+    return 0;
+}
+
+static int key_equal(const CacheKey *a, const CacheKey *b) {
+    return a->lo == b->lo && a->hi == b->hi;
+}
+
+static void lru_unlink(CacheEntry *entry) {
+    if (entry->lru_prev) entry->lru_prev->lru_next = entry->lru_next;
+    else lru_head = entry->lru_next;
+    if (entry->lru_next) entry->lru_next->lru_prev = entry->lru_prev;
+    else lru_tail = entry->lru_prev;
+    entry->lru_prev = entry->lru_next = NULL;
+}
+
+static void lru_push_front(CacheEntry *entry) {
+    entry->lru_prev = NULL;
+    entry->lru_next = lru_head;
+    if (lru_head) lru_head->lru_prev = entry;
+    lru_head = entry;
+    if (!lru_tail) lru_tail = entry;
+}
+
+static void remove_entry(CacheEntry *entry) {
+    CacheEntry **slot = &buckets[entry->key.lo & (CACHE_BUCKETS - 1)];
+    while (*slot && *slot != entry) slot = &(*slot)->bucket_next;
+    if (*slot) *slot = entry->bucket_next;
+
+    lru_unlink(entry);
+    entry_count--;
+    bytes_used -= entry->value_len;
+    free(entry->value);
+    free(entry);
+}
+
+static CacheEntry *find_entry(const CacheKey *key) {
+    for (CacheEntry *e = buckets[key->lo & (CACHE_BUCKETS - 1)]; e; e = e->bucket_next) {
+        if (key_equal(&e->key, key)) return e;
+    }
+    return NULL;
+}
+
+static void memory_put(const CacheKey *key, const char *value, size_t len, time_t expires_at, double cost) {
+    if (len > max_bytes) return;
+
+    CacheEntry *existing = find_entry(key);
+    if (existing) remove_entry(existing);
+
+    while (lru_tail && (entry_count >= max_entries || bytes_used + len > max_bytes)) {
+        remove_entry(lru_tail);
+        cache_stats.evictions++;
+    }
+
+    CacheEntry *entry = calloc(1, sizeof(CacheEntry));
+    if (!entry) return;
+    entry->value = malloc(len + 1);
+    if (!entry->value) {
+        free(entry);
+        return;
+    }
+    memcpy(entry->value, value, len);
+    entry->value[len] = '\0';
+    entry->value_len = len;
+    entry->key = *key;
+    entry->expires_at = expires_at;
+    entry->cost = cost;
+
+    CacheEntry **bucket = &buckets[key->lo & (CACHE_BUCKETS - 1)];
+    entry->bucket_next = *bucket;
+    *bucket = entry;
+    lru_push_front(entry);
+    entry_count++;
+    bytes_used += len;
+}
+
+/* ---- Memory-mapped disk store ---- */
+
+static void disk_close(void) {
+    if (disk_map) {
+        msync(disk_map, disk_map_size, MS_SYNC);
+        munmap(disk_map, disk_map_size);
+    }
+    if (disk_fd >= 0) close(disk_fd);
+    disk_map = NULL;
+    disk_fd = -1;
+    disk_header = NULL;
+    disk_slots = NULL;
+    disk_data = NULL;
+}
+
+static int disk_open(const char *path, size_t data_mb) {
+    size_t data_capacity = data_mb * 1024 * 1024;
+    size_t total = sizeof(DiskHeader) + DISK_CACHE_SLOTS * sizeof(DiskSlot) + data_capacity;
+
+    disk_fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (disk_fd < 0) {
+        (void)fprintf(stderr, "Cache file %s unavailable, using memory cache only\n", path);
+        return -1;
+    }
+
+    // One server per file; a second instance falls back to memory only
+    if (flock(disk_fd, LOCK_EX | LOCK_NB) != 0) {
+        (void)fprintf(stderr, "Cache file %s is in use by another process, using memory cache only\n", path);
+        disk_close();
+        return -1;
+    }
+
+    struct stat st;
+    int fresh = fstat(disk_fd, &st) != 0 || (size_t)st.st_size != total;
+    if (fresh && ftruncate(disk_fd, (off_t)total) != 0) {
+        disk_close();
+        return -1;
+    }
+
+    disk_map = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, disk_fd, 0);
+    if (disk_map == MAP_FAILED) {
+        disk_map = NULL;
+        disk_close();
+        return -1;
+    }
+    disk_map_size = total;
+    disk_header = (DiskHeader *)disk_map;
+    disk_slots = (DiskSlot *)((char *)disk_map + sizeof(DiskHeader));
+    disk_data = (char *)(disk_slots + DISK_CACHE_SLOTS);
+
+    if (fresh || disk_header->magic != DISK_CACHE_MAGIC || disk_header->version != DISK_CACHE_VERSION ||
+        disk_header->slot_count != DISK_CACHE_SLOTS || disk_header->data_capacity != data_capacity) {
+        memset(disk_map, 0, sizeof(DiskHeader) + DISK_CACHE_SLOTS * sizeof(DiskSlot));
+        disk_header->magic = DISK_CACHE_MAGIC;
+        disk_header->version = DISK_CACHE_VERSION;
+        disk_header->slot_count = DISK_CACHE_SLOTS;
+        disk_header->data_capacity = data_capacity;
+    }
+
+    return 0;
+}
+
+// Records are at most a quarter of the ring and never straddle its end
+static int disk_slot_live(const DiskSlot *slot, time_t now) {
+    uint64_t capacity = disk_header->data_capacity;
+    return slot->length > 0 && slot->length <= capacity / 4 && slot->offset % capacity + slot->length <= capacity &&
+           slot->expires_at > now && disk_header->data_head - slot->offset <= capacity;
+}
+
+static uint64_t disk_checksum(const DiskSlot *slot, const char *data) {
+    KeyHasher h;
+    hasher_init(&h);
+    hasher_update(&h, (const char *)slot, offsetof(DiskSlot, checksum));
+    hasher_update(&h, data, (size_t)slot->length);
+    if (h.word_bytes > 0) hasher_mix(&h, h.word);
+    return fmix64(h.h1 ^ h.total) ^ h.h2;
+}
+
+static DiskSlot *disk_find(const CacheKey *key, time_t now) {
+    for (unsigned int i = 0; i < DISK_CACHE_PROBES; i++) {
+        DiskSlot *slot = &disk_slots[(key->lo + i) % DISK_CACHE_SLOTS];
+        if (slot->key_lo != key->lo || slot->key_hi != key->hi || !disk_slot_live(slot, now)) continue;
+
+        if (disk_checksum(slot, disk_data + slot->offset % disk_header->data_capacity) != slot->checksum) {
+            (void)fprintf(stderr, "Dropping corrupt cache record in slot %ld\n", (long)(slot - disk_slots));
+            slot->length = 0;
+            continue;
+        }
+        return slot;
+    }
+    return NULL;
+}
+
+static void disk_put(const CacheKey *key, const char *value, size_t len, time_t expires_at, double cost) {
+    uint64_t capacity = disk_header->data_capacity;
+    if (len == 0 || len > capacity / 4) return;
+
+    time_t now = time(NULL);
+    DiskSlot *target = NULL;
+    for (unsigned int i = 0; i < DISK_CACHE_PROBES && !target; i++) {
+        DiskSlot *slot = &disk_slots[(key->lo + i) % DISK_CACHE_SLOTS];
+        if ((slot->key_lo == key->lo && slot->key_hi == key->hi) || !disk_slot_live(slot, now)) {
+            target = slot;
+        }
+    }
+    if (!target) target = &disk_slots[key->lo % DISK_CACHE_SLOTS];
+
+    // Records never straddle the end of the ring
+    uint64_t offset = disk_header->data_head;
+    if (offset % capacity + len > capacity) {
+        offset += capacity - offset % capacity;
+    }
+    memcpy(disk_data + offset % capacity, value, len);
+    disk_header->data_head = offset + len;
+
+    target->key_lo = key->lo;
+    target->key_hi = key->hi;
+    target->expires_at = (int64_t)expires_at;
+    target->offset = offset;
+    target->length = len;
+    target->cost = cost;
+    target->checksum = disk_checksum(target, disk_data + offset % capacity);
+}
+
+/* ---- Public API ---- */
+
+static long env_long(const char *name, long fallback) {
+    const char *value = getenv(name);
+    if (!value || !*value) return fallback;
+    return atol(value);
+}
+
+int response_cache_init(void) {
+    const char *disabled = getenv("PERPLEXITY_CACHE_DISABLE");
+    if (disabled && *disabled && strcmp(disabled, "0") != 0) {
+        (void)fprintf(stderr, "Response cache disabled\n");
+        return 0;
+    }
+
+    for (size_t i = 0; i < sizeof(tool_ttls) / sizeof(tool_ttls[0]); i++) {
+        tool_ttls[i].ttl = env_long(tool_ttls[i].env_name, tool_ttls[i].default_ttl);
+    }
+
+    long entries = env_long("PERPLEXITY_CACHE_ENTRIES", DEFAULT_CACHE_ENTRIES);
+    long megabytes = env_long("PERPLEXITY_CACHE_MB", DEFAULT_CACHE_MB);
+    if (entries > 0) max_entries = (size_t)entries;
+    if (megabytes > 0) max_bytes = (size_t)megabytes * 1024 * 1024;
+
+    const char *path = getenv("PERPLEXITY_CACHE_FILE");
+    if (path && *path) {
+        long disk_mb = env_long("PERPLEXITY_CACHE_FILE_MB", DEFAULT_DISK_CACHE_MB);
+        if (disk_open(path, disk_mb > 0 ? (size_t)disk_mb : DEFAULT_DISK_CACHE_MB) == 0) {
+            (void)fprintf(stderr, "Response cache persisted to %s\n", path);
+        }
+    }
+
+    cache_enabled = 1;
+    return 0;
+}
+
+void response_cache_shutdown(void) {
+    pthread_mutex_lock(&cache_lock);
+    while (lru_head) remove_entry(lru_head);
+    disk_close();
+    cache_enabled = 0;
+    pthread_mutex_unlock(&cache_lock);
+}
+
+char *response_cache_get(const CacheKey *key, const char *model) {
+    if (!cache_enabled) return NULL;
+
+    char *answer = NULL;
+    double saved = 0.0;
+    time_t now = time(NULL);
+
+    pthread_mutex_lock(&cache_lock);
+    CacheEntry *entry = find_entry(key);
+    if (entry && entry->expires_at <= now) {
+        remove_entry(entry);
+        entry = NULL;
+    }
+
+    if (entry) {
+        lru_unlink(entry);
+        lru_push_front(entry);
+        answer = strdup(entry->value);
+        saved = entry->cost;
+    } else if (disk_header) {
+        DiskSlot *slot = disk_find(key, now);
+        if (slot) {
+            const char *data = disk_data + slot->offset % disk_header->data_capacity;
+            answer = strndup(data, (size_t)slot->length);
+            saved = slot->cost;
+            if (answer) {
+                memory_put(key, answer, (size_t)slot->length, (time_t)slot->expires_at, slot->cost);
+                cache_stats.disk_hits++;
+            }
+        }
+    }
+
+    if (answer) {
+        cache_stats.hits++;
+        cache_stats.dollars_saved += saved;
+    } else {
+        cache_stats.misses++;
+    }
+    CacheStats snapshot = cache_stats;
+    pthread_mutex_unlock(&cache_lock);
+
+    if (answer) {
+        (void)fprintf(stderr, "=== Cache Hit ===\n");
+        (void)fprintf(stderr, "Model: %s\n", model);
+        (void)fprintf(stderr, "Saved: $%.6f (total saved: $%.6f, hits: %lu, misses: %lu)\n",
+                      saved, snapshot.dollars_saved, snapshot.hits, snapshot.misses);
+        (void)fprintf(stderr, "========================\n");
+    }
+    return answer;
+}
+
+void response_cache_put(const CacheKey *key, const char *tool_name, const char *answer, double cost) {
+    if (!cache_enabled || !answer) return;
+
+    long ttl = ttl_for_tool(tool_name);
+    if (ttl <= 0) return;
+
+    time_t expires_at = time(NULL) + ttl;
+    size_t len = strlen(answer);
+
+    pthread_mutex_lock(&cache_lock);
+    memory_put(key, answer, len, expires_at, cost);
+    if (disk_header) disk_put(key, answer, len, expires_at, cost);
+    cache_stats.stores++;
+    pthread_mutex_unlock(&cache_lock);
+}
+
+void response_cache_get_stats(CacheStats *stats) {
+    pthread_mutex_lock(&cache_lock);
+    *stats = cache_stats;
+    pthread_mutex_unlock(&cache_lock);
+}
+
+void response_cache_log_stats(void) {
+    if (!cache_enabled) return;
+
+    CacheStats stats;
+    response_cache_get_stats(&stats);
+
+    unsigned long lookups = stats.hits + stats.misses;
+    double hit_ratio = lookups > 0 ? (double)stats.hits / (double)lookups : 0.0;
+
+    (void)fprintf(stderr, "Response cache: %lu hits (%lu from disk), %lu misses (%.1f%% hit rate), %lu stored, %lu evicted, $%.6f saved\n",
+                  stats.hits, stats.disk_hits, stats.misses, hit_ratio * 100.0,
+                  stats.stores, stats.evictions, stats.dollars_saved);
+}
@@ -0,0 +1,36 @@
+#ifndef RESPONSE_CACHE_H
+#define RESPONSE_CACHE_H
+
+#include <stdint.h>
+#include "../include/types.h"
+
+// 128-bit content address of (model, normalized message history)
+typedef struct {
+    uint64_t lo;
+    uint64_t hi;
+} CacheKey;
+
+// Hit/miss counters reported with the usage log
+typedef struct {
+    unsigned long hits;
+    unsigned long disk_hits;
+    unsigned long misses;
+    unsigned long stores;
+    unsigned long evictions;
+    double dollars_saved;
+} CacheStats;
+
+void cache_key_compute(CacheKey *key, const char *model, const MessageArray *msg_array);
+
+// Cache lifecycle; configured from PERPLEXITY_CACHE_* environment variables
+int response_cache_init(void);
+void response_cache_shutdown(void);
+
+// Lookup returns a malloc'd copy of the cached answer, or NULL
+char *response_cache_get(const CacheKey *key, const char *model);
+void response_cache_put(const CacheKey *key, const char *tool_name, const char *answer, double cost);
+
+void response_cache_get_stats(CacheStats *stats);
+void response_cache_log_stats(void);
+
+#endif
@@ -0,0 +1,165 @@
+#define GNU_SOURCE
+#include "response_decoder.h"
+#include "json_scan.h"
+#include "buffer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// content of a message/delta object; returns the position after the object
+static const char *decode_message(const char *p, const char *end, DecodedResponse *out) {
+    JsonIter it;
+    if (!json_scan_object_begin(&it, p, end)) return NULL;
+
+    const char *key, *value, *value_end;
+    size_t key_len;
+    while (json_scan_object_next(&it, &key, &key_len, &value)) {
+        if (!json_scan_key_equals(key, key_len, "content")) continue;
+
+        char *content = json_scan_string_dup(value, end, &value_end);
+        if (content) {
+            free(out->content);
+            out->content = content;
+            json_scan_iter_skip_to(&it, value_end);
+        }
+    }
+    return it.after;
+}
+
+// choices[0].message.content, or choices[0].delta.content for stream chunks.
+// The report text is walked once: each level resumes where the inner one stopped.
+static const char *decode_choices(const char *p, const char *end, DecodedResponse *out) {
+    JsonIter choices;
+    const char *first;
+    if (!json_scan_array_begin(&choices, p, end) || !json_scan_array_next(&choices, &first)) return NULL;
+
+    JsonIter choice;
+    if (!json_scan_object_begin(&choice, first, end)) return NULL;
+
+    const char *key, *value;
+    size_t key_len;
+    while (json_scan_object_next(&choice, &key, &key_len, &value)) {
+        if (json_scan_key_equals(key, key_len, "message") || json_scan_key_equals(key, key_len, "delta")) {
+            const char *value_end = decode_message(value, end, out);
+            if (value_end) json_scan_iter_skip_to(&choice, value_end);
+        }
+    }
+    if (!choice.after) return NULL;
+
+    json_scan_iter_skip_to(&choices, choice.after);
+    while (json_scan_array_next(&choices, &value)) {
+        // Further choices are not used
+    }
+    return choices.after;
+}
+
+static void decode_citations(const char *p, const char *end, DecodedResponse *out) {
+    JsonIter it;
+    if (!json_scan_array_begin(&it, p, end)) return;
+
+    const char *value;
+    while (json_scan_array_next(&it, &value)) {
+        char *url = json_scan_string_dup(value, end, NULL);
+        if (!url) continue;
+
+        char **grown = realloc(out->citations, sizeof(char *) * (size_t)(out->citation_count + 1));
+        if (!grown) {
+            free(url);
+            return;
+        }
+        out->citations = grown;
+        out->citations[out->citation_count++] = url;
+    }
+}
+
+// One object level; async status documents nest the completion under "response".
+// Returns the position after the object, or NULL if it is malformed.
+static const char *decode_object(const char *p, const char *end, DecodedResponse *out) {
+    JsonIter it;
+    if (!json_scan_object_begin(&it, p, end)) return NULL;
+
+    const char *key, *value, *value_end;
+    size_t key_len;
+    while (json_scan_object_next(&it, &key, &key_len, &value)) {
+        switch (key_len > 0 ? key[0] : '\0') {
+            case 'c':
+                if (json_scan_key_equals(key, key_len, "choices")) {
+                    value_end = decode_choices(value, end, out);
+                    if (value_end) json_scan_iter_skip_to(&it, value_end);
+                } else if (json_scan_key_equals(key, key_len, "citations") && !out->citations) {
+                    decode_citations(value, end, out);
+                }
+                break;
+            case 'e':
+                if (json_scan_key_equals(key, key_len, "error_message") && !out->error_message) {
+                    out->error_message = json_scan_string_dup(value, end, NULL);
+                }
+                break;
+            case 'i':
+                if (json_scan_key_equals(key, key_len, "id") && !out->id) {
+                    out->id = json_scan_string_dup(value, end, NULL);
+                }
+                break;
+            case 'r':
+                if (json_scan_key_equals(key, key_len, "response")) {
+                    value_end = decode_object(value, end, out);
+                    if (value_end) json_scan_iter_skip_to(&it, value_end);
+                }
+                break;
+            case 's':
+                if (json_scan_key_equals(key, key_len, "status") && !out->status) {
+                    out->status = json_scan_string_dup(value, end, NULL);
+                }
+                break;
+            case 'u':
+                if (json_scan_key_equals(key, key_len, "usage") && parse_usage_object(value, end, &out->usage) == 0) {
+                    out->has_usage = 1;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    return it.error ? NULL : it.after;
+}
+
+// Decode json (NUL-terminated, len bytes) into out; -1 if it is not an object
+int decode_response(const char *json, size_t len, DecodedResponse *out) {
+    memset(out, 0, sizeof(*out));
+    if (!json) return -1;
+    return decode_object(json, json + len, out) ? 0 : -1;
+}
+
+void free_decoded_response(DecodedResponse *decoded) {
+    free(decoded->id);
+    free(decoded->status);
+    free(decoded->error_message);
+    free(decoded->content);
+    for (int i = 0; i < decoded->citation_count; i++) {
+        free(decoded->citations[i]);
+    }
+    free(decoded->citations);
+    memset(decoded, 0, sizeof(*decoded));
+}
+
+char *take_content_with_citations(DecodedResponse *decoded) {
+    char *content = decoded->content;
+    decoded->content = NULL;
+    if (!content || decoded->citation_count == 0) return content;
+
+    Buffer buf;
+    buffer_init(&buf);
+    if (buffer_append_str(&buf, content) != 0 || buffer_append_str(&buf, "\n\nCitations:") != 0) {
+        buffer_free(&buf);
+        return content;
+    }
+    for (int i = 0; i < decoded->citation_count; i++) {
+        if (buffer_append_printf(&buf, "\n[%d] %s", i + 1, decoded->citations[i]) != 0) {
+            buffer_free(&buf);
+            return content;
+        }
+    }
+
+    free(content);
+    return buf.data;
+}
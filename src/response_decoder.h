@@ -0,0 +1,26 @@
+#ifndef RESPONSE_DECODER_H
+#define RESPONSE_DECODER_H
+
+#include <stddef.h>
+#include "../include/usage.h"
+
+// Fields read from a chat completion, a streamed chunk, or an async job
+// status document. Decoded in a single pass; unread fields are skipped.
+typedef struct {
+    char *id;
+    char *status;           // Async jobs: CREATED, IN_PROGRESS, COMPLETED, FAILED
+    char *error_message;
+    char *content;          // choices[0].message.content (or delta.content)
+    char **citations;
+    int citation_count;
+    UsageInfo usage;
+    int has_usage;
+} DecodedResponse;
+
+int decode_response(const char *json, size_t len, DecodedResponse *out);
+void free_decoded_response(DecodedResponse *decoded);
+
+// Take ownership of the decoded content with a "Citations:" list appended
+char *take_content_with_citations(DecodedResponse *decoded);
+
+#endif
@@ -0,0 +1,170 @@
+#define GNU_SOURCE
+#include "singleflight.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A follower waiting for the leader's result
+typedef struct Follower {
+    struct InflightCall *call;
+    CancelWatch watch;          // Gives up for the follower when its call expires
+    singleflight_done_fn on_done;
+    void *userdata;
+    struct Follower *next;
+} Follower;
+
+// One pending request shared by its leader and any identical followers
+struct InflightCall {
+    CacheKey key;
+    int refs;               // Leader + followers not yet answered
+    int done;
+    int complete;           // Leader's result is a finished answer
+    char *result;
+    const char *error;      // Leader's static ctx->error when it has no result
+    Follower *followers;    // Registered and not yet answered
+    struct InflightCall *next;
+};
+
+static pthread_mutex_t inflight_lock = PTHREAD_MUTEX_INITIALIZER;
+static InflightCall *inflight_calls = NULL;
+static unsigned long coalesced = 0;
+
+// Drop one reference; caller holds inflight_lock
+static void release_call(InflightCall *call) {
+    if (--call->refs > 0) return;
+
+    free(call->result);
+    free(call);
+}
+
+InflightCall *singleflight_join(const CacheKey *key, int *is_leader) {
+    pthread_mutex_lock(&inflight_lock);
+
+    for (InflightCall *call = inflight_calls; call; call = call->next) {
+        if (call->key.lo == key->lo && call->key.hi == key->hi) {
+            call->refs++;
+            coalesced++;
+            pthread_mutex_unlock(&inflight_lock);
+            *is_leader = 0;
+            return call;
+        }
+    }
+
+    InflightCall *call = calloc(1, sizeof(InflightCall));
+    if (!call) {
+        pthread_mutex_unlock(&inflight_lock);
+        *is_leader = 1;
+        return NULL;  // Run uncoalesced
+    }
+    call->key = *key;
+    call->refs = 1;
+    call->next = inflight_calls;
+    inflight_calls = call;
+
+    pthread_mutex_unlock(&inflight_lock);
+    *is_leader = 1;
+    return call;
+}
+
+// Answer a follower that is off the list, or still on it when its watch
+// fired: with a copy of the leader's result, or nothing if it is not in yet
+static void answer_follower(Follower *follower) {
+    InflightCall *call = follower->call;
+
+    pthread_mutex_lock(&inflight_lock);
+    for (Follower **slot = &call->followers; *slot; slot = &(*slot)->next) {
+        if (*slot == follower) {
+            *slot = follower->next;
+            break;
+        }
+    }
+    char *result = call->done && call->result ? strdup(call->result) : NULL;
+    int complete = call->done ? call->complete : 0;
+    const char *error = call->done ? call->error : NULL;
+    release_call(call);
+    pthread_mutex_unlock(&inflight_lock);
+
+    follower->on_done(result, complete, error, follower->userdata);
+    free(follower);
+}
+
+// Watch expiry (event loop thread)
+static void follower_expired(void *userdata) {
+    answer_follower((Follower *)userdata);
+}
+
+void singleflight_complete(InflightCall *call, const char *result, int complete, const char *error) {
+    if (!call) return;
+
+    char *copy = result ? strdup(result) : NULL;
+    Follower *ready = NULL;
+
+    pthread_mutex_lock(&inflight_lock);
+    for (InflightCall **slot = &inflight_calls; *slot; slot = &(*slot)->next) {
+        if (*slot == call) {
+            *slot = call->next;
+            break;
+        }
+    }
+    call->result = copy;
+    call->complete = complete < 0 ? -1 : complete && copy != NULL;
+    call->error = copy ? NULL : error;
+    call->done = 1;
+    // Followers whose watch already fired are answered by it
+    Follower **slot = &call->followers;
+    while (*slot) {
+        Follower *follower = *slot;
+        if (cancel_unwatch(&follower->watch)) {
+            *slot = follower->next;
+            follower->next = ready;
+            ready = follower;
+        } else {
+            slot = &follower->next;
+        }
+    }
+    call->refs++;  // Kept until the ready followers have their copies
+    release_call(call);
+    pthread_mutex_unlock(&inflight_lock);
+
+    while (ready) {
+        Follower *follower = ready;
+        ready = follower->next;
+        answer_follower(follower);
+    }
+    pthread_mutex_lock(&inflight_lock);
+    release_call(call);
+    pthread_mutex_unlock(&inflight_lock);
+}
+
+void singleflight_follow(InflightCall *call, const CancelToken *cancel, singleflight_done_fn on_done, void *userdata) {
+    Follower *follower = calloc(1, sizeof(Follower));
+    if (!follower) {
+        pthread_mutex_lock(&inflight_lock);
+        release_call(call);
+        pthread_mutex_unlock(&inflight_lock);
+        on_done(NULL, 0, NULL, userdata);
+        return;
+    }
+    follower->call = call;
+    follower->on_done = on_done;
+    follower->userdata = userdata;
+
+    pthread_mutex_lock(&inflight_lock);
+    int waiting = !call->done && !cancel_token_expired(cancel);
+    if (waiting) {
+        follower->next = call->followers;
+        call->followers = follower;
+        // Without the loop nothing expires the wait; the leader still answers
+        (void)cancel_watch(&follower->watch, cancel, 0, follower_expired, follower);
+    }
+    pthread_mutex_unlock(&inflight_lock);
+
+    if (!waiting) answer_follower(follower);
+}
+
+unsigned long singleflight_coalesced_count(void) {
+    pthread_mutex_lock(&inflight_lock);
+    unsigned long count = coalesced;
+    pthread_mutex_unlock(&inflight_lock);
+    return count;
+}
@@ -0,0 +1,28 @@
+#ifndef SINGLEFLIGHT_H
+#define SINGLEFLIGHT_H
+
+#include "response_cache.h"
+#include "cancel.h"
+
+typedef struct InflightCall InflightCall;
+
+// Join the in-flight call for key. Sets *is_leader when the caller must
+// execute the request and publish it with singleflight_complete().
+InflightCall *singleflight_join(const CacheKey *key, int *is_leader);
+
+// Leader: publish the result (copied) to all followers and release the slot.
+// complete < 0 means the leader was cancelled and followers should retry.
+// error is the leader's static failure message, passed on when result is NULL.
+void singleflight_complete(InflightCall *call, const char *result, int complete, const char *error);
+
+// Follower: on_done gets a malloc'd copy of the leader's result, complete
+// and error as published. It holds no thread and runs once: on the leader's
+// thread, or on the event loop thread with NULL and complete 0 once cancel
+// expires first. complete is -1 when the leader was cancelled (the caller
+// may take over).
+typedef void (*singleflight_done_fn)(char *result, int complete, const char *error, void *userdata);
+void singleflight_follow(InflightCall *call, const CancelToken *cancel, singleflight_done_fn on_done, void *userdata);
+
+unsigned long singleflight_coalesced_count(void);
+
+#endif
@@ -0,0 +1,106 @@
+#define GNU_SOURCE
+#include "sse_parser.h"
+#include <stdlib.h>
+#include <string.h>
+
+static int append_bytes(char **buf, size_t *len, size_t *cap, const char *bytes, size_t n) {
+    if (*len + n + 1 > *cap) {
+        size_t new_cap = *cap ? *cap : 256;
+        while (*len + n + 1 > new_cap) new_cap *= 2;
+        char *grown = realloc(*buf, new_cap);
+        if (!grown) return -1;
+        *buf = grown;
+        *cap = new_cap;
+    }
+    memcpy(*buf + *len, bytes, n);
+    *len += n;
+    (*buf)[*len] = '\0';
+    return 0;
+}
+
+void sse_parser_init(SSEParser *parser, sse_event_fn on_event, void *userdata) {
+    memset(parser, 0, sizeof(*parser));
+    parser->on_event = on_event;
+    parser->userdata = userdata;
+}
+
+static void dispatch_event(SSEParser *parser) {
+    if (parser->has_data) {
+        parser->on_event(parser->data ? parser->data : "", parser->data_len, parser->userdata);
+    }
+    parser->data_len = 0;
+    parser->has_data = 0;
+}
+
+// Process one complete line (without its terminator)
+static int process_line(SSEParser *parser, const char *line, size_t len) {
+    if (len == 0) {
+        dispatch_event(parser);
+        return 0;
+    }
+    if (line[0] == ':') return 0;  // Comment / keep-alive
+
+    const char *colon = memchr(line, ':', len);
+    size_t field_len = colon ? (size_t)(colon - line) : len;
+    if (field_len != 4 || memcmp(line, "data", 4) != 0) return 0;  // event/id/retry unused
+
+    const char *value = colon ? colon + 1 : line + len;
+    size_t value_len = (size_t)(line + len - value);
+    if (value_len > 0 && value[0] == ' ') {
+        value++;
+        value_len--;
+    }
+
+    if (parser->has_data && append_bytes(&parser->data, &parser->data_len, &parser->data_cap, "\n", 1) != 0) {
+        return -1;
+    }
+    parser->has_data = 1;
+    return append_bytes(&parser->data, &parser->data_len, &parser->data_cap, value, value_len);
+}
+
+int sse_parser_feed(SSEParser *parser, const char *bytes, size_t len) {
+    const char *end = bytes + len;
+
+    while (bytes < end) {
+        const char *nl = memchr(bytes, '\n', (size_t)(end - bytes));
+        if (!nl) {
+            return append_bytes(&parser->line, &parser->line_len, &parser->line_cap, bytes, (size_t)(end - bytes));
+        }
+
+        const char *line = bytes;
+        size_t line_len = (size_t)(nl - bytes);
+
+        // Join with a carried-over partial line
+        if (parser->line_len > 0) {
+            if (append_bytes(&parser->line, &parser->line_len, &parser->line_cap, bytes, line_len) != 0) return -1;
+            line = parser->line;
+            line_len = parser->line_len;
+        }
+        if (line_len > 0 && line[line_len - 1] == '\r') line_len--;
+
+        int rc = process_line(parser, line, line_len);
+        parser->line_len = 0;
+        if (rc != 0) return rc;
+
+        bytes = nl + 1;
+    }
+    return 0;
+}
+
+// Flush a trailing event that was not followed by a blank line
+void sse_parser_finish(SSEParser *parser) {
+    if (parser->line_len > 0) {
+        size_t len = parser->line_len;
+        if (parser->line[len - 1] == '\r') len--;
+        (void)process_line(parser, parser->line, len);
+        parser->line_len = 0;
+    }
+    dispatch_event(parser);
+}
+
+void sse_parser_free(SSEParser *parser) {
+    free(parser->line);
+    free(parser->data);
+    parser->line = NULL;
+    parser->data = NULL;
+}
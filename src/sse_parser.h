@@ -0,0 +1,27 @@
+#ifndef SSE_PARSER_H
+#define SSE_PARSER_H
+
+#include <stddef.h>
+
+// Called once per complete event with its joined data lines (NUL-terminated)
+typedef void (*sse_event_fn)(const char *data, size_t len, void *userdata);
+
+// Incremental text/event-stream parser; bytes may arrive split anywhere
+typedef struct {
+    char *line;             // Partial line carried over between chunks
+    size_t line_len;
+    size_t line_cap;
+    char *data;             // Data lines of the event being assembled
+    size_t data_len;
+    size_t data_cap;
+    int has_data;
+    sse_event_fn on_event;
+    void *userdata;
+} SSEParser;
+
+void sse_parser_init(SSEParser *parser, sse_event_fn on_event, void *userdata);
+int sse_parser_feed(SSEParser *parser, const char *bytes, size_t len);
+void sse_parser_finish(SSEParser *parser);
+void sse_parser_free(SSEParser *parser);
+
+#endif
@@ -0,0 +1,130 @@
+#define GNU_SOURCE
+#include "stdin_reader.h"
+#include "../include/constants.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+int line_reader_init(LineReader *reader, int fd, size_t max_line) {
+    memset(reader, 0, sizeof(*reader));
+    reader->fd = fd;
+    reader->max_line = max_line;
+    reader->cap = READ_CHUNK_SIZE;
+    reader->buf = malloc(reader->cap);
+    return reader->buf ? 0 : -1;
+}
+
+void line_reader_free(LineReader *reader) {
+    free(reader->buf);
+    reader->buf = NULL;
+}
+
+// Make room for at least one more read: slide the partial line to the
+// front, and grow geometrically only when the line itself fills the buffer.
+static int reserve_read_space(LineReader *reader) {
+    if (reader->start > 0) {
+        size_t pending = reader->end - reader->start;
+        if (reader->cap - reader->end < READ_CHUNK_SIZE / 2 || pending == 0) {
+            memmove(reader->buf, reader->buf + reader->start, pending);
+            reader->end = pending;
+            reader->start = 0;
+        }
+    }
+
+    if (reader->cap - reader->end >= READ_CHUNK_SIZE / 2) return 0;
+
+    size_t new_cap = reader->cap * 2;
+    char *grown = realloc(reader->buf, new_cap);
+    if (!grown) return -1;
+    reader->buf = grown;
+    reader->cap = new_cap;
+    return 0;
+}
+
+// Drop the current line up to (and including) its newline
+static char *skip_line(LineReader *reader, const char *reason, size_t *len) {
+    static char empty_line[1];
+
+    reader->dropped = reason;
+    *len = 0;
+    for (;;) {
+        char *nl = memchr(reader->buf + reader->start, '\n', reader->end - reader->start);
+        if (nl) {
+            reader->start = (size_t)(nl - reader->buf) + 1;
+            reader->scanned = 0;
+            return empty_line;
+        }
+
+        reader->start = reader->end = reader->scanned = 0;
+        if (reader->eof) return empty_line;
+        ssize_t n = read(reader->fd, reader->buf, reader->cap);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            reader->eof = 1;
+            return empty_line;
+        }
+        reader->end = (size_t)n;
+    }
+}
+
+// Return the next line without its terminator (CR/LF stripped), or NULL at EOF
+char *line_reader_next(LineReader *reader, size_t *len) {
+    reader->dropped = NULL;
+    for (;;) {
+        // memchr is vectorized in libc; resume where the last scan stopped
+        char *scan_from = reader->buf + reader->start + reader->scanned;
+        size_t scan_len = reader->end - reader->start - reader->scanned;
+        char *nl = memchr(scan_from, '\n', scan_len);
+
+        if (nl) {
+            char *line = reader->buf + reader->start;
+            size_t line_len = (size_t)(nl - line);
+            if (line_len > 0 && line[line_len - 1] == '\r') line_len--;
+            line[line_len] = '\0';
+
+            reader->start = (size_t)(nl - reader->buf) + 1;
+            reader->scanned = 0;
+            *len = line_len;
+            return line;
+        }
+        reader->scanned += scan_len;
+
+        if (reader->eof) {
+            // Final line without a trailing newline
+            if (reader->end > reader->start) {
+                if (reserve_read_space(reader) != 0) {
+                    (void)fprintf(stderr, "Not enough memory for request buffer, discarding request\n");
+                    return skip_line(reader, "Not enough memory for request", len);
+                }
+                char *line = reader->buf + reader->start;
+                size_t line_len = reader->end - reader->start;
+                line[line_len] = '\0';
+                reader->start = reader->end;
+                reader->scanned = 0;
+                *len = line_len;
+                return line;
+            }
+            return NULL;
+        }
+
+        if (reader->end - reader->start > reader->max_line) {
+            (void)fprintf(stderr, "Request exceeds %zu bytes, discarding\n", reader->max_line);
+            return skip_line(reader, "Request too large", len);
+        }
+
+        if (reserve_read_space(reader) != 0) {
+            (void)fprintf(stderr, "Not enough memory for request buffer, discarding request\n");
+            return skip_line(reader, "Not enough memory for request", len);
+        }
+
+        ssize_t n = read(reader->fd, reader->buf + reader->end, reader->cap - reader->end - 1);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            reader->eof = 1;
+            continue;
+        }
+        reader->end += (size_t)n;
+    }
+}
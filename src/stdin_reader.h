@@ -0,0 +1,29 @@
+#ifndef STDIN_READER_H
+#define STDIN_READER_H
+
+#include <stddef.h>
+
+// Newline-delimited frame reader over a file descriptor. Lines are returned
+// in place (NUL-terminated inside the buffer) and stay valid until the next
+// call to line_reader_next().
+typedef struct {
+    int fd;
+    char *buf;
+    size_t cap;
+    size_t start;       // First byte of the current (unconsumed) line
+    size_t end;         // End of buffered data
+    size_t scanned;     // Bytes from start already searched for a newline
+    int eof;
+    size_t max_line;    // Longer lines are discarded
+    const char *dropped;    // Why the line just returned was discarded; NULL if it wasn't
+} LineReader;
+
+int line_reader_init(LineReader *reader, int fd, size_t max_line);
+
+// Next line without its terminator, or NULL at EOF. A line longer than
+// max_line, or one the buffer cannot grow to hold, is skipped and comes back
+// empty with dropped set, so the caller can still answer it.
+char *line_reader_next(LineReader *reader, size_t *len);
+void line_reader_free(LineReader *reader);
+
+#endif
@@ -1,12 +1,13 @@
 #define GNU_SOURCE
 #include "../include/usage.h"
-#include <cjson/cJSON.h>
+#include "json_scan.h"
+#include "registry.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 // Pricing constants (per 1M tokens, except search queries per 1K)
-static const double PRICING_TABLE[][5] = {
+static const double PRICING_TABLE[USAGE_MODEL_COUNT][5] = {
     // [input, output, citation, search_per_1k, reasoning]
     [0] = {1.0, 1.0, 0.0, 5.0, 0.0},    // sonar
     [1] = {3.0, 15.0, 0.0, 5.0, 0.0},   // sonar-pro
@@ -15,64 +16,78 @@ static const double PRICING_TABLE[][5] = {
     [4] = {2.0, 8.0, 2.0, 5.0, 3.0}     // sonar-deep-research
 };
 
-static int get_model_index(const char *model) {
-    if (strcmp(model, "sonar") == 0) return 0;
-    if (strcmp(model, "sonar-pro") == 0) return 1;
-    if (strcmp(model, "sonar-reasoning") == 0) return 2;
-    if (strcmp(model, "sonar-reasoning-pro") == 0) return 3;
-    if (strcmp(model, "sonar-deep-research") == 0) return 4;
-    return -1; // Unknown model
+// Row names for PRICING_TABLE
+static const char *const MODEL_NAMES[USAGE_MODEL_COUNT] = {
+    "sonar", "sonar-pro", "sonar-reasoning", "sonar-reasoning-pro", "sonar-deep-research"
+};
+
+int usage_model_index(const char *model) {
+    const ModelDescriptor *descriptor = registry_find_model(model, strlen(model));
+    return descriptor ? descriptor->usage_index : -1;
 }
 
-UsageInfo *parse_usage_from_response(const char *response_json) {
-    cJSON *json = cJSON_Parse(response_json);
-    if (!json) return NULL;
+const char *usage_model_name(int index) {
+    return index >= 0 && index < USAGE_MODEL_COUNT ? MODEL_NAMES[index] : NULL;
+}
 
-    cJSON *usage = cJSON_GetObjectItem(json, "usage");
-    if (!usage || !cJSON_IsObject(usage)) {
-        cJSON_Delete(json);
-        return NULL;
+// Copy a short JSON string value without decoding escapes (enum-like values only)
+static void copy_short_string(const char *p, const char *end, char *out, size_t size) {
+    size_t n = 0;
+    p = json_scan_ws(p, end);
+    if (p < end && *p == '"') {
+        for (p++; p < end && *p != '"' && *p != '\\' && n + 1 < size; p++) out[n++] = *p;
     }
+    out[n] = '\0';
+}
 
-    UsageInfo *info = calloc(1, sizeof(UsageInfo));
-
-    // Parse standard fields
-    cJSON *prompt = cJSON_GetObjectItem(usage, "prompt_tokens");
-    if (cJSON_IsNumber(prompt)) info->prompt_tokens = (int)prompt->valuedouble;
-
-    cJSON *completion = cJSON_GetObjectItem(usage, "completion_tokens");
-    if (cJSON_IsNumber(completion)) info->completion_tokens = (int)completion->valuedouble;
-
-    cJSON *total = cJSON_GetObjectItem(usage, "total_tokens");
-    if (cJSON_IsNumber(total)) info->total_tokens = (int)total->valuedouble;
-
-    // Parse deep research specific fields
-    cJSON *citation = cJSON_GetObjectItem(usage, "citation_tokens");
-    if (cJSON_IsNumber(citation)) info->citation_tokens = (int)citation->valuedouble;
-
-    cJSON *search_queries = cJSON_GetObjectItem(usage, "num_search_queries");
-    if (cJSON_IsNumber(search_queries)) info->num_search_queries = (int)search_queries->valuedouble;
-
-    cJSON *reasoning = cJSON_GetObjectItem(usage, "reasoning_tokens");
-    if (cJSON_IsNumber(reasoning)) info->reasoning_tokens = (int)reasoning->valuedouble;
-
-    // Parse search context size
-    cJSON *search_context = cJSON_GetObjectItem(usage, "search_context_size");
-    if (cJSON_IsString(search_context)) {
-        info->search_context_size = strdup(search_context->valuestring);
+// Fill info from the "usage" object at p (p points into a larger document)
+int parse_usage_object(const char *p, const char *end, UsageInfo *info) {
+    JsonIter it;
+    if (!json_scan_object_begin(&it, p, end)) return -1;
+
+    const char *key, *value;
+    size_t key_len;
+    double number;
+    while (json_scan_object_next(&it, &key, &key_len, &value)) {
+        if (json_scan_key_equals(key, key_len, "search_context_size")) {
+            copy_short_string(value, end, info->search_context_size, sizeof(info->search_context_size));
+            continue;
+        }
+        if (json_scan_number(value, end, &number) != 0) continue;
+
+        if (json_scan_key_equals(key, key_len, "prompt_tokens")) {
+            info->prompt_tokens = (int)number;
+        } else if (json_scan_key_equals(key, key_len, "completion_tokens")) {
+            info->completion_tokens = (int)number;
+        } else if (json_scan_key_equals(key, key_len, "total_tokens")) {
+            info->total_tokens = (int)number;
+        } else if (json_scan_key_equals(key, key_len, "citation_tokens")) {
+            // Deep research specific fields
+            info->citation_tokens = (int)number;
+        } else if (json_scan_key_equals(key, key_len, "num_search_queries")) {
+            info->num_search_queries = (int)number;
+        } else if (json_scan_key_equals(key, key_len, "reasoning_tokens")) {
+            info->reasoning_tokens = (int)number;
+        }
     }
+    return it.error ? -1 : 0;
+}
 
-    cJSON_Delete(json);
-    return info;
+int parse_usage_from_response(const char *response_json, UsageInfo *info) {
+    memset(info, 0, sizeof(*info));
+    const char *end = response_json + strlen(response_json);
+    const char *usage = json_scan_member(response_json, end, "usage");
+    if (!usage) return -1;
+    return parse_usage_object(usage, end, info);
 }
 
-CostInfo *calculate_cost(UsageInfo *usage, const char *model) {
-    if (!usage || !model) return NULL;
+int calculate_cost(const UsageInfo *usage, const char *model, CostInfo *cost) {
+    if (!usage || !model) return -1;
 
-    int model_idx = get_model_index(model);
-    if (model_idx < 0) return NULL;
+    int model_idx = usage_model_index(model);
+    if (model_idx < 0) return -1;
 
-    CostInfo *cost = calloc(1, sizeof(CostInfo));
+    memset(cost, 0, sizeof(*cost));
 
     // Calculate costs based on pricing table
     cost->input_cost = (usage->prompt_tokens / 1000000.0) * PRICING_TABLE[model_idx][0];
@@ -91,43 +106,25 @@ CostInfo *calculate_cost(UsageInfo *usage, const char *model) {
     cost->total_cost = cost->input_cost + cost->output_cost + cost->citation_cost +
                       cost->reasoning_cost + cost->search_cost;
 
-    return cost;
+    return 0;
 }
 
-void log_usage_and_cost(const char *model, const UsageInfo *usage, const CostInfo *cost) {
-    fprintf(stderr, "=== Usage & Cost Report ===\n");
-    fprintf(stderr, "Model: %s\n", model);
-    fprintf(stderr, "Tokens - Input: %d, Output: %d, Total: %d\n",
-            usage->prompt_tokens, usage->completion_tokens, usage->total_tokens);
-
-    if (usage->citation_tokens > 0) {
-        fprintf(stderr, "Citation tokens: %d\n", usage->citation_tokens);
-    }
-    if (usage->reasoning_tokens > 0) {
-        fprintf(stderr, "Reasoning tokens: %d\n", usage->reasoning_tokens);
-    }
-    if (usage->num_search_queries > 0) {
-        fprintf(stderr, "Search queries: %d\n", usage->num_search_queries);
-    }
-    if (usage->search_context_size) {
-        fprintf(stderr, "Search context: %s\n", usage->search_context_size);
-    }
-
-    fprintf(stderr, "Costs - Input: $%.6f, Output: $%.6f", cost->input_cost, cost->output_cost);
-    if (cost->citation_cost > 0) fprintf(stderr, ", Citation: $%.6f", cost->citation_cost);
-    if (cost->reasoning_cost > 0) fprintf(stderr, ", Reasoning: $%.6f", cost->reasoning_cost);
-    if (cost->search_cost > 0) fprintf(stderr, ", Search: $%.6f", cost->search_cost);
-    fprintf(stderr, "\nTotal Cost: $%.6f\n", cost->total_cost);
-    fprintf(stderr, "========================\n");
+// Accumulate the token counts of one billed request into a call's total
+void usage_add(UsageInfo *sum, const UsageInfo *add) {
+    sum->prompt_tokens += add->prompt_tokens;
+    sum->completion_tokens += add->completion_tokens;
+    sum->total_tokens += add->total_tokens;
+    sum->citation_tokens += add->citation_tokens;
+    sum->num_search_queries += add->num_search_queries;
+    sum->reasoning_tokens += add->reasoning_tokens;
 }
 
-void free_usage_info(UsageInfo *usage) {
-    if (usage) {
-        if (usage->search_context_size) free(usage->search_context_size);
-        free(usage);
-    }
-}
-
-void free_cost_info(CostInfo *cost) {
-    if (cost) free(cost);
+// One line per billed call; running totals live in the cost ledger
+void log_usage_and_cost(const char *model, const UsageInfo *usage, const CostInfo *cost) {
+    (void)fprintf(stderr, "Usage: %s in=%d out=%d", model, usage->prompt_tokens, usage->completion_tokens);
+    if (usage->citation_tokens > 0) (void)fprintf(stderr, " citation=%d", usage->citation_tokens);
+    if (usage->reasoning_tokens > 0) (void)fprintf(stderr, " reasoning=%d", usage->reasoning_tokens);
+    if (usage->num_search_queries > 0) (void)fprintf(stderr, " searches=%d", usage->num_search_queries);
+    if (usage->search_context_size[0]) (void)fprintf(stderr, " context=%s", usage->search_context_size);
+    (void)fprintf(stderr, " cost=$%.6f\n", cost->total_cost);
 }
@@ -0,0 +1,130 @@
+#define GNU_SOURCE
+#include "worker_pool.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Pending task (FIFO linked list)
+typedef struct WorkerTask {
+    worker_task_fn fn;
+    void *arg;
+    struct WorkerTask *next;
+} WorkerTask;
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_cond = PTHREAD_COND_INITIALIZER;
+static WorkerTask *queue_head = NULL;
+static WorkerTask *queue_tail = NULL;
+static pthread_t *workers = NULL;
+static int worker_count = 0;
+static int running = 0;
+static int holds = 0;       // Calls in flight on the event loop that will queue more work
+
+static void *worker_main(void *unused) {
+    (void)unused;
+
+    for (;;) {
+        pthread_mutex_lock(&pool_lock);
+        while (!queue_head && (running || holds > 0)) {
+            pthread_cond_wait(&pool_cond, &pool_lock);
+        }
+
+        // Drain remaining tasks, and those of held calls, before exiting on shutdown
+        WorkerTask *task = queue_head;
+        if (!task) {
+            pthread_mutex_unlock(&pool_lock);
+            break;
+        }
+        queue_head = task->next;
+        if (!queue_head) queue_tail = NULL;
+        pthread_mutex_unlock(&pool_lock);
+
+        task->fn(task->arg);
+        free(task);
+    }
+
+    return NULL;
+}
+
+int worker_pool_start(int num_workers) {
+    if (num_workers < 1) num_workers = 1;
+
+    workers = calloc((size_t)num_workers, sizeof(pthread_t));
+    if (!workers) return -1;
+
+    running = 1;
+    for (int i = 0; i < num_workers; i++) {
+        if (pthread_create(&workers[i], NULL, worker_main, NULL) != 0) {
+            (void)fprintf(stderr, "Failed to start worker thread %d\n", i);
+            break;
+        }
+        worker_count++;
+    }
+
+    if (worker_count == 0) {
+        running = 0;
+        free(workers);
+        workers = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+int worker_pool_submit(worker_task_fn fn, void *arg) {
+    WorkerTask *task = malloc(sizeof(WorkerTask));
+    if (!task) return -1;
+    task->fn = fn;
+    task->arg = arg;
+    task->next = NULL;
+
+    pthread_mutex_lock(&pool_lock);
+    if (worker_count == 0 || (!running && holds == 0)) {
+        pthread_mutex_unlock(&pool_lock);
+        free(task);
+        return -1;
+    }
+    if (queue_tail) {
+        queue_tail->next = task;
+    } else {
+        queue_head = task;
+    }
+    queue_tail = task;
+    pthread_cond_signal(&pool_cond);
+    pthread_mutex_unlock(&pool_lock);
+
+    return 0;
+}
+
+void worker_pool_dispatch(worker_task_fn fn, void *arg) {
+    if (worker_pool_submit(fn, arg) != 0) fn(arg);
+}
+
+void worker_pool_hold(void) {
+    pthread_mutex_lock(&pool_lock);
+    holds++;
+    pthread_mutex_unlock(&pool_lock);
+}
+
+void worker_pool_release(void) {
+    pthread_mutex_lock(&pool_lock);
+    if (--holds == 0) pthread_cond_broadcast(&pool_cond);
+    pthread_mutex_unlock(&pool_lock);
+}
+
+// Stop accepting new work, let queued and held calls finish, join all threads
+void worker_pool_shutdown(void) {
+    pthread_mutex_lock(&pool_lock);
+    running = 0;
+    pthread_cond_broadcast(&pool_cond);
+    pthread_mutex_unlock(&pool_lock);
+
+    for (int i = 0; i < worker_count; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    pthread_mutex_lock(&pool_lock);
+    worker_count = 0;
+    pthread_mutex_unlock(&pool_lock);
+    free(workers);
+    workers = NULL;
+}
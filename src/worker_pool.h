@@ -0,0 +1,22 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+// Unit of work executed on a pool thread
+typedef void (*worker_task_fn)(void *arg);
+
+// Worker pool lifecycle
+int worker_pool_start(int num_workers);
+void worker_pool_shutdown(void);
+
+// Queue a task; returns 0 on success, -1 if the pool is not running
+int worker_pool_submit(worker_task_fn fn, void *arg);
+
+// Queue a task, or run it on the calling thread when the pool does not take it
+void worker_pool_dispatch(worker_task_fn fn, void *arg);
+
+// A call waiting on the event loop holds the pool: its completions are still
+// accepted during shutdown, which waits until every hold is released
+void worker_pool_hold(void);
+void worker_pool_release(void);
+
+#endif
@@ -0,0 +1,246 @@
+#!/usr/bin/env python3
+"""End-to-end load driver for the stdio MCP server.
+
+Starts the server (and optionally the local mock API), pipes JSON-RPC
+tools/call traffic into its stdin and reports throughput plus latency
+percentiles per tool. Example:
+
+  tools/load_driver.py --start-mock --requests 500 --concurrency 32 \\
+      --mix perplexity_ask=6,perplexity_reason=2,perplexity_research=2
+"""
+import argparse
+import json
+import os
+import random
+import subprocess
+import sys
+import threading
+import time
+import urllib.parse
+import urllib.request
+
+TOPICS = ["battery storage", "steel decarbonization", "semiconductor supply chains", "grid interconnection queues",
+          "LNG shipping rates", "small modular reactors", "critical minerals policy", "carbon capture economics"]
+MODELS = ["sonar", "sonar-pro", "sonar-reasoning", "sonar-reasoning-pro", "sonar-deep-research"]
+
+
+def percentile(sorted_values, pct):
+    if not sorted_values:
+        return 0.0
+    rank = max(0, min(len(sorted_values) - 1, int(round(pct / 100.0 * len(sorted_values) + 0.5)) - 1))
+    return sorted_values[rank]
+
+
+def parse_mix(text):
+    mix = []
+    for item in text.split(","):
+        name, _, weight = item.partition("=")
+        mix.append((name.strip(), float(weight or 1)))
+    return mix
+
+
+def make_messages(args, rng, index):
+    topic = rng.choice(TOPICS)
+    question = "Question %d: give a comprehensive market analysis of %s." % (index, topic)
+    if len(question) < args.message_bytes:
+        question += " Context: " + ("Consider costs, policy and adoption trends. " *
+                                    (args.message_bytes // 40 + 1))[:args.message_bytes - len(question) - 10]
+    messages = []
+    for turn in range(args.history_turns):
+        messages.append({"role": "user", "content": "Earlier question %d about %s" % (turn, topic)})
+        messages.append({"role": "assistant", "content": "Earlier answer %d. " % turn * 20})
+    messages.append({"role": "user", "content": question})
+    return messages
+
+
+class LoadRun:
+    def __init__(self, args, proc):
+        self.args = args
+        self.proc = proc
+        self.lock = threading.Lock()
+        self.pending = {}           # id -> (tool, start time)
+        self.results = []           # (tool, latency seconds, ok)
+        self.progress = {}          # tool -> notifications received
+        self.slots = threading.Semaphore(args.concurrency)
+        self.done = threading.Event()
+        self.init_done = threading.Event()
+
+    def send(self, message):
+        self.proc.stdin.write((json.dumps(message, separators=(",", ":")) + "\n").encode())
+        self.proc.stdin.flush()
+
+    def reader(self):
+        for raw in self.proc.stdout:
+            try:
+                message = json.loads(raw)
+            except ValueError:
+                continue
+            if message.get("method") == "notifications/progress":
+                token = str(message.get("params", {}).get("progressToken", ""))
+                tool = token.split(":", 1)[0]
+                with self.lock:
+                    self.progress[tool] = self.progress.get(tool, 0) + 1
+                continue
+
+            request_id = message.get("id")
+            if request_id == 0:
+                self.init_done.set()
+                continue
+            with self.lock:
+                entry = self.pending.pop(request_id, None)
+                if entry is None:
+                    continue
+                tool, started = entry
+                ok = "result" in message and not message["result"].get("isError", False)
+                self.results.append((tool, time.monotonic() - started, ok))
+                finished = len(self.results) == self.args.requests
+            self.slots.release()
+            if finished:
+                self.done.set()
+        self.done.set()
+
+    def run(self):
+        rng = random.Random(self.args.seed)
+        mix = parse_mix(self.args.mix)
+        tools = [name for name, _ in mix]
+        weights = [weight for _, weight in mix]
+        previous = {}
+
+        threading.Thread(target=self.reader, daemon=True).start()
+        self.send({"jsonrpc": "2.0", "id": 0, "method": "initialize", "params": {}})
+        if not self.init_done.wait(10):
+            sys.exit("server did not answer initialize")
+
+        start = time.monotonic()
+        for index in range(1, self.args.requests + 1):
+            if self.args.rate > 0:
+                delay = start + (index - 1) / self.args.rate - time.monotonic()
+                if delay > 0:
+                    time.sleep(delay)
+            self.slots.acquire()
+
+            tool = rng.choices(tools, weights)[0]
+            if tool in previous and rng.random() < self.args.duplicate_rate:
+                messages = previous[tool]  # Exercises the response cache and in-flight coalescing
+            else:
+                messages = make_messages(self.args, rng, index)
+                previous[tool] = messages
+
+            params = {"name": tool, "arguments": {"messages": messages}}
+            if self.args.stream:
+                params["_meta"] = {"progressToken": "%s:%d" % (tool, index)}
+            with self.lock:
+                self.pending[index] = (tool, time.monotonic())
+            self.send({"jsonrpc": "2.0", "id": index, "method": "tools/call", "params": params})
+
+        self.done.wait(self.args.timeout)
+        return time.monotonic() - start
+
+
+def report(args, run, elapsed, mock_stats):
+    by_tool = {}
+    for tool, latency, ok in run.results:
+        by_tool.setdefault(tool, []).append((latency, ok))
+
+    summary = {"requests": args.requests, "completed": len(run.results), "timed_out": len(run.pending),
+               "elapsed_s": round(elapsed, 3),
+               "throughput_rps": round(len(run.results) / elapsed, 2) if elapsed > 0 else 0.0,
+               "tools": {}}
+    for tool, samples in sorted(by_tool.items()):
+        latencies = sorted(latency * 1000.0 for latency, _ in samples)
+        summary["tools"][tool] = {
+            "count": len(samples),
+            "errors": sum(1 for _, ok in samples if not ok),
+            "p50_ms": round(percentile(latencies, 50), 2),
+            "p90_ms": round(percentile(latencies, 90), 2),
+            "p99_ms": round(percentile(latencies, 99), 2),
+            "max_ms": round(latencies[-1], 2),
+            "progress_notifications": run.progress.get(tool, 0),
+        }
+    if mock_stats is not None:
+        summary["upstream"] = mock_stats
+
+    if args.json:
+        print(json.dumps(summary, indent=2))
+        return
+
+    print("%d/%d completed in %.2fs: %.1f req/s" % (summary["completed"], args.requests, elapsed,
+                                                   summary["throughput_rps"]))
+    print("%-26s %7s %7s %10s %10s %10s %10s" % ("tool", "count", "errors", "p50 ms", "p90 ms", "p99 ms", "max ms"))
+    for tool, row in summary["tools"].items():
+        print("%-26s %7d %7d %10.1f %10.1f %10.1f %10.1f" % (tool, row["count"], row["errors"], row["p50_ms"],
+                                                           row["p90_ms"], row["p99_ms"], row["max_ms"]))
+    if mock_stats is not None:
+        print("upstream requests: " + ", ".join("%s=%s" % item for item in sorted(mock_stats.items())))
+
+
+def fetch_mock_stats(base_url):
+    try:
+        with urllib.request.urlopen(base_url.rstrip("/") + "/_mock/stats", timeout=2) as response:
+            return json.loads(response.read())
+    except (OSError, ValueError):
+        return None
+
+
+def start_mock(args):
+    port = urllib.parse.urlparse(args.base_url).port or 80
+    script = os.path.join(os.path.dirname(os.path.abspath(__file__)), "mock_perplexity.py")
+    mock = subprocess.Popen([sys.executable, script, "--port", str(port)] + args.mock_arg,
+                            stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+    line = mock.stdout.readline().decode()
+    if "listening" not in line:
+        mock.kill()
+        sys.exit("mock server failed to start: " + line.strip())
+    return mock
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--server", default="./perplexity-mcp-server", help="server binary")
+    parser.add_argument("--base-url", default="http://127.0.0.1:8765", help="PERPLEXITY_API_BASE_URL for the server")
+    parser.add_argument("--start-mock", action="store_true", help="run tools/mock_perplexity.py on the base URL port")
+    parser.add_argument("--mock-arg", action="append", default=[], help="extra mock argument (repeatable)")
+    parser.add_argument("--requests", type=int, default=200)
+    parser.add_argument("--concurrency", type=int, default=16, help="maximum calls in flight")
+    parser.add_argument("--rate", type=float, default=0, help="open-loop arrival rate in req/s (0: closed loop)")
+    parser.add_argument("--mix", default="perplexity_ask=1", help="tool=weight,... e.g. perplexity_ask=3,perplexity_reason=1")
+    parser.add_argument("--message-bytes", type=int, default=200, help="size of the final user message")
+    parser.add_argument("--history-turns", type=int, default=0, help="earlier user/assistant pairs per call")
+    parser.add_argument("--duplicate-rate", type=float, default=0, help="fraction of calls repeating a query")
+    parser.add_argument("--stream", action="store_true", help="request progress notifications (streaming)")
+    parser.add_argument("--workers", type=int, default=0, help="PERPLEXITY_MCP_WORKERS for the server")
+    parser.add_argument("--rate-limits", default=",".join("%s=600000" % m for m in MODELS),
+                        help="PERPLEXITY_RATE_LIMITS for the server (default: high enough not to throttle)")
+    parser.add_argument("--timeout", type=float, default=600, help="seconds to wait for outstanding calls")
+    parser.add_argument("--server-log", default=os.devnull, help="file for the server's stderr")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--json", action="store_true", help="print the summary as JSON")
+    args = parser.parse_args()
+
+    mock = start_mock(args) if args.start_mock else None
+    env = dict(os.environ, PERPLEXITY_API_BASE_URL=args.base_url)
+    env.setdefault("PERPLEXITY_API_KEY", "test")
+    if args.workers > 0:
+        env["PERPLEXITY_MCP_WORKERS"] = str(args.workers)
+    if args.rate_limits:
+        env["PERPLEXITY_RATE_LIMITS"] = args.rate_limits
+
+    with open(args.server_log, "w") as server_log:
+        proc = subprocess.Popen([args.server], stdin=subprocess.PIPE, stdout=subprocess.PIPE, stderr=server_log,
+                                env=env)
+        try:
+            run = LoadRun(args, proc)
+            elapsed = run.run()
+            report(args, run, elapsed, fetch_mock_stats(args.base_url))
+        finally:
+            proc.stdin.close()
+            try:
+                proc.wait(timeout=30)
+            except subprocess.TimeoutExpired:
+                proc.kill()
+            if mock:
+                mock.terminate()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,231 @@
+#!/usr/bin/env python3
+"""Local stand-in for the Perplexity API, for load tests and development.
+
+Serves the endpoints the server uses:
+  POST /chat/completions              (JSON, or SSE when "stream": true)
+  POST /async/chat/completions        (creates a job)
+  GET  /async/chat/completions/<id>   (job status / result)
+  GET  /_mock/stats                   (request counters, for test harnesses)
+
+Point the server at it with:
+  PERPLEXITY_API_BASE_URL=http://127.0.0.1:8765 PERPLEXITY_API_KEY=test ./perplexity-mcp-server
+"""
+import argparse
+import json
+import random
+import threading
+import time
+import uuid
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+FILLER = ("Green hydrogen costs depend on electricity prices, electrolyzer utilization and capex. "
+          "Estimates for 2030 range widely by region; see the cited sources for details. ")
+
+
+class MockState:
+    def __init__(self, args):
+        self.args = args
+        self.lock = threading.Lock()
+        self.jobs = {}
+        self.counters = {"chat": 0, "stream": 0, "async_submit": 0, "async_poll": 0, "errors": 0, "unauthorized": 0}
+
+    def count(self, name):
+        with self.lock:
+            self.counters[name] += 1
+
+    def stats(self):
+        with self.lock:
+            return dict(self.counters, jobs=len(self.jobs))
+
+
+def answer_text(args, messages):
+    question = messages[-1].get("content", "") if messages else ""
+    text = "Answer to: " + question[:200]
+    if args.response_bytes > len(text):
+        repeat = FILLER * (args.response_bytes // len(FILLER) + 1)
+        text = (text + "\n\n" + repeat)[:args.response_bytes]
+    return text
+
+
+def completion(args, model, messages):
+    content = answer_text(args, messages)
+    prompt_bytes = sum(len(m.get("content", "")) for m in messages)
+    prompt_tokens = max(1, prompt_bytes // 4)
+    completion_tokens = max(1, len(content) // 4)
+    return {
+        "id": str(uuid.uuid4()),
+        "model": model,
+        "created": int(time.time()),
+        "object": "chat.completion",
+        "citations": ["https://example.com/source/%d" % i for i in range(args.citations)],
+        "choices": [{"index": 0, "finish_reason": "stop",
+                     "message": {"role": "assistant", "content": content}}],
+        "usage": {"prompt_tokens": prompt_tokens, "completion_tokens": completion_tokens,
+                  "total_tokens": prompt_tokens + completion_tokens, "search_context_size": "low"},
+    }
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    state = None  # Set in main()
+
+    def log_message(self, fmt, *params):
+        if self.state.args.verbose:
+            super().log_message(fmt, *params)
+
+    def send_json(self, code, obj, headers=None):
+        body = json.dumps(obj).encode()
+        self.send_response(code)
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(body)))
+        for name, value in (headers or {}).items():
+            self.send_header(name, value)
+        self.end_headers()
+        self.wfile.write(body)
+
+    def delay(self):
+        args = self.state.args
+        latency = args.latency_ms + random.uniform(0, args.jitter_ms)
+        if latency > 0:
+            time.sleep(latency / 1000.0)
+
+    # Returns True when the request was answered with an error
+    def reject(self):
+        if not self.headers.get("Authorization", "").startswith("Bearer "):
+            self.state.count("unauthorized")
+            self.send_json(401, {"error": {"message": "Missing API key", "type": "unauthorized"}})
+            return True
+        args = self.state.args
+        if args.error_rate > 0 and random.random() < args.error_rate:
+            self.state.count("errors")
+            headers = {"Retry-After": str(args.retry_after)} if args.error_status == 429 else None
+            self.send_json(args.error_status, {"error": {"message": "Injected failure", "code": args.error_status}},
+                           headers)
+            return True
+        return False
+
+    def read_body(self):
+        length = int(self.headers.get("Content-Length", 0))
+        return json.loads(self.rfile.read(length) or b"{}")
+
+    def do_POST(self):
+        body = self.read_body()
+        path = self.path.rstrip("/")
+        if path.endswith("/async/chat/completions"):
+            self.submit_job(body)
+        elif path.endswith("/chat/completions"):
+            self.chat(body)
+        else:
+            self.send_json(404, {"error": {"message": "Not found"}})
+
+    def chat(self, body):
+        self.delay()
+        if self.reject():
+            return
+        model = body.get("model", "sonar-pro")
+        messages = body.get("messages", [])
+        if body.get("stream"):
+            self.state.count("stream")
+            self.stream(completion(self.state.args, model, messages))
+        else:
+            self.state.count("chat")
+            self.send_json(200, completion(self.state.args, model, messages))
+
+    def write_chunk(self, data):
+        self.wfile.write(b"%x\r\n%s\r\n" % (len(data), data))
+        self.wfile.flush()
+
+    def stream(self, full):
+        args = self.state.args
+        self.send_response(200)
+        self.send_header("Content-Type", "text/event-stream")
+        self.send_header("Transfer-Encoding", "chunked")
+        self.end_headers()
+
+        text = full["choices"][0]["message"]["content"]
+        size = max(1, args.stream_chunk_chars)
+        parts = [text[i:i + size] for i in range(0, len(text), size)] or [""]
+        for i, part in enumerate(parts):
+            event = {"id": full["id"], "model": full["model"], "object": "chat.completion.chunk",
+                     "choices": [{"index": 0, "delta": {"role": "assistant", "content": part}}]}
+            if i == len(parts) - 1:
+                event["usage"] = full["usage"]
+                event["citations"] = full["citations"]
+            self.write_chunk(("data: " + json.dumps(event) + "\r\n\r\n").encode())
+            if args.stream_interval_ms > 0:
+                time.sleep(args.stream_interval_ms / 1000.0)
+        self.write_chunk(b"data: [DONE]\r\n\r\n")
+        self.wfile.write(b"0\r\n\r\n")
+
+    def submit_job(self, body):
+        self.delay()
+        if self.reject():
+            return
+        self.state.count("async_submit")
+        request = body.get("request", {})
+        job_id = str(uuid.uuid4())
+        failed = random.random() < self.state.args.job_fail_rate
+        with self.state.lock:
+            self.state.jobs[job_id] = (time.time(), request, failed)
+        self.send_json(200, {"id": job_id, "model": request.get("model"), "status": "CREATED",
+                             "created_at": int(time.time())})
+
+    def do_GET(self):
+        if self.path.rstrip("/") == "/_mock/stats":
+            return self.send_json(200, self.state.stats())
+
+        self.state.count("async_poll")
+        job_id = self.path.rstrip("/").rsplit("/", 1)[-1]
+        with self.state.lock:
+            job = self.state.jobs.get(job_id)
+        if not job:
+            return self.send_json(404, {"error": {"message": "Job not found"}})
+
+        started, request, failed = job
+        args = self.state.args
+        if time.time() - started < args.job_duration:
+            return self.send_json(200, {"id": job_id, "model": request.get("model"), "status": "IN_PROGRESS"})
+        if failed:
+            return self.send_json(200, {"id": job_id, "model": request.get("model"), "status": "FAILED",
+                                        "error_message": "Injected job failure"})
+
+        result = completion(args, request.get("model", "sonar-deep-research"), request.get("messages", []))
+        result["usage"].update({"citation_tokens": 1200, "num_search_queries": 12, "reasoning_tokens": 30000})
+        self.send_json(200, {"id": job_id, "model": result["model"], "status": "COMPLETED", "response": result})
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=8765)
+    parser.add_argument("--latency-ms", type=float, default=200, help="delay before each answer")
+    parser.add_argument("--jitter-ms", type=float, default=0, help="extra uniform random delay")
+    parser.add_argument("--response-bytes", type=int, default=0, help="pad answers to this many characters")
+    parser.add_argument("--citations", type=int, default=2)
+    parser.add_argument("--stream-chunk-chars", type=int, default=16, help="characters per SSE delta")
+    parser.add_argument("--stream-interval-ms", type=float, default=20, help="delay between SSE events")
+    parser.add_argument("--job-duration", type=float, default=5, help="seconds until an async job completes")
+    parser.add_argument("--job-fail-rate", type=float, default=0, help="fraction of async jobs that fail")
+    parser.add_argument("--error-rate", type=float, default=0, help="fraction of requests answered with an error")
+    parser.add_argument("--error-status", type=int, default=500, help="HTTP status for injected errors")
+    parser.add_argument("--retry-after", type=int, default=1, help="Retry-After seconds sent with 429s")
+    parser.add_argument("--seed", type=int, default=None)
+    parser.add_argument("--verbose", action="store_true")
+    args = parser.parse_args()
+
+    if args.seed is not None:
+        random.seed(args.seed)
+    Handler.state = MockState(args)
+    # The default listen backlog of 5 makes connection bursts retry their SYN after 1s
+    ThreadingHTTPServer.request_queue_size = 1024
+    server = ThreadingHTTPServer((args.host, args.port), Handler)
+    server.daemon_threads = True
+    print("Mock Perplexity API listening on http://%s:%d" % (args.host, server.server_address[1]), flush=True)
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()